@@ -0,0 +1,198 @@
+#!/usr/bin/env node
+// Decode audio files with the Node.js build of JuliusJS, for regression
+// and throughput runs over an utterance corpus.
+//
+//   node bin/batch.js [--threads 4] [--build js/recognizer-node.js]
+//                     [--model dist/voxforge] [--dfa f.dfa --dict f.dict]
+//                     [--log] [--list files.txt | file ...] [-- julius options]
+//
+// Files are WAV or headerless raw (16-bit big endian, as Julius reads
+// them) at the sampling rate of the model, one utterance each.  They are
+// shared out by size across `worker_threads`, each loading its own
+// engine (`NODE=1 ./emscript.sh` builds recognizer-node.js), which reads
+// them with `-input rawfile -filelist` through the same event-driven
+// loop as the browser.
+//
+// One JSON line is written per file, as it is done:
+//   {"file", "thread", "sentence", "score", "status", "audio", "cpu",
+//    "rtf", "wall"}
+// (times in msec.; `audio`, `cpu` and `rtf` are the engine gauges, `wall`
+// the elapsed time of the file on its thread), then a summary line with
+// totals and the overall speed (audio / elapsed time of the run).
+
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+var threads = require('worker_threads');
+
+var cli = require('../test/cli')('batch',
+  'usage: batch.js [--threads 4] [--build js/recognizer-node.js] [--model dist/voxforge]\n' +
+  '                [--dfa f.dfa --dict f.dict] [--log] [--list files.txt | file ...] [-- julius options]');
+var fail = cli.fail;
+
+// - engine thread
+
+var decode = function(job) {
+  var current = null;
+  var Recognizer = require(job.build);
+
+  var finish = function() {
+    if (!current) return;
+    current.wall = Date.now() - current.wall;
+    threads.parentPort.postMessage({type: 'result', result: current});
+    current = null;
+  };
+
+  // Functions called by the engine (see recogloop.c and recogmain.c)
+  global.fileBegin = function(name) {
+    finish();
+    current = {file: name, thread: threads.threadId, sentence: null, score: null, status: null,
+               audio: null, cpu: null, rtf: null, wall: Date.now()};
+  };
+  global.filesDone = function(count) {
+    finish();
+    threads.parentPort.postMessage({type: 'done', count: count});
+  };
+  global.gauges = function(audio, cpu, rtf) {
+    if (!current) return;
+    current.audio = audio;
+    current.cpu = cpu;
+    current.rtf = rtf;
+  };
+  global.pass1final = global.pass1verified = global.spotted = global.cascade = function() {};
+
+  var print = function(line) {
+    var match;
+    if (current && (match = line.match(/^sentence1: (.*)/))) current.sentence = match[1];
+    else if (current && (match = line.match(/^score1: (.*)/))) current.score = parseFloat(match[1]);
+    else if (current && (match = line.match(/^<(.*)>$/))) current.status = match[1];
+    else if (job.log) console.error(line);
+  };
+  var printErr = function(line) { if (job.log) console.error(line); };
+
+  Recognizer({print: print, printErr: printErr}).then(function(Module) {
+    Module.callMain(job.args);
+  });
+};
+
+if (!threads.isMainThread) {
+  decode(threads.workerData);
+  return;
+}
+
+// - options
+
+var opts = {
+  threads: os.cpus().length,
+  build: path.join(__dirname, '..', 'js', 'recognizer-node.js'),
+  model: path.join(__dirname, '..', 'dist', 'voxforge'),
+  dfa: null,
+  dict: null,
+  log: false
+};
+var listed = [];
+var extra = [];
+var files = cli.parse({
+  '--threads': function(n) { opts.threads = parseInt(n, 10); },
+  '--build': function(file) { opts.build = path.resolve(file); },
+  '--model': function(dir) { opts.model = path.resolve(dir); },
+  '--dfa': function(file) { opts.dfa = path.resolve(file); },
+  '--dict': function(file) { opts.dict = path.resolve(file); },
+  '--log': function() { opts.log = true; },
+  '--list': function(list) {
+    try {
+      fs.readFileSync(list, 'utf8').split(/\r?\n/).forEach(function(line) {
+        line = line.trim();
+        if (line && line[0] !== '#') listed.push(path.resolve(path.dirname(list), line));
+      });
+    } catch (e) { fail(e.message); }
+  },
+  '--': function(args) { extra = args; }
+}).map(function(file) { return path.resolve(file); }).concat(listed);
+if (!(opts.threads > 0) || !files.length || (!opts.dfa !== !opts.dict)) cli.usage();
+cli.need(opts.build, 'NODE=1 ./emscript.sh');
+
+// Larger files first, each to the least loaded thread
+var sizes = {};
+files.forEach(function(file) {
+  try { sizes[file] = fs.statSync(file).size; }
+  catch (e) { fail(e.message); }
+});
+if (opts.threads > files.length) opts.threads = files.length;
+var shards = [];
+for (var i = 0; i < opts.threads; i++) shards.push({files: [], size: 0});
+files.slice().sort(function(a, b) { return sizes[b] - sizes[a]; }).forEach(function(file) {
+  var shard = shards.reduce(function(a, b) { return b.size < a.size ? b : a; });
+  shard.files.push(file);
+  shard.size += sizes[file];
+});
+
+var engineArgs = function(list) {
+  var model = opts.model;
+  var out = [
+    '-input',    'rawfile',
+    '-filelist', list,
+    '-h',        path.join(model, 'hmmdefs'),
+    '-hlist',    path.join(model, 'tiedlist'),
+    '-dfa',      opts.dfa || path.join(model, 'sample.dfa'),
+    '-v',        opts.dict || path.join(model, 'sample.dict')
+  ];
+  // model files made by bin/hquant.js and bin/gselect.js, as worker.js
+  if (fs.existsSync(path.join(model, 'hmmdefs.q'))) out.push('-hquant', path.join(model, 'hmmdefs.q'));
+  if (fs.existsSync(path.join(model, 'hmmdefs.gs'))) out.push('-gselect', path.join(model, 'hmmdefs.gs'));
+  if (!opts.log) out.push('-nolog');
+  return out.concat(extra);
+};
+
+// - run
+
+var start = Date.now();
+var total = {files: 0, failed: 0, audio: 0, cpu: 0};
+var running = shards.length;
+var lists = [];
+
+shards.forEach(function(shard, n) {
+  var list = path.join(os.tmpdir(), 'juliusjs-batch-' + process.pid + '-' + n + '.list');
+  fs.writeFileSync(list, shard.files.join('\n') + '\n');
+  lists.push(list);
+
+  var worker = new threads.Worker(__filename, {
+    workerData: {build: opts.build, args: engineArgs(list), log: opts.log}
+  });
+  worker.on('message', function(message) {
+    if (message.type === 'result') {
+      var r = message.result;
+      total.files++;
+      if (r.sentence === null) total.failed++;
+      total.audio += r.audio || 0;
+      total.cpu += r.cpu || 0;
+      console.log(JSON.stringify(r));
+    } else if (message.type === 'done') {
+      worker.terminate();
+    }
+  });
+  worker.on('error', function(error) {
+    console.error('batch: thread ' + n + ': ' + (error.stack || error));
+    process.exitCode = 1;
+  });
+  worker.on('exit', function() {
+    if (--running) return;
+    lists.forEach(function(list) { fs.unlinkSync(list); });
+    var wall = Date.now() - start;
+    console.log(JSON.stringify({
+      summary: true,
+      files: total.files,
+      failed: total.failed,
+      threads: shards.length,
+      audio: total.audio,
+      cpu: total.cpu,
+      wall: wall,
+      rtf: total.audio ? total.cpu / total.audio : null,
+      speed: wall ? total.audio / wall : null
+    }));
+    if (total.files < files.length) {
+      console.error('batch: ' + (files.length - total.files) + ' files were not decoded');
+      process.exitCode = 1;
+    }
+  });
+});
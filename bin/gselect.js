@@ -0,0 +1,197 @@
+#!/usr/bin/env node
+// Build a Gaussian selection codebook for an HTK ASCII hmmdefs.
+//
+//   node bin/gselect.js [--size 64] [--ratio 0.25] in/hmmdefs out/hmmdefs.gs
+//
+// The means of all Gaussians are clustered (k-means, in dimensions
+// normalized by their spread) into `size` codewords.  Each codeword lists
+// the Gaussians whose Mahalanobis distance to it is below a threshold,
+// chosen so that lists hold about `ratio` of all Gaussians; the members
+// of its cluster are always listed.  With `-gselect`, the engine finds the
+// nearest codeword of each frame and computes only the listed Gaussians,
+// flooring the others at a distance most Gaussians are from most codewords
+// (the 90th percentile), so that floors seldom outscore computed
+// Gaussians (see libjulius/src/outprob_simd.c).
+//
+// The fraction of Gaussians computed and the output probability
+// difference against computing all of them on synthetic frames are
+// reported on stdout.
+
+var fs = require('fs');
+var hmmdefs = require('./hmmdefs');
+
+var BENCH_FRAMES = 200;
+var ITERATIONS = 20;
+var FLOOR_QUANTILE = 0.9;
+
+var cli = require('../test/cli')('gselect', 'usage: gselect.js [--size 64] [--ratio 0.25] in/hmmdefs out/hmmdefs.gs');
+var fail = cli.fail;
+
+var size = 64, ratio = 0.25;
+var args = cli.parse({
+  '--size': function(n) { size = parseInt(n, 10); },
+  '--ratio': function(x) { ratio = parseFloat(x); }
+});
+if (!(size > 0) || !(ratio > 0 && ratio <= 1) || args.length !== 2) cli.usage();
+
+var model;
+try { model = hmmdefs.read(args[0]); }
+catch (e) { fail(e.message); }
+var veclen = model.veclen;
+var states = hmmdefs.sortByName(model.states);
+
+// All Gaussians, numbered by state (in name order) then mixture
+var gaussians = [];
+states.forEach(function(s) {
+  s.first = gaussians.length;
+  s.mixtures.forEach(function(m) { gaussians.push(m); });
+});
+if (size > gaussians.length) size = gaussians.length;
+
+// - cluster
+
+// Normalize each dimension by the spread of the means
+var offset = [], scale = [];
+for (var d = 0; d < veclen; d++) {
+  var sum = 0, sum2 = 0;
+  gaussians.forEach(function(g) { sum += g.mean[d]; sum2 += g.mean[d] * g.mean[d]; });
+  var mean = sum / gaussians.length;
+  offset.push(mean);
+  scale.push(Math.sqrt(Math.max(sum2 / gaussians.length - mean * mean, 0)) || 1);
+}
+var normalize = function(x) {
+  return x.map(function(v, d) { return (v - offset[d]) / scale[d]; });
+};
+var points = gaussians.map(function(g) { return normalize(g.mean); });
+
+var distance = function(a, b) {
+  var sum = 0;
+  for (var d = 0; d < veclen; d++) sum += (a[d] - b[d]) * (a[d] - b[d]);
+  return sum;
+};
+var nearest = function(codewords, x) {
+  var best = 0, bestDist = Infinity;
+  codewords.forEach(function(c, i) {
+    var dist = distance(c, x);
+    if (dist < bestDist) { bestDist = dist; best = i; }
+  });
+  return best;
+};
+
+var codewords = [];
+for (var i = 0; i < size; i++) codewords.push(points[Math.floor(i * points.length / size)].slice());
+var assign = [];
+for (var it = 0; it < ITERATIONS; it++) {
+  assign = points.map(function(p) { return nearest(codewords, p); });
+  var sums = codewords.map(function() { return {n: 0, v: new Array(veclen).fill(0)}; });
+  points.forEach(function(p, g) {
+    var s = sums[assign[g]];
+    s.n++;
+    for (var d = 0; d < veclen; d++) s.v[d] += p[d];
+  });
+  sums.forEach(function(s, c) {
+    if (s.n) codewords[c] = s.v.map(function(v) { return v / s.n; });
+  });
+}
+
+// - shortlists
+
+// Mahalanobis distance from each codeword (in model space) to each Gaussian
+var mahalanobis = function(m, x) {
+  var sum = 0;
+  for (var d = 0; d < veclen; d++) {
+    var diff = x[d] - m.mean[d];
+    sum += diff * diff / m.variance[d];
+  }
+  return sum;
+};
+var centers = codewords.map(function(c) {
+  return c.map(function(v, d) { return offset[d] + v * scale[d]; });
+});
+var dists = centers.map(function(c) {
+  return gaussians.map(function(g) { return mahalanobis(g, c); });
+});
+
+var all = [];
+dists.forEach(function(row) { row.forEach(function(v) { all.push(v); }); });
+all.sort(function(a, b) { return a - b; });
+var threshold = all[Math.min(all.length - 1, Math.floor(all.length * ratio))];
+var floor = Math.max(threshold, all[Math.floor(all.length * FLOOR_QUANTILE)]);
+
+var lists = dists.map(function(row, c) {
+  var list = [];
+  row.forEach(function(v, g) { if (v <= threshold || assign[g] === c) list.push(g); });
+  return list;
+});
+
+// - write
+//
+// Little endian:
+//   "JGSL", int32 version (1), int32 veclen, int32 number of codewords,
+//   int32 number of states, float32 threshold, float32 floor distance,
+//   float32 offset[veclen], scale[veclen] (normalized = (x - offset) / scale),
+//   float32 codeword[number of codewords][veclen] (normalized),
+//   per state, sorted by name: uint8 name length, name,
+//                              int32 number of mixtures,
+//   per codeword: int32 number of Gaussians, int32 Gaussian[number]
+//   (Gaussians are numbered by state then mixture)
+
+var bytes = 4 + 4 * 4 + 8 + veclen * 8 + size * veclen * 4;
+states.forEach(function(s) { bytes += 1 + Buffer.byteLength(s.name) + 4; });
+lists.forEach(function(list) { bytes += 4 + list.length * 4; });
+
+var out = Buffer.alloc(bytes);
+var pos = 0;
+out.write('JGSL', pos); pos += 4;
+[1, veclen, size, states.length].forEach(function(v) { out.writeInt32LE(v, pos); pos += 4; });
+out.writeFloatLE(threshold, pos); pos += 4;
+out.writeFloatLE(floor, pos); pos += 4;
+offset.concat(scale).forEach(function(v) { out.writeFloatLE(v, pos); pos += 4; });
+codewords.forEach(function(c) { c.forEach(function(v) { out.writeFloatLE(v, pos); pos += 4; }); });
+states.forEach(function(s) {
+  var name = Buffer.from(s.name);
+  if (name.length > 255) fail(s.name + ': name too long');
+  out.writeUInt8(name.length, pos++);
+  name.copy(out, pos); pos += name.length;
+  out.writeInt32LE(s.mixtures.length, pos); pos += 4;
+});
+lists.forEach(function(list) {
+  out.writeInt32LE(list.length, pos); pos += 4;
+  list.forEach(function(g) { out.writeInt32LE(g, pos); pos += 4; });
+});
+fs.writeFileSync(args[1], out);
+
+// - report
+
+var listed = 0;
+lists.forEach(function(list) { listed += list.length; });
+console.log('gselect: ' + gaussians.length + ' Gaussians, ' + size + ' codewords, threshold ' +
+  threshold.toFixed(1) + ', floor ' + floor.toFixed(1) + ', ' + (out.length / 1024).toFixed(0) + ' KB');
+
+var computed = 0, agree = 0, sumdiff = 0, count = 0;
+hmmdefs.benchFrames(states, veclen, BENCH_FRAMES).forEach(function(x) {
+  var c = nearest(codewords, normalize(x));
+  var selected = {};
+  lists[c].forEach(function(g) { selected[g] = true; });
+  computed += lists[c].length;
+
+  var bestAll = -1, bestSel = -1, pAll = -Infinity, pSel = -Infinity;
+  states.forEach(function(s, i) {
+    var full = s.mixtures.map(function(m) { return hmmdefs.gaussian(m, x); });
+    var sel = s.mixtures.map(function(m, k) {
+      if (selected[s.first + k]) return full[k];
+      // the Gaussian at the floor distance
+      var far = m.mean.map(function(v, d) { return v + Math.sqrt(floor / veclen * m.variance[d]); });
+      return hmmdefs.gaussian(m, far);
+    });
+    var p = hmmdefs.logadd10(full), q = hmmdefs.logadd10(sel);
+    if (p > pAll) { pAll = p; bestAll = i; }
+    if (q > pSel) { pSel = q; bestSel = i; }
+  });
+  if (bestAll === bestSel) agree++;
+  sumdiff += Math.abs(pAll - pSel); count++;
+});
+console.log('selection: ' + (100 * computed / count / gaussians.length).toFixed(1) +
+  '% of Gaussians computed (' + (100 * listed / size / gaussians.length).toFixed(1) + '% listed on average)');
+console.log('accuracy: best state agreed on ' + agree + '/' + BENCH_FRAMES +
+  ' frames, mean best score diff ' + (sumdiff / count).toFixed(4) + ' (log10)');
@@ -0,0 +1,122 @@
+// Read the Gaussians of an HTK ASCII hmmdefs, for the model tools
+// (hquant.js, gselect.js).
+//
+// Only states defined as `~s` macros with inline Gaussians (as in the
+// voxforge model) are supported; errors are thrown.
+
+var fs = require('fs');
+
+// Split into macro definitions, each starting with `~x "name"`; macros
+// referred to inside an HMM stay with it, up to <ENDHMM>
+var split = function(text) {
+  var chunks = [];
+  text.split(/^(?=~)/m).forEach(function(chunk) {
+    var last = chunks[chunks.length - 1];
+    if (last && /^~h/.test(last) && !/<ENDHMM>/i.test(last)) chunks[chunks.length - 1] += chunk;
+    else chunks.push(chunk);
+  });
+  return chunks;
+};
+
+var parseState = function(model, name, body) {
+  var tokens = body.trim().split(/\s+/);
+  var mixtures = [];
+  var mix = null;
+  var i = 0;
+  var vector = function() {
+    var n = parseInt(tokens[i++], 10);
+    if (model.veclen && n !== model.veclen)
+      throw new Error(name + ': vector length ' + n + ', expected ' + model.veclen);
+    model.veclen = n;
+    var v = [];
+    for (var k = 0; k < n; k++) v.push(parseFloat(tokens[i++]));
+    return v;
+  };
+
+  while (i < tokens.length) {
+    var token = tokens[i++].toUpperCase();
+    if (token === '<NUMMIXES>') {
+      i++;
+    } else if (token === '<MIXTURE>') {
+      i++;
+      mix = {weight: parseFloat(tokens[i++])};
+      mixtures.push(mix);
+    } else if (token === '<MEAN>') {
+      if (!mix || mix.mean) mixtures.push(mix = {weight: 1.0});
+      mix.mean = vector();
+    } else if (token === '<VARIANCE>') {
+      mix.variance = vector();
+    } else if (token === '<GCONST>') {
+      mix.gconst = tokens[i++];
+    } else {
+      throw new Error(name + ': ' + token + ' is not supported');
+    }
+  }
+  mixtures.forEach(function(m) {
+    if (!m.mean || !m.variance) throw new Error(name + ': mixture without mean or variance');
+  });
+  return mixtures;
+};
+
+// Read a model: `chunks` are the macro definitions, `states` the `~s`
+// states in file order, each with its chunk index and mixtures
+// ({weight, mean, variance, gconst}).
+exports.read = function(file) {
+  var model = {veclen: 0, states: []};
+  model.text = fs.readFileSync(file, 'latin1');
+  model.chunks = split(model.text);
+  model.chunks.forEach(function(chunk, index) {
+    var head = chunk.match(/^~(\w) "([^"]*)"/);
+    if (!head || head[1] !== 's') {
+      if (head && /<MEAN>/i.test(chunk))
+        throw new Error('~' + head[1] + ' "' + head[2] + '": inline Gaussians are not supported');
+      return;
+    }
+    model.states.push({
+      name: head[2],
+      chunk: index,
+      head: head[0],
+      mixtures: parseState(model, head[2], chunk.slice(head[0].length))
+    });
+  });
+  if (!model.states.length) throw new Error('no ~s state found');
+  return model;
+};
+
+// Sort states as strcmp() does, for the engine to search them
+exports.sortByName = function(states) {
+  return states.slice().sort(function(a, b) {
+    return Buffer.compare(Buffer.from(a.name), Buffer.from(b.name));
+  });
+};
+
+// Natural log likelihood of a Gaussian, weight included
+exports.gaussian = function(m, x) {
+  var sum = x.length * Math.log(2 * Math.PI);
+  for (var d = 0; d < x.length; d++) {
+    var diff = x[d] - m.mean[d];
+    sum += diff * diff / m.variance[d] + Math.log(m.variance[d]);
+  }
+  return -0.5 * sum + Math.log(m.weight);
+};
+
+// log10 output probability from natural log mixture scores, as calc_mix()
+exports.logadd10 = function(scores) {
+  var max = -Infinity, total = 0;
+  scores.forEach(function(score) { if (score > max) max = score; });
+  scores.forEach(function(score) { total += Math.exp(score - max); });
+  return (max + Math.log(total)) / Math.LN10;
+};
+
+// Synthetic frames: state means, perturbed as the engine benchmark does
+// (see simd_bench() in libjulius/src/outprob_simd.c)
+exports.benchFrames = function(states, veclen, num) {
+  var frames = [];
+  for (var f = 0; f < num; f++) {
+    var base = states[(f * 7919) % states.length].mixtures[0].mean;
+    var x = [];
+    for (var d = 0; d < veclen; d++) x.push(base[d] + 0.1 * (((f * 31 + d * 17) % 21) - 10) / 10.0);
+    frames.push(x);
+  }
+  return frames;
+};
@@ -0,0 +1,261 @@
+#!/usr/bin/env node
+// Quantize the Gaussians of an HTK ASCII hmmdefs for JuliusJS.
+//
+//   node bin/hquant.js [--format 8|16] in/hmmdefs out/hmmdefs out/hmmdefs.q
+//
+// Writes two files:
+// - a skeleton hmmdefs, where every mean is zero and every variance refers
+//   to one shared unit variance macro, so that Julius still reads the
+//   model structure from it.  Julius has no mean macros, so each Gaussian
+//   keeps a zero mean of its own: the skeleton is small gzipped, and
+//   saves the heap of the variances, not that of the means;
+// - the quantized means and inverse variances of each state, loaded by
+//   the engine with `-hquant` (see libjulius/src/outprob_simd.c).
+//
+// With `--format 8` (default), values are int8 with a per-dimension offset
+// and scale; with `--format 16`, they are IEEE half floats.  Gaussian
+// constants are recomputed from the quantized variances.
+//
+// Only states defined as `~s` macros with inline Gaussians (as in the
+// voxforge model) are supported (see hmmdefs.js).
+//
+// Sizes, parameter memory, the heap the Gaussians take in the engine
+// (vectors read from hmmdefs and blocks packed by outprob_simd.c) and the
+// output probability difference against the original model on synthetic
+// frames are reported on stdout.
+
+var fs = require('fs');
+var zlib = require('zlib');
+var hmmdefs = require('./hmmdefs');
+
+var UNIT = 'JQHM_unit';
+var BENCH_FRAMES = 200;
+
+var cli = require('../test/cli')('hquant', 'usage: hquant.js [--format 8|16] in/hmmdefs out/hmmdefs out/hmmdefs.q');
+var fail = cli.fail;
+
+var format = 8;
+var args = cli.parse({
+  '--format': function(n) { format = parseInt(n, 10); }
+});
+if ((format !== 8 && format !== 16) || args.length !== 3) cli.usage();
+
+var model;
+try { model = hmmdefs.read(args[0]); }
+catch (e) { fail(e.message); }
+var veclen = model.veclen;
+
+var skeleton = model.chunks.slice();
+model.states.forEach(function(s) {
+  var out = s.head + '\n';
+  if (s.mixtures.length > 1) out += '<NUMMIXES> ' + s.mixtures.length + '\n';
+  s.mixtures.forEach(function(m, i) {
+    if (s.mixtures.length > 1) out += '<MIXTURE> ' + (i + 1) + ' ' + m.weight + '\n';
+    out += '<MEAN> ' + veclen + '\n' + new Array(veclen + 1).join(' 0') + '\n';
+    out += '~v "' + UNIT + '"\n';
+    if (m.gconst !== undefined) out += '<GCONST> ' + m.gconst + '\n';
+  });
+  skeleton[s.chunk] = out;
+});
+
+// The shared variance follows the global options (first macro)
+skeleton.splice(/^~o/.test(model.chunks[0]) ? 1 : 0, 0,
+  '~v "' + UNIT + '"\n<VARIANCE> ' + veclen + '\n' + new Array(veclen + 1).join(' 1') + '\n');
+
+var states = hmmdefs.sortByName(model.states);
+
+// - quantize
+
+var toHalf = function(value) {
+  var f = new Float32Array([value]);
+  var x = new Uint32Array(f.buffer)[0];
+  var sign = (x >>> 16) & 0x8000;
+  var exp = ((x >>> 23) & 0xff) - 127 + 15;
+  var mant = x & 0x7fffff;
+  if (exp <= 0) {
+    if (exp < -10) return sign;
+    mant = (mant | 0x800000) >> (1 - exp);
+    return sign | ((mant + 0x1000) >> 13);
+  }
+  if (exp >= 31) return sign | 0x7c00;
+  var h = sign | (exp << 10) | (mant >> 13);
+  if (mant & 0x1000) h++;
+  return h;
+};
+
+var fromHalf = function(h) {
+  var sign = (h & 0x8000) ? -1 : 1;
+  var exp = (h >> 10) & 0x1f;
+  var mant = h & 0x3ff;
+  if (exp === 0) return sign * Math.pow(2, -14) * (mant / 1024);
+  if (exp === 31) return sign * Infinity;
+  return sign * Math.pow(2, exp - 15) * (1 + mant / 1024);
+};
+
+var range = function(key, f) {
+  var min = [], max = [];
+  for (var d = 0; d < veclen; d++) { min.push(Infinity); max.push(-Infinity); }
+  states.forEach(function(s) {
+    s.mixtures.forEach(function(m) {
+      for (var d = 0; d < veclen; d++) {
+        var v = f(m[key][d]);
+        if (v < min[d]) min[d] = v;
+        if (v > max[d]) max[d] = v;
+      }
+    });
+  });
+  return {min: min, max: max};
+};
+
+var meanRange = range('mean', function(v) { return v; });
+var ivarRange = range('variance', function(v) { return 1.0 / v; });
+var meanOffset = [], meanScale = [], ivarOffset = [], ivarScale = [];
+for (var d = 0; d < veclen; d++) {
+  if (format === 8) {
+    meanOffset.push((meanRange.max[d] + meanRange.min[d]) / 2);
+    meanScale.push((meanRange.max[d] - meanRange.min[d]) / 254 || 1);
+    ivarOffset.push(ivarRange.min[d]);
+    ivarScale.push((ivarRange.max[d] - ivarRange.min[d]) / 255 || 1);
+  } else {
+    meanOffset.push(0); meanScale.push(1); ivarOffset.push(0); ivarScale.push(1);
+  }
+}
+
+var clamp = function(v, lo, hi) { return v < lo ? lo : (v > hi ? hi : v); };
+var f32 = function(v) { return Math.fround(v); };
+
+// Quantized values, and the values the engine will compute with
+states.forEach(function(s) {
+  s.mixtures.forEach(function(m) {
+    m.qmean = []; m.qivar = []; m.dmean = []; m.divar = [];
+    for (var d = 0; d < veclen; d++) {
+      var mean = m.mean[d], ivar = 1.0 / m.variance[d];
+      if (format === 8) {
+        var qm = clamp(Math.round((mean - meanOffset[d]) / meanScale[d]), -127, 127);
+        var qh = clamp(Math.round((ivar - ivarOffset[d]) / ivarScale[d]), 0, 255);
+        m.qmean.push(qm); m.qivar.push(qh);
+        m.dmean.push(f32(meanOffset[d]) + f32(meanScale[d]) * qm);
+        m.divar.push(f32(ivarOffset[d]) + f32(ivarScale[d]) * qh);
+      } else {
+        m.qmean.push(toHalf(mean)); m.qivar.push(toHalf(ivar));
+        m.dmean.push(fromHalf(m.qmean[d])); m.divar.push(fromHalf(m.qivar[d]));
+      }
+    }
+    m.gconst = veclen * Math.log(2 * Math.PI);
+    for (d = 0; d < veclen; d++) {
+      // keep a usable Gaussian if an inverse variance rounds to zero
+      if (m.divar[d] <= 0) m.divar[d] = ivarScale[d] / 2;
+      m.gconst -= Math.log(m.divar[d]);
+    }
+  });
+});
+
+// - write
+//
+// Little endian:
+//   "JQHM", int32 version (1), int32 format (8 or 16), int32 veclen,
+//   int32 number of states,
+//   float32 mean offset[veclen], mean scale[veclen],
+//           inverse variance offset[veclen], inverse variance scale[veclen],
+//   then per state, sorted by name:
+//     uint8 name length, name, int32 number of mixtures,
+//     per mixture: float32 log weight, float32 gconst,
+//                  mean[veclen], inverse variance[veclen]
+//                  (int8/uint8 with format 8, half floats with format 16)
+
+var size = 4 + 4 * 4 + 4 * veclen * 4;
+states.forEach(function(s) {
+  size += 1 + Buffer.byteLength(s.name) + 4;
+  size += s.mixtures.length * (8 + veclen * 2 * (format / 8));
+});
+
+var out = Buffer.alloc(size);
+var pos = 0;
+out.write('JQHM', pos); pos += 4;
+[1, format, veclen, states.length].forEach(function(v) { out.writeInt32LE(v, pos); pos += 4; });
+[meanOffset, meanScale, ivarOffset, ivarScale].forEach(function(a) {
+  a.forEach(function(v) { out.writeFloatLE(v, pos); pos += 4; });
+});
+states.forEach(function(s) {
+  var name = Buffer.from(s.name);
+  if (name.length > 255) fail(s.name + ': name too long');
+  out.writeUInt8(name.length, pos++);
+  name.copy(out, pos); pos += name.length;
+  out.writeInt32LE(s.mixtures.length, pos); pos += 4;
+  s.mixtures.forEach(function(m) {
+    out.writeFloatLE(m.weight > 0 ? Math.log(m.weight) : -1.0e30, pos); pos += 4;
+    out.writeFloatLE(m.gconst, pos); pos += 4;
+    for (var d = 0; d < veclen; d++) {
+      if (format === 8) out.writeInt8(m.qmean[d], pos++);
+      else { out.writeUInt16LE(m.qmean[d], pos); pos += 2; }
+    }
+    for (d = 0; d < veclen; d++) {
+      if (format === 8) out.writeUInt8(m.qivar[d], pos++);
+      else { out.writeUInt16LE(m.qivar[d], pos); pos += 2; }
+    }
+  });
+});
+
+var skeletonText = Buffer.from(skeleton.join(''), 'latin1');
+fs.writeFileSync(args[1], skeletonText);
+fs.writeFileSync(args[2], out);
+
+// - report
+
+var mixtureNum = 0;
+states.forEach(function(s) { mixtureNum += s.mixtures.length; });
+
+var gz = function(buffer) { return zlib.gzipSync(buffer, {level: 9}).length; };
+var kb = function(bytes) { return (bytes / 1024).toFixed(0) + ' KB'; };
+var original = Buffer.from(model.text, 'latin1');
+
+console.log('hquant: ' + states.length + ' states, ' + mixtureNum + ' Gaussians, ' + veclen + ' dimensions, format ' + format);
+console.log('download: ' + kb(original.length) + ' (' + kb(gz(original)) + ' gzipped) -> ' +
+  kb(skeletonText.length + out.length) + ' (' + kb(gz(skeletonText) + gz(out)) + ' gzipped)');
+console.log('parameters: ' + kb(mixtureNum * veclen * 2 * 4) + ' as float -> ' +
+  kb(mixtureNum * veclen * 2 * (format / 8)) + ' quantized');
+
+// Bytes of the packed block of a state, as block_size() of outprob_simd.c
+var vecpad = Math.ceil(veclen / 4) * 4;
+var blockBytes = function(mix, packed) {
+  if (packed === 8) return mix * (vecpad / 2 + 1) * 4;
+  if (mix >= 4) return Math.ceil(mix / 4) * (veclen * 8 + 4) * 4;
+  return mix * (vecpad * 2 + 4) * 4;
+};
+var blocks = function(packed) {
+  return states.reduce(function(total, s) { return total + blockBytes(s.mixtures.length, packed); }, 0);
+};
+// Vectors of hmmdefs are floats, a mean and a variance per Gaussian in
+// the original; a zero mean per Gaussian and one variance in the
+// skeleton, which the engine keeps along with the file it packs from
+var vectors = mixtureNum * veclen * 4;
+var skeletonHeap = vectors + veclen * 4;
+console.log('heap: ' + kb(vectors * 2 + blocks(32)) + ' as float (' + kb(vectors * 2) + ' hmmdefs, ' +
+  kb(blocks(32)) + ' packed) -> ' + kb(skeletonHeap + out.length + blocks(format)) + ' quantized (' +
+  kb(skeletonHeap) + ' hmmdefs, ' + kb(out.length) + ' hmmdefs.q, ' + kb(blocks(format)) + ' packed)');
+
+var quantized = function(m, x) {
+  var sum = m.gconst;
+  for (var d = 0; d < veclen; d++) {
+    var diff = x[d] - m.dmean[d];
+    sum += diff * diff * m.divar[d];
+  }
+  return -0.5 * sum + Math.log(m.weight);
+};
+
+var maxdiff = 0, sumdiff = 0, count = 0, agree = 0;
+hmmdefs.benchFrames(states, veclen, BENCH_FRAMES).forEach(function(x) {
+  var bestOrig = -1, bestQuant = -1, pOrig = -Infinity, pQuant = -Infinity;
+  states.forEach(function(s, i) {
+    var p = hmmdefs.logadd10(s.mixtures.map(function(m) { return hmmdefs.gaussian(m, x); }));
+    var q = hmmdefs.logadd10(s.mixtures.map(function(m) { return quantized(m, x); }));
+    var diff = Math.abs(p - q);
+    if (diff > maxdiff) maxdiff = diff;
+    sumdiff += diff; count++;
+    if (p > pOrig) { pOrig = p; bestOrig = i; }
+    if (q > pQuant) { pQuant = q; bestQuant = i; }
+  });
+  if (bestOrig === bestQuant) agree++;
+});
+console.log('accuracy: max diff ' + maxdiff.toFixed(4) + ', mean diff ' + (sumdiff / count).toFixed(4) +
+  ' (log10), best state agreed on ' + agree + '/' + BENCH_FRAMES + ' frames');
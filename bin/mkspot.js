@@ -0,0 +1,115 @@
+#!/usr/bin/env node
+// Compile a keyword spotting grammar for JuliusJS.
+//
+//   node bin/mkspot.js [--hlist voxforge/tiedlist] keywords.voca out/prefix
+//
+// Keywords are given as a `.voca` file (see mkdfa.pl), one category per
+// keyword class.  Instead of a `.grammar`, they are embedded in a loop of
+// filler words, one per phone of the acoustic model (base phones of the
+// HMM list, without silences):
+//
+//   S : NS_B LOOP NS_E      LOOP : LOOP ITEM | ITEM
+//   ITEM : FILLER | <each keyword category>
+//
+// so that any speech is matched, and a keyword path competes with the
+// filler path over the same frames.  With `-spot`, the engine reports a
+// keyword as soon as its score per frame leads the best filler ending on
+// the same frame by the given threshold (see libjulius/src/recogmain.c).
+//
+// Writes out/prefix.dfa, out/prefix.dict and out/prefix.term, as mkdfa.pl
+// does; filler words are output as `<filler>`.
+
+var fs = require('fs');
+var path = require('path');
+
+var FILLER = '<filler>';
+var SILENCES = ['sil', 'sp'];
+
+var cli = require('../test/cli')('mkspot', 'usage: mkspot.js [--hlist voxforge/tiedlist] keywords.voca out/prefix');
+var fail = cli.fail;
+
+var hlist = path.join(__dirname, '..', 'dist', 'voxforge', 'tiedlist');
+var args = cli.parse({
+  '--hlist': function(file) { hlist = file; }
+});
+if (args.length !== 2) cli.usage();
+
+// - phones
+
+// Base phone of each logical name (`l-c+r` -> `c`)
+var phones = [];
+var known = {};
+try {
+  fs.readFileSync(hlist, 'latin1').split(/\r?\n/).forEach(function(line) {
+    var name = line.trim().split(/\s+/)[0];
+    if (!name) return;
+    var base = name.replace(/^.*-/, '').replace(/\+.*$/, '');
+    if (known[base]) return;
+    known[base] = true;
+    if (SILENCES.indexOf(base) < 0) phones.push(base);
+  });
+} catch (e) { fail(e.message); }
+if (!phones.length) fail(hlist + ': no phone found');
+
+// - keywords
+
+var categories = [];
+var category = null;
+var text;
+try { text = fs.readFileSync(args[0], 'latin1'); }
+catch (e) { fail(e.message); }
+text.split(/\r?\n/).forEach(function(line, n) {
+  line = line.replace(/#.*/, '').trim();
+  if (!line) return;
+  var head = line.match(/^%\s*([A-Za-z0-9_]*)/);
+  if (head) {
+    category = {name: head[1], words: []};
+    // sentence start and end are added here
+    if (category.name !== 'NS_B' && category.name !== 'NS_E') categories.push(category);
+    return;
+  }
+  if (!category) fail(args[0] + ':' + (n + 1) + ': word before any category');
+  var fields = line.split(/\s+/);
+  if (fields.length < 2) fail(args[0] + ':' + (n + 1) + ': word without phones');
+  fields.slice(1).forEach(function(p) {
+    if (!known[p]) console.error('mkspot: warning: ' + fields[0] + ': phone ' + p + ' is not in ' + hlist);
+  });
+  if (fields[0][0] === '<') fail(args[0] + ':' + (n + 1) + ': keywords may not start with "<"');
+  category.words.push({name: fields[0], phones: fields.slice(1)});
+});
+categories = categories.filter(function(c) { return c.words.length; });
+if (!categories.length) fail(args[0] + ': no keyword found');
+
+// - write
+//
+// Categories: 0 NS_B, 1 NS_E, 2 FILLER, then the keyword categories.
+// The DFA is read backwards from the sentence end, as mkfa writes it.
+
+var items = [2];
+categories.forEach(function(c, i) { items.push(3 + i); });
+
+var dfa = ['0 1 1 0 0'];
+items.forEach(function(c) { dfa.push('1 ' + c + ' 2 0 0'); });
+items.forEach(function(c) { dfa.push('2 ' + c + ' 2 0 0'); });
+dfa.push('2 0 3 0 0', '3 -1 -1 1 0');
+
+var dict = ['0\t[<s>]\tsil', '1\t[</s>]\tsil'];
+phones.forEach(function(p) { dict.push('2\t[' + FILLER + ']\t' + p); });
+categories.forEach(function(c, i) {
+  c.words.forEach(function(w) { dict.push((3 + i) + '\t[' + w.name + ']\t' + w.phones.join(' ')); });
+});
+
+var term = ['0\tNS_B', '1\tNS_E', '2\tFILLER'];
+categories.forEach(function(c, i) { term.push((3 + i) + '\t' + c.name); });
+
+var prefix = args[1];
+try {
+  fs.writeFileSync(prefix + '.dfa', dfa.join('\n') + '\n');
+  fs.writeFileSync(prefix + '.dict', dict.join('\n') + '\n');
+  fs.writeFileSync(prefix + '.term', term.join('\n') + '\n');
+} catch (e) { fail(e.message); }
+
+var words = 0;
+categories.forEach(function(c) { words += c.words.length; });
+console.log('mkspot: ' + categories.length + ' keyword categories, ' + words + ' words, ' +
+  phones.length + ' filler phones -> ' + prefix + '.dfa, .dict, .term');
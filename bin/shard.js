@@ -0,0 +1,73 @@
+#!/usr/bin/env node
+// Split the model files into shards named by their content, for the
+// worker to fetch and cache one by one (see `SHARDS=1 ./emscript.sh`).
+//
+//   node bin/shard.js [--out models] [--dir voxforge] voxforge-dir [file ...]
+//
+// Each file (by default, those the engine reads: hmmdefs, tiedlist, the
+// sample grammar, and hmmdefs.q / hmmdefs.gs when built) is copied to
+// `out` as name.hash, where hash is the start of its SHA-256, and listed
+// in out/manifest.json with its size and full SHA-256 (hex).  worker.js
+// mounts the files in `/dir` of the engine.
+//
+// A shard is renamed only when its content changes, so it can be served
+// and cached as immutable, and a release only has the shards that
+// changed fetched again; the manifest itself must be revalidated.
+// Shards in `out` no longer listed are removed.
+//
+// Files, sizes and hashes are reported on stdout.
+
+var fs = require('fs');
+var path = require('path');
+var crypto = require('crypto');
+
+var VERSION = 1;
+var HASH_CHARS = 16;
+var FILES = ['hmmdefs', 'tiedlist', 'sample.dfa', 'sample.dict', 'hmmdefs.q', 'hmmdefs.gs'];
+
+var cli = require('../test/cli')('shard', 'usage: shard.js [--out models] [--dir voxforge] voxforge-dir [file ...]');
+var fail = cli.fail;
+
+var out = 'models', dir = 'voxforge';
+var args = cli.parse({
+  '--out': function(value) { out = value; },
+  '--dir': function(value) { dir = value; }
+});
+if (!args.length || !out || !dir) cli.usage();
+
+var source = args[0];
+var names = args.length > 1 ? args.slice(1) : FILES.filter(function(name) {
+  return fs.existsSync(path.join(source, name));
+});
+if (!names.length) fail('no model file in ' + source);
+
+fs.mkdirSync(out, {recursive: true});
+
+var manifest = {version: VERSION, dir: dir, files: []};
+names.forEach(function(name) {
+  var data;
+  try { data = fs.readFileSync(path.join(source, name)); }
+  catch (e) { fail(e.message); }
+  var sha256 = crypto.createHash('sha256').update(data).digest('hex');
+  var shard = name + '.' + sha256.slice(0, HASH_CHARS);
+  var target = path.join(out, shard);
+  if (!fs.existsSync(target)) fs.writeFileSync(target, data);
+  manifest.files.push({name: name, shard: shard, size: data.length, sha256: sha256});
+});
+
+// Shards of earlier builds
+var listed = {};
+manifest.files.forEach(function(file) { listed[file.shard] = true; });
+fs.readdirSync(out).forEach(function(name) {
+  if (name === 'manifest.json' || listed[name]) return;
+  if (new RegExp('\\.[0-9a-f]{' + HASH_CHARS + '}$').test(name)) fs.unlinkSync(path.join(out, name));
+});
+
+fs.writeFileSync(path.join(out, 'manifest.json'), JSON.stringify(manifest, null, 2) + '\n');
+
+var total = 0;
+manifest.files.forEach(function(file) {
+  total += file.size;
+  console.log(file.shard + '\t' + file.size + '\t' + file.sha256);
+});
+console.log(manifest.files.length + ' shards, ' + total + ' bytes, in ' + out);
@@ -27,6 +27,17 @@
       var audio = this.audio;
       var recognizer = this.recognizer;
       var terminate = this.terminate;
+
+      // Without the microphone, only `decodeBuffer` is of use
+      if (!this.audio._mic) {
+        recognizer.postMessage({
+          type: 'begin',
+          pathToDfa: pathToDfa,
+          pathToDict: pathToDict,
+          options: options
+        });
+        return;
+      }
       
       // Compatibility
       navigator.getUserMedia  = navigator.getUserMedia ||
@@ -68,11 +79,20 @@
         source:    null,
         // `ScriptProcessorNode` for julius
         processor: null,
-        _transfer:  options.transfer
+        _transfer:  options.transfer,
+        _mic:       options.mic !== false
       };
 
       // Do not pollute the object
-      delete options.transfer;
+      delete options.transfer, delete options.mic;
+
+      // Pending `decodeBuffer` promises, by id
+      this._decodes = {};
+      this._decodeId = 0;
+
+      // Pending `addWords`, `removeWords` and `useGrammar` promises, by id
+      this._slots = {};
+      this._slotId = 0;
 
       // _Recognition is offloaded to a separate thread to avoid slowing UI_
       this.recognizer = new Worker(options.pathToWorker || 'worker.js');
@@ -84,10 +104,51 @@
         } else if (e.data.type === 'recog') {
           if (e.data.firstpass) {
             typeof that.onfirstpass === 'function' &&
-              that.onfirstpass(e.data.sentence, e.data.score);
+              that.onfirstpass(e.data.sentence, e.data.score, e.data.gauges);
+          } else if (e.data.correction) {
+            typeof that.oncorrection === 'function' &&
+              that.oncorrection(e.data.sentence, e.data.score, e.data.gauges);
           } else
             typeof that.onrecognition === 'function' &&
-              that.onrecognition(e.data.sentence);
+              that.onrecognition(e.data.sentence, e.data.score, e.data.gauges);
+
+        } else if (e.data.type === 'spot') {
+          typeof that.onspot === 'function' &&
+            that.onspot(e.data.word, e.data.begin, e.data.end, e.data.ratio);
+
+        } else if (e.data.type === 'cascade') {
+          if (e.data.awake)
+            typeof that.onwake === 'function' && that.onwake();
+          else
+            typeof that.onsleep === 'function' && that.onsleep();
+
+        } else if (e.data.type === 'progress') {
+          typeof that.ondecodeprogress === 'function' &&
+            that.ondecodeprogress(e.data.progress);
+
+        } else if (e.data.type === 'decoded') {
+          var pending = that._decodes[e.data.id];
+          delete that._decodes[e.data.id];
+          if (e.data.error) pending.reject(new Error(e.data.error));
+          else pending.resolve(e.data.result);
+
+        } else if (e.data.type === 'slot' || e.data.type === 'grammar') {
+          var slot = that._slots[e.data.id];
+          delete that._slots[e.data.id];
+          if (e.data.error) slot.reject(new Error(e.data.error));
+          else slot.resolve(e.data.result);
+
+        } else if (e.data.type === 'stats') {
+          typeof that.onstats === 'function' &&
+            that.onstats(e.data.stats);
+
+        } else if (e.data.type === 'trace') {
+          typeof that.ontrace === 'function' &&
+            that.ontrace(e.data.trace);
+
+        } else if (e.data.type === 'recording') {
+          typeof that.onrecording === 'function' &&
+            that.onrecording(e.data.recording);
 
         } else if (e.data.type === 'log') {
           typeof that.onlog === 'function' &&
@@ -109,7 +170,90 @@
 
     Julius.prototype.onfirstpass = function(sentence) { /* noop */ };
     Julius.prototype.onrecognition = function(sentence, score) { /* noop */ };
+    Julius.prototype.oncorrection = function(sentence, score, gauges) {
+      this.onrecognition(sentence, score, gauges);
+    };
+    Julius.prototype.onspot = function(word, begin, end, ratio) { /* noop */ };
+    Julius.prototype.onwake = function() { /* noop */ };
+    Julius.prototype.onsleep = function() { /* noop */ };
+    Julius.prototype.ondecodeprogress = function(progress) { /* noop */ };
+    Julius.prototype.decodeBuffer = function(buffer, sampleRate) {
+      var that = this;
+      var id = ++this._decodeId;
+      var samples = buffer;
+      var transfer = [];
+
+      // `AudioBuffer`, e.g. from `decodeAudioData`: mix channels down
+      if (typeof buffer.getChannelData === 'function') {
+        sampleRate = buffer.sampleRate;
+        samples = new Float32Array(buffer.length);
+        for (var c = 0; c < buffer.numberOfChannels; c++) {
+          var channel = buffer.getChannelData(c);
+          for (var i = 0; i < samples.length; i++)
+            samples[i] += channel[i] / buffer.numberOfChannels;
+        }
+        transfer.push(samples.buffer);
+      }
+
+      return new Promise(function(resolve, reject) {
+        that._decodes[id] = {resolve: resolve, reject: reject};
+        that.recognizer.postMessage({
+          type: 'decode',
+          id: id,
+          samples: samples,
+          sampleRate: sampleRate
+        }, transfer);
+      });
+    };
+    var changeWords = function(category, words, remove) {
+      var that = this;
+      var id = ++this._slotId;
+
+      return new Promise(function(resolve, reject) {
+        that._slots[id] = {resolve: resolve, reject: reject};
+        that.recognizer.postMessage({
+          type: 'slot',
+          id: id,
+          category: category,
+          words: words,
+          remove: remove
+        });
+      });
+    };
+    Julius.prototype.addWords = function(category, words) {
+      return changeWords.call(this, category, words, false);
+    };
+    Julius.prototype.removeWords = function(category, words) {
+      return changeWords.call(this, category, words, true);
+    };
+    // Replace the grammar, as given to the constructor, at the next input
+    Julius.prototype.useGrammar = function(pathToDfa, pathToDict) {
+      var that = this;
+      var id = ++this._slotId;
+
+      return new Promise(function(resolve, reject) {
+        that._slots[id] = {resolve: resolve, reject: reject};
+        that.recognizer.postMessage({
+          type: 'grammar',
+          id: id,
+          pathToDfa: pathToDfa,
+          pathToDict: pathToDict
+        });
+      });
+    };
     Julius.prototype.onlog = function(obj) { console.log(obj); };
+    Julius.prototype.onstats = function(stats) { /* noop */ };
+    Julius.prototype.getStats = function() {
+      this.recognizer.postMessage({type: 'stats'});
+    };
+    Julius.prototype.ontrace = function(trace) { /* noop */ };
+    Julius.prototype.getTrace = function(reset) {
+      this.recognizer.postMessage({type: 'trace', reset: !!reset});
+    };
+    Julius.prototype.onrecording = function(recording) { /* noop */ };
+    Julius.prototype.getRecording = function() {
+      this.recognizer.postMessage({type: 'recording'});
+    };
     Julius.prototype.onfail = function() { /* noop */ };
     Julius.prototype.terminate = function(cb) {
       this.audio.processor.onaudioprocess = null;
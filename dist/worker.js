@@ -3,18 +3,123 @@ var master = self;
 // Functions exposed to libsent/src/adin_mic_webaudio.c
 var setRate;
 var begin = function() { master.postMessage({type: 'begin'}); };
+var decodeBegin;
+var decodeProgress;
+var decodeEnd;
 
-// console polyfill for emscripted Module
+// Functions exposed to libjulius/src/recogmain.c
+var pass1final;
+var pass1verified;
+var gauges;
+var spotted;
+var cascade;
+var slotsApplied;
+var grammarApplied;
+
+// Functions exposed to libjulius/src/event_lexicon.c
+var lexiconBuilt;
+
+// Functions exposed to libjulius/src/event_sched.c
+var schedTask;
+
+// console polyfill for emscripted Module, whose `log` parses the
+// output of julius (see `Module` below)
 var console = {};
 
-importScripts('recognizer.js', 'listener/resampler.js', 'listener/converter.js');
+// Buffers to decode offline (see `decodeBuffer` in julius.js), in order;
+// the first one is being decoded once `started`
+var decodes = [];
+var offline = function() {
+  return decodes.length && decodes[0].started ? decodes[0] : null;
+};
+
+// The session being replayed (see `replay` below), which results are
+// also reported to
+var replaying = null;
+
+// Report a result to the page
+var postResult = function(data) {
+  if (replaying) {
+    replaying.results.push({time: replaying.time, sentence: data.sentence, score: data.score,
+                            firstpass: !!data.firstpass, correction: !!data.correction});
+  }
+  data.type = 'recog';
+  master.postMessage(data);
+};
+
+// Use the WebAssembly SIMD build where supported (see `SIMD=1 ./emscript.sh`)
+var simd = (function() {
+  // The smallest module using a v128 instruction
+  var probe = new Uint8Array([
+    0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0, 10,
+    10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11
+  ]);
+  try { return typeof WebAssembly === 'object' && WebAssembly.validate(probe); }
+  catch (e) { return false; }
+}() );
+
+// Use the pthread build where the page is cross-origin isolated, so that
+// memory can be shared (see `PTHREAD=1 ./emscript.sh`): A/D-in and decoding
+// then run on threads of their own instead of being stepped by events
+var pthread = typeof crossOriginIsolated !== 'undefined' && crossOriginIsolated &&
+  typeof SharedArrayBuffer === 'function';
 
+// Output of julius, parsed for results
 console.log = (function() {
   // The designation used by julius for recognition
   var recogPrefix = /^sentence[0-9]+: (.*)/;
   var guessPrefix = /^pass[0-9]+_best: (.*)/;
   var scorePrefix = /^score[0-9]+: (.*)/;
+  // The 2nd pass ended without a result, e.g. "<search failed>"
+  var failedPrefix = /^<(search|input) [^>]*>/;
   var recog;
+  var guess;
+  // Whether the 2nd pass agreed with a result already emitted on the 1st pass
+  var verified = null;
+  // Real-time factor and latencies of the current utterance
+  var measured = null;
+
+  var strip = function(sentence) {
+    return console.stripSilence ?
+      sentence.split(' ').slice(1, -1).join(' ') : sentence;
+  };
+
+  // Set just before each result is output (see gauge_emit())
+  gauges = function(audio, cpu, rtf, pass1, final) {
+    measured = {
+      audio: audio,
+      cpu: cpu,
+      rtf: rtf,
+      pass1Latency: pass1 < 0 ? null : pass1,
+      finalLatency: final < 0 ? null : final
+    };
+  };
+
+  // The 1st pass result is confidently final (see `-pass1final`)
+  pass1final = function(margin) {
+    // A new result: nothing is left to verify of an earlier one
+    verified = null;
+    if (offline())
+      offline().segments.push({sentence: strip(guess), margin: margin, gauges: measured});
+    else
+      postResult({sentence: strip(guess), margin: margin, gauges: measured});
+  };
+  // A keyword was detected on the 1st pass (see `-spot`)
+  spotted = function(word, begin, end, ratio) {
+    master.postMessage({type: 'spot', word: word, begin: begin, end: end, ratio: ratio});
+  };
+  // The cascade switched stages (see `-cascade`): results of the wake
+  // stage are not reported
+  cascade = function(stage) {
+    console.awake = stage === 1;
+    master.postMessage({type: 'cascade', awake: console.awake});
+  };
+  // The 2nd pass has verified it (see `-pass1verify`)
+  pass1verified = function(agree, agreed, taken) {
+    verified = agree;
+    if (console.verbose)
+      master.postMessage({type: 'log', sentence: 'pass1 agreement: ' + agreed + '/' + taken});
+  };
 
   return function(str) {
     var score;
@@ -25,14 +130,32 @@ console.log = (function() {
       return;
     }
 
+    // Spotting grammars only report keywords, through `spotted`, and a
+    // cascade only the results of its main stage
+    if (console.cascade ? !console.awake : console.spot) {
+      if (console.verbose) master.postMessage({type: 'log', sentence: str});
+      return;
+    }
+
     if (score = str.match(scorePrefix)) {
-      master.postMessage({type: 'recog', sentence: recog, score: score[1]});
+      if (offline()) {
+        // A correction replaces the segment finalized on the 1st pass
+        if (verified === false) offline().segments.pop();
+        if (verified !== true)
+          offline().segments.push({sentence: recog, score: score[1], gauges: measured});
+      } else if (verified !== true)
+        postResult({sentence: recog, score: score[1], correction: verified === false, gauges: measured});
+      verified = null;
+    } else if (str.match(failedPrefix)) {
+      // No score line follows to report the verification
+      verified = null;
+      if (console.verbose) master.postMessage({type: 'log', sentence: str});
     } else if (sentence = str.match(recogPrefix)) {
-      recog = sentence[1];
-      if (console.stripSilence)
-        recog = recog.split(' ').slice(1, -1).join(' ');
+      recog = strip(sentence[1]);
     } else if (sentence = str.match(guessPrefix)) {
-      master.postMessage({type: 'recog', sentence: sentence[1], firstpass: true});
+      guess = sentence[1];
+      if (!offline())
+        postResult({sentence: guess, firstpass: true, gauges: measured});
     } else if (console.verbose)
       master.postMessage({type: 'log', sentence: str});
   };
@@ -40,80 +163,896 @@ console.log = (function() {
 
 console.error = function(err) { master.postMessage({type: 'error'}); };
 
+// Where the emscripted Module writes its stdout and stderr, both to
+// the parser: newer emscripten binds these as the build is loaded, so
+// they are set before any build is imported
+var Module = {print: console.log, printErr: console.log};
+
+// Fall back to the next build when one was not built
+var builds = [];
+if (pthread) builds.push('recognizer-pthread.js');
+if (simd) builds.push('recognizer-simd.js');
+builds.push('recognizer.js');
+var build;
+for (var i = 0; i < builds.length; i++) {
+  try { importScripts(builds[i]); build = builds[i]; break; }
+  catch (e) {
+    // A build that is there but fails to load is not skipped
+    if (e.name !== 'NetworkError' || i === builds.length - 1) {
+      master.postMessage({type: 'error', error: builds[i] + ': ' + (e.message || e)});
+      throw e;
+    }
+  }
+}
+importScripts('listener/resampler.js', 'listener/converter.js');
+
+// Builds made with `SHARDS=1 ./emscript.sh` carry no package: the model
+// files are fetched as shards named by their content (see bin/shard.js),
+// all at once, from Cache Storage when there, and checked against the
+// SHA-256 of models/manifest.json before they are mounted
+var SHARD_DIR = 'models/';
+var SHARD_CACHE = 'juliusjs-models';
+
+var shards = Module.expectedDataFileDownloads ? null : (function() {
+  var start = performance.now();
+  var loading = {manifest: null, files: null, error: null, report: {
+    files: 0, hits: 0, misses: 0, bytesCached: 0, bytesFetched: 0, pruned: 0, msec: 0
+  }};
+  var report = loading.report;
+
+  var hex = function(hash) {
+    return Array.prototype.map.call(new Uint8Array(hash), function(b) {
+      return (b < 16 ? '0' : '') + b.toString(16);
+    }).join('');
+  };
+  var verify = function(entry, data) {
+    return crypto.subtle.digest('SHA-256', data).then(function(hash) {
+      return hex(hash) === entry.sha256;
+    });
+  };
+
+  var fetchShard = function(cache, entry) {
+    var url = SHARD_DIR + entry.shard;
+    var network = function() {
+      return fetch(url).then(function(response) {
+        if (!response.ok) throw new Error(url + ': ' + response.status);
+        return response.arrayBuffer();
+      }).then(function(data) {
+        return verify(entry, data).then(function(ok) {
+          if (!ok) throw new Error(url + ': integrity check failed');
+          report.misses++;
+          report.bytesFetched += data.byteLength;
+          if (cache) cache.put(url, new Response(data)).catch(function() {});
+          return data;
+        });
+      });
+    };
+    return (cache ? cache.match(url) : Promise.resolve(null)).then(function(response) {
+      if (!response) return network();
+      return response.arrayBuffer().then(function(data) {
+        return verify(entry, data).then(function(ok) {
+          if (!ok) return cache.delete(url).then(network);
+          report.hits++;
+          report.bytesCached += data.byteLength;
+          return data;
+        });
+      });
+    });
+  };
+
+  // Shards of other releases
+  var prune = function(cache, manifest) {
+    var listed = {};
+    manifest.files.forEach(function(entry) {
+      listed[new URL(SHARD_DIR + entry.shard, location.href).href] = true;
+    });
+    return cache.keys().then(function(requests) {
+      return Promise.all(requests.filter(function(request) {
+        return !listed[request.url];
+      }).map(function(request) {
+        report.pruned++;
+        return cache.delete(request);
+      }));
+    });
+  };
+
+  var cache = typeof caches === 'undefined' ? Promise.resolve(null) :
+    caches.open(SHARD_CACHE).catch(function() { return null; });
+
+  loading.promise = Promise.all([
+    cache,
+    fetch(SHARD_DIR + 'manifest.json', {cache: 'no-cache'}).then(function(response) {
+      if (!response.ok) throw new Error(SHARD_DIR + 'manifest.json: ' + response.status);
+      return response.json();
+    })
+  ]).then(function(loaded) {
+    var cache = loaded[0], manifest = loaded[1];
+    loading.manifest = manifest;
+    report.files = manifest.files.length;
+    return Promise.all(manifest.files.map(function(entry) {
+      return fetchShard(cache, entry);
+    })).then(function(data) {
+      loading.files = data;
+      report.msec = performance.now() - start;
+      if (cache) return prune(cache, manifest).catch(function() {});
+    });
+  }).catch(function(error) {
+    loading.error = String(error.message || error);
+  });
+  return loading;
+}() );
+
 master.onmessage = (function() {
   var converter;
   var bufferSize;
   var byteSize;
+  var inputRate = 16000;
 
   setRate = function(rate) {
     rate = rate || 16000;
+    inputRate = rate;
     bufferSize = Math.floor(rate * 4096 / 44100);
     byteSize = bufferSize * 2;
     converter = new Converter(rate, bufferSize, byteSize);
   };
 
   var fillBuffer = Module.cwrap('fill_buffer', 'number', ['number', 'number']);
+  var running = false;
 
-  return function(e) {
-    if (e.data.type === 'begin') {
-      var dfa = 'julius.dfa';
-      var dict = 'julius.dict';
-      var options = [];
-
-      console.verbose = e.data.options.verbose;
-      console.stripSilence =
-        e.data.options.stripSilence === undefined ?
-          true : e.data.options.stripSilence;
-
-      delete e.data.options.verbose, delete e.data.options.stripSilence;
-
-      if (typeof e.data.pathToDfa === 'string' &&
-          typeof e.data.pathToDict === 'string') {
-        var pathToDfa = 
-          ((e.data.pathToDfa[0] === '/') ? '..' : '../') + e.data.pathToDfa;
-        var pathToDict =
-          ((e.data.pathToDict[0] === '/') ? '..' : '../') + e.data.pathToDict;
-        FS.createLazyFile('/', 'julius.dfa', '../' + pathToDfa, true, false);
-        FS.createLazyFile('/', 'julius.dict', '../' + pathToDict, true, false);
-      } else {
-        dfa = 'voxforge/sample.dfa';
-        dict = 'voxforge/sample.dict';
+  // - offline decoding
+  //
+  // Samples are resampled to the input rate and handed to the engine,
+  // which reads them at full speed in place of the microphone, as an
+  // input stream of their own (see adin_mic_decode() in
+  // libsent/src/adin/adin_mic_webaudio.c); microphone input is dropped
+  // meanwhile.
+
+  var decodeNext = function() {
+    var d = decodes[0];
+    var resampler = new Resampler(d.sampleRate, inputRate, 1,
+      Math.ceil(d.samples.length * inputRate / d.sampleRate) + 1, true);
+    var length = resampler.resampler(d.samples);
+    var ptr = Module._malloc(length * 2);
+    var heap = Module.HEAP16.subarray(ptr >> 1, (ptr >> 1) + length);
+
+    for (var i = 0; i < length; i++) {
+      var s = Math.max(-1, Math.min(1, resampler.outputBuffer[i]));
+      heap[i] = s < 0 ? Math.ceil(s * 0x8000) : Math.floor(s * 0x7FFF);
+    }
+    d.samples = null;
+    d.audio = length * 1000 / inputRate;
+    d.segments = [];
+    // Freed by the engine once read
+    Module.ccall('adin_mic_decode', 'number', ['number', 'number'], [ptr, length]);
+  };
+
+  decodeBegin = function(length) {
+    decodes[0].started = performance.now();
+    decodes[0].progress = 0;
+  };
+  decodeProgress = function(pos, length) {
+    var d = decodes[0];
+    var now = performance.now();
+
+    if (pos < length && now - d.progress < 50) return;
+    d.progress = now;
+    master.postMessage({type: 'progress', id: d.id, progress: pos / length});
+  };
+  decodeEnd = function() {
+    var d = decodes.shift();
+    var wall = performance.now() - d.started;
+    var cpu = 0;
+
+    d.segments.forEach(function(segment) {
+      if (segment.gauges) cpu += segment.gauges.cpu;
+    });
+    master.postMessage({type: 'decoded', id: d.id, result: {
+      sentence: d.segments.map(function(segment) { return segment.sentence; })
+        .filter(function(sentence) { return sentence; }).join(' '),
+      segments: d.segments,
+      audio: d.audio,
+      cpu: cpu,
+      wall: wall,
+      rtf: d.audio ? wall / d.audio : null
+    }});
+    if (decodes.length) decodeNext();
+  };
+
+  var decode = function(data) {
+    // The A/D-in thread of the pthread build cannot hand over to memory
+    if (!Module._adin_mic_decode || build === 'recognizer-pthread.js') {
+      master.postMessage({type: 'decoded', id: data.id,
+        error: 'decodeBuffer is not supported by ' + build});
+      return;
+    }
+    decodes.push({id: data.id, samples: data.samples, sampleRate: data.sampleRate || 16000});
+    if (running && decodes.length === 1) decodeNext();
+  };
+
+  // - category slots (see `addWords` in julius.js)
+  //
+  // Words are given to the engine as lines of the dictionary of the
+  // grammar, with the numbers of their categories (see slot_words() in
+  // julius/recogloop.c); names of categories are read from the .term file
+  // made with the grammar by mkdfa.pl.  The engine applies changes at the
+  // next input, together, and the requests are answered then.
+
+  var termFile = null;
+  var terms = null;		// category numbers, by name
+  var slotsWaiting = [];	// requests made before the engine runs, with `useGrammar`
+  var slotRequests = [];	// requests waiting for the lexicon to be rebuilt
+
+  var readTerms = function() {
+    terms = {};
+    try {
+      FS.readFile(termFile, {encoding: 'utf8'}).split('\n').forEach(function(line) {
+        var fields = line.trim().split(/\s+/);
+        if (fields.length === 2) terms[fields[1]] = parseInt(fields[0], 10);
+      });
+    } catch (e) {}
+  };
+
+  // The lexicon was rebuilt: `changed` words, `words` in all (see slot_built())
+  slotsApplied = function(changed, words, msec) {
+    var now = performance.now();
+    slotRequests.splice(0).forEach(function(request) {
+      master.postMessage({type: 'slot', id: request.id, result: {
+        words: request.words, batch: changed, lexicon: words, build: msec, wait: now - request.time,
+        lexicons: lexicons.splice(0)
+      }});
+    });
+  };
+
+  var slot = function(data) {
+    var fail = function(error) {
+      master.postMessage({type: 'slot', id: data.id, error: error});
+    };
+
+    // The lexicon of the pthread build is rebuilt on the thread decoding
+    if (!Module._slot_words || build === 'recognizer-pthread.js')
+      return fail('addWords and removeWords are not supported by ' + build);
+    if (!running) return slotsWaiting.push(data);
+
+    var category = data.category;
+    if (typeof category === 'string' && !/^[0-9]+$/.test(category)) {
+      if (!terms) readTerms();
+      if (!(category in terms)) return fail('no category ' + category + ' in the grammar');
+      category = terms[category];
+    }
+    var lines = [];
+    for (var i = 0; i < data.words.length; i++) {
+      var word = data.words[i];
+      var phones = Array.isArray(word.phones) ? word.phones.join(' ') : String(word.phones || '');
+      if (!word.word || /[\]\n]/.test(word.word) || /\n/.test(phones) || (!data.remove && !phones.trim()))
+        return fail('invalid word ' + JSON.stringify(word));
+      lines.push(category + '\t[' + word.word + ']\t' + phones);
+    }
+
+    var bytes = new TextEncoder().encode(lines.join('\n'));
+    var ptr = Module._malloc(bytes.length + 1);
+    Module.HEAPU8.set(bytes, ptr);
+    Module.HEAPU8[ptr + bytes.length] = 0;
+    var changed = Module._slot_words(ptr, data.remove ? 1 : 0);
+    Module._free(ptr);
+
+    if (changed < 0) fail('invalid words for category ' + data.category + ' (see the log)');
+    else if (changed === 0) master.postMessage({type: 'slot', id: data.id, result: {words: 0}});
+    else slotRequests.push({id: data.id, words: changed, time: performance.now()});
+  };
+
+  // - grammar switching (see `useGrammar` in julius.js)
+  //
+  // The grammar and dictionary are read when asked for, and replace the
+  // grammar of the engine at the next input, as slots do (see
+  // use_grammar() in julius/recogloop.c); with `options.grammarCache`,
+  // the lexicon tree of a grammar used before is read back instead of
+  // built (see below).
+
+  var grammarCount = 0;
+  var grammarRequests = [];	// requests waiting for the lexicon to be built
+
+  // Files given by the page, relative to it
+  var lazyFile = function(name, path) {
+    var fromWorker = ((path[0] === '/') ? '..' : '../') + path;
+    FS.createLazyFile('/', name, '../' + fromWorker, true, false);
+  };
+
+  // The lexicon of the grammar was built, of `words` in all (see grammar_built())
+  grammarApplied = function(words, msec) {
+    var now = performance.now();
+    var built = lexicons.splice(0);
+    grammarRequests.splice(0).forEach(function(request) {
+      master.postMessage({type: 'grammar', id: request.id, result: {
+        words: words, build: msec, wait: now - request.time, lexicons: built
+      }});
+    });
+  };
+
+  var useGrammar = function(data) {
+    var fail = function(error) {
+      master.postMessage({type: 'grammar', id: data.id, error: error});
+    };
+
+    if (!Module._use_grammar || build === 'recognizer-pthread.js')
+      return fail('useGrammar is not supported by ' + build);
+    if (typeof data.pathToDfa !== 'string' || typeof data.pathToDict !== 'string')
+      return fail('useGrammar needs a grammar and a dictionary');
+    if (!running) return slotsWaiting.push(data);
+
+    // Named after the file, which can be loaded again
+    var name = 'grammar' + (++grammarCount);
+    lazyFile(name + '.dfa', data.pathToDfa);
+    lazyFile(name + '.dict', data.pathToDict);
+    var words = Module.ccall('use_grammar', 'number', ['string', 'string', 'string'], [
+      data.pathToDfa.replace(/^.*\//, '').replace(/\.dfa$/, ''), name + '.dfa', name + '.dict'
+    ]);
+    if (words < 0) return fail('failed to read ' + data.pathToDfa + ' or ' + data.pathToDict + ' (see the log)');
+
+    // Names of categories, for `addWords`
+    termFile = null;
+    terms = null;
+    if (/\.dfa$/.test(data.pathToDfa)) {
+      lazyFile(name + '.term', data.pathToDfa.replace(/\.dfa$/, '.term'));
+      termFile = name + '.term';
+    }
+    grammarRequests.push({id: data.id, time: performance.now()});
+  };
+
+  // Member order of EventStats (see libjulius/include/julius/event.h)
+  var statsFields = [
+    'heapSize', 'heapUsed', 'heapInUse', 'heapFree', 'inputs',
+    'ringSize', 'ringFill', 'speech',
+    'adinBuffer', 'adinCbuf', 'adinSwapbuf', 'adinBuffer48',
+    'modelLoad', 'modelFusion', 'am', 'dict', 'dfa', 'wchmm',
+    'adinSpeech', 'bufferResizes'
+  ];
+
+  // Whether main has set the engine up, which get_stats() reports on
+  var engine = false;
+
+  // All zero until then: models may still be fetched or restored.  Also
+  // all zero with a build older than get_stats(), such as the committed
+  // recognizer.js until it is rebuilt
+  var readStats = function() {
+    var live = engine && !!Module._get_stats;
+    var ptr = live ? Module.ccall('get_stats', 'number', [], []) >> 2 : 0;
+    var stats = {};
+
+    statsFields.forEach(function(field, i) {
+      stats[field] = live ? Module.HEAP32[ptr + i] : 0;
+    });
+    stats.startup = startup;
+    return stats;
+  };
+
+  var postStats = function() {
+    master.postMessage({type: 'stats', stats: readStats()});
+  };
+
+  // - model package
+  //
+  // The files of recognizer.data are mounted in MEMFS as views of the
+  // package (see `--no-heap-copy` in emscript.sh), so that the engine
+  // reads them in place, and are read once, at startup, into the
+  // structures of the engine.  They are then unlinked, for the package
+  // to be collected: this drops the MEMFS copy only, the heap of the
+  // engine is not given anything back.
+
+  var PACKAGE_DIR = '/voxforge';
+  // Heap and package sizes of the startup, once models are loaded
+  var startup = null;
+
+  var heapStats = function() {
+    if (!Module._get_stats) return null;
+    var stats = readStats();
+    return {size: stats.heapSize, used: stats.heapUsed, inUse: stats.heapInUse};
+  };
+
+  // Mount the shards of a sharded build once loaded, and true then; until
+  // then, false, and `next` is called once they are
+  var mountShards = function(next) {
+    if (shards.error) {
+      master.postMessage({type: 'error', error: shards.error});
+      return false;
+    }
+    if (!shards.files) {
+      shards.promise.then(next);
+      return false;
+    }
+    if (!shards.mounted) {
+      var dir = '/' + shards.manifest.dir;
+      if (!FS.findObject(dir)) FS.mkdir(dir);
+      // Owned by the file system, not copied
+      shards.manifest.files.forEach(function(entry, i) {
+        FS.createDataFile(dir, entry.name, new Uint8Array(shards.files[i]), true, false, true);
+      });
+      shards.files = [];
+      shards.mounted = true;
+    }
+    return true;
+  };
+
+  var releasePackage = function() {
+    var released = {files: 0, bytes: 0};
+    var names;
+
+    try { names = FS.readdir(PACKAGE_DIR); }
+    catch (e) { return released; }
+    names.forEach(function(name) {
+      var path = PACKAGE_DIR + '/' + name;
+      var node = FS.lookupPath(path).node;
+      if (!FS.isFile(node.mode)) return;
+      var contents = node.contents;
+      var bytes = node.usedBytes !== undefined ? node.usedBytes : (contents ? contents.length : 0);
+      FS.unlink(path);
+      released.files++;
+      released.bytes += bytes;
+    });
+    return released;
+  };
+
+  // - lexicon cache (see `options.grammarCache`)
+  //
+  // Building the lexicon tree of a grammar takes most of the startup,
+  // and of `useGrammar`, with large dictionaries.  With the cache, the
+  // engine writes the tree of each grammar it builds to a file of
+  // LEXICON_DIR, named by a hash of the grammar, the dictionary and the
+  // acoustic model, and reads it back instead of building it when the
+  // same grammar is given again (see libjulius/src/event_lexicon.c).  The
+  // files are kept in IndexedDB, the newest LEXICON_ENTRIES of them, and
+  // put back in LEXICON_DIR before the engine starts.
+
+  var LEXICON_DB = 'juliusjs';
+  var LEXICON_STORE = 'lexicons';
+  var LEXICON_DIR = '/lexicons';
+  var LEXICON_ENTRIES = 8;
+  // Whether the files are kept in IndexedDB
+  var lexiconStored = false;
+  // Trees built or read since they were last reported
+  var lexicons = [];
+
+  // Run `body(store)` in a transaction, for the result of the request it returns
+  var transact = function(mode, body) {
+    return new Promise(function(resolve, reject) {
+      var open = indexedDB.open(LEXICON_DB, 1);
+      open.onupgradeneeded = function() {
+        open.result.createObjectStore(LEXICON_STORE, {keyPath: 'key'}).createIndex('time', 'time');
+      };
+      open.onerror = function() { reject(open.error); };
+      open.onsuccess = function() {
+        var db = open.result;
+        var tx = db.transaction(LEXICON_STORE, mode);
+        var request = body(tx.objectStore(LEXICON_STORE));
+        tx.oncomplete = function() { db.close(); resolve(request ? request.result : null); };
+        tx.onerror = tx.onabort = function() { db.close(); reject(tx.error); };
+      };
+    });
+  };
+
+  // Put the stored files in LEXICON_DIR
+  var lexiconRestore = function() {
+    var start = performance.now();
+    return transact('readonly', function(store) { return store.getAll(); }).then(function(entries) {
+      var bytes = 0;
+      entries.forEach(function(entry) {
+        FS.writeFile(LEXICON_DIR + '/' + entry.key + '.lex', new Uint8Array(entry.data));
+        bytes += entry.data.byteLength;
+      });
+      return {files: entries.length, bytes: bytes, msec: performance.now() - start};
+    });
+  };
+
+  // Store the file of a tree just built, or mark one read as used, and
+  // drop the oldest ones
+  var lexiconStore = function(key, hit) {
+    var data = hit ? null : FS.readFile(LEXICON_DIR + '/' + key + '.lex');
+
+    return transact('readwrite', function(store) {
+      if (hit) {
+        store.get(key).onsuccess = function(e) {
+          var entry = e.target.result;
+          if (!entry) return;
+          entry.time = Date.now();
+          store.put(entry);
+        };
+        return null;
       }
+      store.put({key: key, time: Date.now(), data: data.buffer});
+      var count = store.count();
+      count.onsuccess = function() {
+        var extra = count.result - LEXICON_ENTRIES;
+        if (extra <= 0) return;
+        store.index('time').openKeyCursor().onsuccess = function(e) {
+          var cursor = e.target.result;
+          if (!cursor || extra-- <= 0) return;
+          store.delete(cursor.primaryKey);
+          cursor.continue();
+        };
+      };
+    });
+  };
+
+  // The tree of `key` was read (`hit`) or built, in `msec`, for `words`,
+  // with a file of `bytes` (see build_wchmm2() of event_lexicon.c)
+  lexiconBuilt = function(key, hit, msec, words, bytes) {
+    lexicons.push({key: key, hit: hit, msec: msec, words: words, bytes: bytes});
+    if (lexiconStored && bytes > 0) lexiconStore(key, hit).catch(function() {});
+  };
+
+  // - session recording (see `options.record`)
+  //
+  // Each fill of the ring buffer, with the samples as given to the
+  // engine, and each task run by the scheduler (see event_sched_observe()
+  // in libjulius/src/event_sched.c) are appended to a binary log, which
+  // `replay` feeds back to the engine in the same order.  Little endian:
+  // 'JJSR', u16 version, u32 input rate, u32 length of the JSON of the
+  // `begin` message, the JSON, then events of u8 kind, u32 usec. since
+  // the previous event and
+  //   RECORD_FILL: u16 count, count int16 samples
+  //   RECORD_TASK: u32 duration in usec.
+
+  var RECORD_VERSION = 1;
+  var RECORD_HEADER = 14;
+  var RECORD_FILL = 1;
+  var RECORD_TASK = 2;
+  var RECORD_CHUNK = 65536;
+  var recording = null;
+
+  var Recording = function(session) {
+    this.session = session;
+    this.chunks = [];
+    this.view = new DataView(new ArrayBuffer(RECORD_CHUNK));
+    this.pos = 0;
+    this.time = performance.now();
+  };
+
+  // Start an event at `time`, with `size` bytes to follow
+  Recording.prototype.event = function(kind, time, size) {
+    var delta = Math.min(0xFFFFFFFF, Math.max(0, Math.round((time - this.time) * 1000)));
+
+    if (this.pos + 5 + size > this.view.byteLength) {
+      this.chunks.push(new Uint8Array(this.view.buffer, 0, this.pos));
+      this.view = new DataView(new ArrayBuffer(Math.max(RECORD_CHUNK, 5 + size)));
+      this.pos = 0;
+    }
+    this.time += delta / 1000;
+    this.view.setUint8(this.pos, kind);
+    this.view.setUint32(this.pos + 1, delta, true);
+    this.pos += 5;
+  };
+
+  Recording.prototype.fill = function(time, ptr, count) {
+    this.event(RECORD_FILL, time, 2 + count * 2);
+    this.view.setUint16(this.pos, count, true);
+    new Uint8Array(this.view.buffer, this.pos + 2, count * 2)
+      .set(Module.HEAPU8.subarray(ptr, ptr + count * 2));
+    this.pos += 2 + count * 2;
+  };
+
+  Recording.prototype.task = function(start, duration) {
+    this.event(RECORD_TASK, start, 4);
+    this.view.setUint32(this.pos, Math.min(0xFFFFFFFF, Math.round(duration * 1000)), true);
+    this.pos += 4;
+  };
+
+  // The log so far, as an `ArrayBuffer`
+  Recording.prototype.save = function() {
+    var json = new TextEncoder().encode(JSON.stringify(this.session));
+    var chunks = this.chunks.concat([new Uint8Array(this.view.buffer, 0, this.pos)]);
+    var length = RECORD_HEADER + json.length;
+    chunks.forEach(function(chunk) { length += chunk.length; });
+
+    var out = new Uint8Array(length);
+    var header = new DataView(out.buffer);
+    out.set([74, 74, 83, 82]);
+    header.setUint16(4, RECORD_VERSION, true);
+    header.setUint32(6, inputRate, true);
+    header.setUint32(10, json.length, true);
+    out.set(json, RECORD_HEADER);
+    length = RECORD_HEADER + json.length;
+    chunks.forEach(function(chunk) {
+      out.set(chunk, length);
+      length += chunk.length;
+    });
+    return out.buffer;
+  };
+
+  schedTask = function(start, duration) {
+    if (recording) recording.task(start, duration);
+  };
+
+  // Count, total and percentiles of durations
+  var durations = function(times) {
+    var sorted = times.slice().sort(function(a, b) { return a - b; });
+    var at = function(p) {
+      return sorted.length ? sorted[Math.min(sorted.length - 1, Math.ceil(p * sorted.length) - 1)] : null;
+    };
+    return {
+      count: sorted.length,
+      total: sorted.reduce(function(total, t) { return total + t; }, 0),
+      p50: at(0.5), p95: at(0.95), p99: at(0.99),
+      max: sorted.length ? sorted[sorted.length - 1] : null
+    };
+  };
+
+  // - replay of a recording
+  //
+  // The engine is started as it was recorded, with its tasks run from
+  // here (see event_sched_manual()): in the recorded order, each fill
+  // is given to the engine and each task runs the next pending one, at
+  // full speed, so that the engine reads the same samples between the
+  // same steps.  Results are reported as usual; the report lists them at
+  // the recorded time they came, with the durations of tasks, recorded
+  // and replayed, and the heap in use.  The worker is of no other use
+  // afterwards.
+
+  var replay = function(data) {
+    var view = new DataView(data.recording);
+    var fail = function(error) {
+      replaying = null;
+      master.postMessage({type: 'replayed', error: error});
+    };
+
+    if (!Module._event_sched_manual || build === 'recognizer-pthread.js')
+      return fail('replay is not supported by ' + build);
+    if (view.byteLength < RECORD_HEADER || view.getUint32(0) !== 0x4A4A5352 ||
+        view.getUint16(4, true) !== RECORD_VERSION)
+      return fail('not a recording of this version');
+
+    var length = view.getUint32(10, true);
+    var session = JSON.parse(new TextDecoder().decode(
+      new Uint8Array(data.recording, RECORD_HEADER, length)));
 
+    Module.ccall('event_sched_manual', null, ['number'], [1]);
+    boot(session, function() {
+      var pos = RECORD_HEADER + length;
+      var ptr = 0, size = 0;
+      var recorded = [], replayed = [];
+      var fills = 0, samples = 0, skipped = 0, peak = 0;
+      var started = performance.now();
+
+      replaying = {time: 0, results: []};
+      while (pos < view.byteLength) {
+        var kind = view.getUint8(pos);
+        replaying.time += view.getUint32(pos + 1, true) / 1000;
+        pos += 5;
+
+        if (kind === RECORD_FILL) {
+          var count = view.getUint16(pos, true);
+          if (count > size) {
+            Module._free(ptr);
+            ptr = Module._malloc(count * 2);
+            size = count;
+          }
+          Module.HEAPU8.set(new Uint8Array(data.recording, pos + 2, count * 2), ptr);
+          fillBuffer(ptr, count);
+          fills++;
+          samples += count;
+          pos += 2 + count * 2;
+
+        } else if (kind === RECORD_TASK) {
+          recorded.push(view.getUint32(pos, true) / 1000);
+          pos += 4;
+          // The engine took other steps than recorded (another build)
+          if (!Module._event_sched_pending()) {
+            skipped++;
+            continue;
+          }
+          var start = performance.now();
+          Module._event_sched_dispatch();
+          replayed.push(performance.now() - start);
+          peak = Math.max(peak, readStats().heapInUse);
+
+        } else {
+          return fail('bad event at byte ' + (pos - 5));
+        }
+      }
+      Module._free(ptr);
+
+      master.postMessage({type: 'replayed', report: {
+        build: build,
+        session: session,
+        duration: replaying.time,
+        audio: samples * 1000 / inputRate,
+        fills: fills,
+        skipped: skipped,
+        pending: Module._event_sched_pending(),
+        recorded: durations(recorded),
+        replayed: durations(replayed),
+        wall: performance.now() - started,
+        heap: {peak: peak, end: readStats().heapInUse},
+        results: replaying.results
+      }});
+      replaying = null;
+    });
+  };
+
+  // Start the engine as the page asks (`begin`), then call `ready`
+  var boot = function(data, ready) {
+    var dfa = 'julius.dfa';
+    var dict = 'julius.dict';
+    var options = [];
+    var record = data.options.record;
+    var session = JSON.parse(JSON.stringify(data));
+    // Files of the lexicon cache, once put back from IndexedDB
+    var cache = data.options.grammarCache ? {restored: null} : null;
+
+    delete session.type, delete session.options.record;
+    delete data.options.record;
+
+    console.verbose = data.options.verbose;
+    console.spot = data.options.spot !== undefined;
+    console.cascade = data.options.cascade;
+    console.awake = false;
+    console.stripSilence =
+      data.options.stripSilence === undefined ?
+        true : data.options.stripSilence;
+
+    var statsInterval = data.options.statsInterval;
+
+    delete data.options.verbose, delete data.options.stripSilence;
+    delete data.options.statsInterval, delete data.options.cascade;
+    delete data.options.grammarCache;
+
+    if (typeof data.pathToDfa === 'string' &&
+        typeof data.pathToDict === 'string') {
+      lazyFile('julius.dfa', data.pathToDfa);
+      lazyFile('julius.dict', data.pathToDict);
+      // Names of categories, for `addWords`
+      if (/\.dfa$/.test(data.pathToDfa)) {
+        lazyFile('julius.term', data.pathToDfa.replace(/\.dfa$/, '.term'));
+        termFile = 'julius.term';
+      }
+    } else {
+      dfa = 'voxforge/sample.dfa';
+      dict = 'voxforge/sample.dict';
+      termFile = 'voxforge/sample.term';
+    }
+
+    options = [
+      '-dfa',   dfa,
+      '-v',     dict,
+      '-h',     'voxforge/hmmdefs',
+      '-hlist', 'voxforge/tiedlist',
+      '-input', 'mic',
+      '-realtime'
+    ];
+
+    // Two-stage cascade: the wake grammar runs alone with a narrow beam
+    // until it hears the wake phrase, then the main grammar, both on one
+    // acoustic model; other options apply to the main stage
+    if (console.cascade) {
+      lazyFile('wake.dfa', console.cascade.dfa);
+      lazyFile('wake.dict', console.cascade.dict);
       options = [
-        '-dfa',   dfa,
-        '-v',     dict,
+        '-input', 'mic',
+        '-realtime',
+        '-cascade', 'wake', String(console.cascade.seconds || 0),
+        '-AM',    'am',
         '-h',     'voxforge/hmmdefs',
         '-hlist', 'voxforge/tiedlist',
-        '-input', 'mic',
-        '-realtime'
+        '-LM',    'wake',
+        '-dfa',   'wake.dfa',
+        '-v',     'wake.dict',
+        '-LM',    'main',
+        '-dfa',   dfa,
+        '-v',     dict,
+        '-SR',    'wake', 'am', 'wake',
+        '-b',     String(console.cascade.beam || 400),
+        '-SR',    'main', 'am', 'main'
       ];
+    }
 
-      for (var flag in e.data.options) {
-        if (flag.match(/dfa|v|h|hlist|input|realtime|quiet|nolog|log/))
-          break;
+    for (var flag in data.options) {
+      if (flag.match(/^(dfa|v|h|hlist|input|realtime|quiet|nolog|log)$/))
+        continue;
 
-        options.push('-' + flag);
-        if (options[flag] !== true && options[flag])
-          options.push(options[flag]);
-      }
-      if (!('log' in e.data.options)) options.push('-nolog');
-      else console.verbose = true;
+      options.push('-' + flag);
+      if (data.options[flag] !== true && data.options[flag] !== undefined)
+        options.push(String(data.options[flag]));
+    }
+    if (!('log' in data.options)) options.push('-nolog');
+    else console.verbose = true;
 
-      var bootstrap = function() {
-        if (runDependencies) {
-          setTimeout(bootstrap, 0);
+    var bootstrap = function() {
+      if (runDependencies) {
+        setTimeout(bootstrap, 0);
+        return;
+      }
+      if (shards && !mountShards(bootstrap)) return;
+      // Quantized builds (`QUANT=8 ./emscript.sh`) ship the Gaussians
+      // apart from a skeleton hmmdefs; see bin/hquant.js
+      if (FS.findObject('voxforge/hmmdefs.q') && options.indexOf('-hquant') < 0)
+        options.push('-hquant', 'voxforge/hmmdefs.q');
+      // and `GSELECT=1` builds a Gaussian selection codebook, unless the
+      // page asks for batches, which it cannot do; see bin/gselect.js
+      if (FS.findObject('voxforge/hmmdefs.gs') && options.indexOf('-gselect') < 0 && !(data.options.obatch > 1))
+        options.push('-gselect', 'voxforge/hmmdefs.gs');
+      if (cache && !cache.restored) {
+        FS.mkdir(LEXICON_DIR);
+        options.push('-lexcache', LEXICON_DIR);
+        lexiconStored = typeof indexedDB !== 'undefined';
+        cache.restored = {files: 0, bytes: 0, msec: 0};
+        if (lexiconStored) {
+          lexiconRestore().then(function(report) {
+            cache.restored = report;
+          }, function() {
+            lexiconStored = false;
+          }).then(bootstrap);
           return;
         }
-        try { Module.callMain(options); }
-        catch (error) { master.postMessage({type: 'error', error: error}); }
-      };
-      bootstrap();
+      }
+      // Record the session from the start (see `replay`)
+      if (record && Module._event_sched_observe) {
+        recording = new Recording(session);
+        Module.ccall('event_sched_observe', null, ['number'], [1]);
+      }
+      // Read before the package is dropped
+      if (termFile && termFile.indexOf(PACKAGE_DIR.slice(1) + '/') === 0) readTerms();
+      var start = performance.now();
+      try { Module.callMain(options); }
+      catch (error) { master.postMessage({type: 'error', error: error}); return; }
+      engine = true;
+      // Models are loaded: peak heap of the startup, then without the package
+      startup = {msec: performance.now() - start, loaded: heapStats()};
+      startup.package = releasePackage();
+      startup.released = heapStats();
+      if (shards) startup.shards = shards.report;
+      // Lexicon trees of the startup, built or read
+      if (cache) startup.grammarCache = {restored: cache.restored, lexicons: lexicons.splice(0)};
+      running = true;
+      if (statsInterval) setInterval(postStats, statsInterval);
+      if (decodes.length) decodeNext();
+      slotsWaiting.splice(0).forEach(function(data) {
+        if (data.type === 'grammar') useGrammar(data);
+        else slot(data);
+      });
+      if (ready) ready();
+    };
+    bootstrap();
+  };
+
+  return function(e) {
+    if (e.data.type === 'begin') {
+      boot(e.data);
+
+    } else if (e.data.type === 'stats') {
+      postStats();
+
+    } else if (e.data.type === 'decode') {
+      decode(e.data);
+
+    } else if (e.data.type === 'slot') {
+      slot(e.data);
+
+    } else if (e.data.type === 'grammar') {
+      useGrammar(e.data);
+
+    } else if (e.data.type === 'recording') {
+      // null unless started with `options.record`
+      var saved = recording ? recording.save() : null;
+      master.postMessage({type: 'recording', recording: saved}, saved ? [saved] : []);
+
+    } else if (e.data.type === 'replay') {
+      replay(e.data);
+
+    } else if (e.data.type === 'trace') {
+      // See event_trace_json() in libjulius/src/event_trace.c;
+      // null unless built with stage timers (`TRACE=1 ./emscript.sh`)
+      var trace = Module._event_trace_json &&
+        Module.ccall('event_trace_json', 'string', ['number'], [e.data.reset ? 1 : 0]);
+      master.postMessage({type: 'trace', trace: trace ? JSON.parse(trace) : null});
 
     } else {
+      if (decodes.length) return;
       var ptr = Module._malloc(byteSize);
+      var start = performance.now();
       // Convert to .raw format
       converter.convert(e.data, Module.HEAPU16.buffer, ptr);
+      // Time the conversion (TRACE_CONVERT in libjulius/include/julius/event.h)
+      if (Module._event_trace_add)
+        Module._event_trace_add(0, start, performance.now() - start);
+      if (recording) recording.fill(start, ptr, bufferSize);
       // Copy to ring buffer (see libsent/src/adin_mic_webaudio.c)
       fillBuffer(ptr, bufferSize);
       Module._free(ptr);
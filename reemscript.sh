@@ -16,6 +16,15 @@ pushd src/emscripted
 # -- update Web Audio adin_mic library
 pushd libsent
 cp -f ../../include/libsent/src/adin/adin_mic_webaudio.c src/adin/.
+cp -f ../../include/libsent/src/wav2mfcc/wav2mfcc-simd.c src/wav2mfcc/.
+cp -f ../../include/libsent/configure.in .
+cp -f ../../include/libsent/configure .
+# -- trees made by an emscript.sh older than wav2mfcc-simd.c: keep the
+#    original WMP_calc() as its fallback, and build it with the MFCC objects
+sed 's/^WMP_calc(/WMP_calc_scalar(/' < src/wav2mfcc/wav2mfcc-pipe.c > tmp && mv tmp src/wav2mfcc/wav2mfcc-pipe.c
+for makefile in Makefile.in Makefile; do
+  grep -q 'src/wav2mfcc/wav2mfcc-simd\.o' $makefile || { sed 's#src/wav2mfcc/wav2mfcc-pipe\.o#src/wav2mfcc/wav2mfcc-pipe.o src/wav2mfcc/wav2mfcc-simd.o#' < $makefile > tmp && mv tmp $makefile; }
+done
 popd
 pushd libjulius
 cp -f ../../include/libjulius/src/m_adin.c src/.
@@ -28,8 +37,27 @@ cp -f ../../include/julius/recogloop.c .
 popd
 # -- update libjulius for (evented) multithreading
 pushd libjulius
+cp -f ../../include/libjulius/include/julius/event.h include/julius/.
 cp -f ../../include/libjulius/src/recogmain.c src/.
 cp -f ../../include/libjulius/src/adin-cut.c src/.
+cp -f ../../include/libjulius/src/event_trace.c src/.
+cp -f ../../include/libjulius/src/event_sched.c src/.
+cp -f ../../include/libjulius/src/outprob_simd.c src/.
+cp -f ../../include/libjulius/src/event_lexicon.c src/.
+# -- trees made by an emscript.sh older than the delayed 1st pass
+sed 's/^decode_proceed(/decode_proceed_serial(/' < src/beam.c > tmp && mv tmp src/beam.c
+sed 's/^decode_end(/decode_end_serial(/' < src/beam.c > tmp && mv tmp src/beam.c
+# -- trees made by an emscript.sh older than the lexicon cache
+sed 's/^build_wchmm2(/build_wchmm2_tree(/' < src/wchmm.c > tmp && mv tmp src/wchmm.c
+# -- enable stage timers with `TRACE=1` (see event.h)
+if [ -n "$TRACE" ]; then
+  sed 's#^/\* \(\#define EVENT_TRACE\) \*/#\1#' < include/julius/event.h > tmp && mv tmp include/julius/event.h
+fi
+# -- trees made by an emscript.sh older than event_sched.c, event_trace.c,
+#    outprob_simd.c or event_lexicon.c
+for obj in event_sched event_trace outprob_simd event_lexicon; do
+  grep -q "src/$obj\\.o" Makefile || { sed "s#src/recogmain\\.o#src/recogmain.o src/$obj.o#" < Makefile > tmp && mv tmp Makefile; }
+done
 popd
 
 # -- emscript
@@ -40,7 +68,101 @@ popd
 
 # - build javascript package
 pushd js
-emcc -O3 ../src/emscripted/julius/julius.bc -L../src/include/zlib -lz -o recognizer.js --preload-file voxforge -s INVOKE_RUN=0 -s NO_EXIT_RUNTIME=1 -s ALLOW_MEMORY_GROWTH=1 -s BUILD_AS_WORKER=1 -s EXPORTED_FUNCTIONS="['_main', '_main_event_recognition_stream_loop', '_end_event_recognition_stream_loop', '_event_recognize_stream', '_get_rate', '_fill_buffer']" 
+# -- model files made by the tools in bin/ are staged in voxforge-pack
+PRELOAD=voxforge
+if [ -n "$QUANT" ] || [ -n "$GSELECT" ]; then
+  rm -rf voxforge-pack && cp -r voxforge voxforge-pack
+  PRELOAD=voxforge-pack@voxforge
+fi
+# -- quantized acoustic model (see bin/hquant.js); build with `QUANT=8`
+#    or `QUANT=16`, worker.js then passes `-hquant` to the engine
+if [ -n "$QUANT" ]; then
+  node ../bin/hquant.js --format "$QUANT" voxforge/hmmdefs voxforge-pack/hmmdefs voxforge-pack/hmmdefs.q
+fi
+# -- Gaussian selection codebook (see bin/gselect.js); build with
+#    `GSELECT=1`, worker.js then passes `-gselect` to the engine
+if [ -n "$GSELECT" ]; then
+  node ../bin/gselect.js voxforge/hmmdefs voxforge-pack/hmmdefs.gs
+fi
+# -- the package stays out of the heap (`--no-heap-copy`, the only mode of
+#    recent emscripten), the engine reads its files in place, and worker.js
+#    drops them once the models are loaded
+PACKAGE="--preload-file $PRELOAD --no-heap-copy"
+# -- or, with `SHARDS=1`, there is no package: the model files are shards
+#    named by their content in models/ (see bin/shard.js), which worker.js
+#    fetches apart and keeps in Cache Storage
+if [ -n "$SHARDS" ]; then
+  node ../bin/shard.js --out models "${PRELOAD%@*}"
+  PACKAGE="-s FORCE_FILESYSTEM=1"
+fi
+
+emcc -O3 ../src/emscripted/julius/julius.bc -L../src/include/zlib -lz -o recognizer.js $PACKAGE -s INVOKE_RUN=0 -s NO_EXIT_RUNTIME=1 -s ALLOW_MEMORY_GROWTH=1 -s BUILD_AS_WORKER=1 -s EXPORTED_FUNCTIONS="['_main', '_main_event_recognition_stream_loop', '_end_event_recognition_stream_loop', '_event_recognize_stream', '_get_rate', '_fill_buffer', '_adin_mic_decode', '_event_sched_dispatch', '_event_sched_manual', '_event_sched_observe', '_event_sched_pending', '_get_stats', '_slot_words', '_use_grammar', '_event_trace_json', '_event_trace_add']" 
+
+# -- SIMD variant (WebAssembly with 128-bit SIMD), chosen by worker.js where
+#    supported; build with `SIMD=1` (needs an emscripten with wasm SIMD)
+if [ -n "$SIMD" ]; then
+  pushd ../src/emscripted
+  emmake make -C libsent clean
+  emmake make -C libsent CFLAGS="-O3 -msimd128"
+  emmake make -C libjulius clean
+  emmake make -C libjulius CFLAGS="-O3 -msimd128"
+  rm -f julius/julius && emmake make -C julius
+  mv julius/julius julius/julius-simd.bc
+  emmake make -C libsent clean
+  emmake make -C libsent
+  emmake make -C libjulius clean
+  emmake make -C libjulius
+  popd
+  emcc -O3 -msimd128 ../src/emscripted/julius/julius-simd.bc -L../src/include/zlib -lz -o recognizer-simd.js $PACKAGE -s WASM=1 -s INVOKE_RUN=0 -s NO_EXIT_RUNTIME=1 -s ALLOW_MEMORY_GROWTH=1 -s BUILD_AS_WORKER=1 -s EXPORTED_FUNCTIONS="['_main', '_main_event_recognition_stream_loop', '_end_event_recognition_stream_loop', '_event_recognize_stream', '_get_rate', '_fill_buffer', '_adin_mic_decode', '_event_sched_dispatch', '_event_sched_manual', '_event_sched_observe', '_event_sched_pending', '_get_stats', '_slot_words', '_use_grammar', '_event_trace_json', '_event_trace_add']"
+fi
+
+# -- pthread variant (A/D-in and decoding on their own threads, sharing
+#    memory), chosen by worker.js where the page is cross-origin isolated;
+#    build with `PTHREAD=1` (configured in a copy of the tree, as libjulius
+#    then defines HAVE_PTHREAD); its Web Workers are made up front for
+#    the A/D-in and recognition threads and the search threads of
+#    recogmain.c, 2 + SEARCH_THREAD_MAX
+if [ -n "$PTHREAD" ]; then
+  pushd ../src
+  rm -rf emscripted-pthread && cp -r emscripted emscripted-pthread
+  pushd emscripted-pthread
+  emconfigure ./configure --with-mictype=webaudio CFLAGS="-O3 -pthread"
+  emmake make clean
+  emmake make $MK_ARG
+  mv julius/julius julius/julius-pthread.bc
+  popd
+  # --- shared memory needs every object built with -pthread, zlib too
+  rm -rf include/zlib-pthread && cp -r include/zlib include/zlib-pthread
+  pushd include/zlib-pthread
+  emmake make clean
+  CFLAGS="-O3 -pthread" emconfigure ./configure
+  emmake make
+  popd
+  popd
+  emcc -O3 -pthread ../src/emscripted-pthread/julius/julius-pthread.bc -L../src/include/zlib-pthread -lz -o recognizer-pthread.js $PACKAGE -s WASM=1 -s USE_PTHREADS=1 -s PTHREAD_POOL_SIZE=10 -s INVOKE_RUN=0 -s NO_EXIT_RUNTIME=1 -s ALLOW_MEMORY_GROWTH=1 -s EXPORTED_FUNCTIONS="['_main', '_main_event_recognition_stream_loop', '_end_event_recognition_stream_loop', '_event_recognize_stream', '_get_rate', '_fill_buffer', '_event_sched_dispatch', '_get_stats', '_event_trace_json', '_event_trace_add']"
+fi
+
+# -- Node.js variant for batch decoding of files (see bin/batch.js); build
+#    with `NODE=1`.  Files, the model included, are read from the disk
+if [ -n "$NODE" ]; then
+  emcc -O3 ../src/emscripted/julius/julius.bc -L../src/include/zlib -lz -o recognizer-node.js -s WASM=1 -s ENVIRONMENT=node -s NODERAWFS=1 -s MODULARIZE=1 -s EXPORT_NAME=Recognizer -s INVOKE_RUN=0 -s NO_EXIT_RUNTIME=1 -s ALLOW_MEMORY_GROWTH=1 -s EXPORTED_FUNCTIONS="['_main', '_main_event_recognition_stream_loop', '_end_event_recognition_stream_loop', '_event_recognize_stream', '_event_sched_dispatch', '_get_stats', '_event_trace_json']" -s EXTRA_EXPORTED_RUNTIME_METHODS="['callMain', 'cwrap', 'ccall']"
+fi
+
+# -- native build of the same event-driven engine, for profilers and
+#    sanitizers (perf, valgrind, -fsanitize=...); build with `NATIVE=1`,
+#    with NATIVE_CFLAGS (-O2 -g by default).  bin/julius-event runs the
+#    loop of libjulius/src/event_sched.c, e.g. on `-input rawfile`
+if [ -n "$NATIVE" ]; then
+  pushd ../src
+  rm -rf native && cp -r emscripted native
+  pushd native
+  make distclean
+  ./configure --disable-pthread CFLAGS="${NATIVE_CFLAGS:--O2 -g}"
+  make $MK_ARG
+  cp -f julius/julius ../../bin/julius-event
+  popd
+  popd
+fi
 
 # -- copy the javascript wrappers
 cp -fr ../dist/* .
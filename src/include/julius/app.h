@@ -1,4 +1,5 @@
 #include <julius/juliuslib.h>
+#include <julius/event.h>
 
 #if defined(_WIN32) && !defined(__CYGWIN32__) && !defined(__MINGW32__)
 #include <config-msvc-julius.h>
@@ -20,6 +21,12 @@ void main_recognition_stream_loop(Recog *recog);
 void init_event_recognition_stream_loop(Recog *recog);
 int main_event_recognition_stream_loop();
 void end_event_recognition_stream_loop();
+#ifdef HAVE_PTHREAD
+boolean start_event_recognition_thread();
+#endif
+EventStats *get_stats();
+int slot_words(char *lines, int remove);
+int use_grammar(char *name, char *dfa, char *dict);
 
 /* module.c */
 int module_send(int sd, char *fmt, ...);
@@ -25,13 +25,25 @@
 
 #include "app.h"
 
-#include <emscripten.h>
-
 boolean separate_score_flag = FALSE;
 boolean outfile_enabled = FALSE;
 
 static char *logfile = NULL;
 static boolean nolog = FALSE;
+static float pass1_final_margin = -1.0;
+static boolean pass1_final_verify = FALSE;
+static boolean simd_enable = TRUE;
+static boolean simd_check = FALSE;
+static boolean simd_bench = FALSE;
+static int outprob_batch = 1;
+static char *hquant_file = NULL;
+static char *gselect_file = NULL;
+static boolean spot_enable = FALSE;
+static float spot_threshold = 0.0;
+static char *cascade_wake = NULL;
+static float cascade_sec = 0.0;
+static boolean split_am_enable = FALSE;
+static char *lexicon_dir = NULL;
 
 /************************************************************************/
 /**
@@ -71,6 +83,123 @@ opt_outfile(Jconf *jconf, char *arg[], int argnum)
   outfile_enabled = TRUE;
   return TRUE;
 }
+static boolean
+opt_pass1final(Jconf *jconf, char *arg[], int argnum)
+{
+  pass1_final_margin = atof(arg[0]);
+  return TRUE;
+}
+static boolean
+opt_pass1verify(Jconf *jconf, char *arg[], int argnum)
+{
+  pass1_final_verify = TRUE;
+  return TRUE;
+}
+static boolean
+opt_nosimd(Jconf *jconf, char *arg[], int argnum)
+{
+  simd_enable = FALSE;
+  return TRUE;
+}
+static boolean
+opt_simdcheck(Jconf *jconf, char *arg[], int argnum)
+{
+  simd_check = TRUE;
+  return TRUE;
+}
+static boolean
+opt_simdbench(Jconf *jconf, char *arg[], int argnum)
+{
+  simd_bench = TRUE;
+  return TRUE;
+}
+static boolean
+opt_obatch(Jconf *jconf, char *arg[], int argnum)
+{
+  outprob_batch = atoi(arg[0]);
+  return TRUE;
+}
+static boolean
+opt_hquant(Jconf *jconf, char *arg[], int argnum)
+{
+  hquant_file = (char *)malloc(strlen(arg[0]) + 1);
+  strcpy(hquant_file, arg[0]);
+  return TRUE;
+}
+static boolean
+opt_gselect(Jconf *jconf, char *arg[], int argnum)
+{
+  gselect_file = (char *)malloc(strlen(arg[0]) + 1);
+  strcpy(gselect_file, arg[0]);
+  return TRUE;
+}
+static boolean
+opt_spot(Jconf *jconf, char *arg[], int argnum)
+{
+  spot_enable = TRUE;
+  spot_threshold = atof(arg[0]);
+  return TRUE;
+}
+static boolean
+opt_cascade(Jconf *jconf, char *arg[], int argnum)
+{
+  cascade_wake = (char *)malloc(strlen(arg[0]) + 1);
+  strcpy(cascade_wake, arg[0]);
+  cascade_sec = atof(arg[1]);
+  return TRUE;
+}
+static boolean
+opt_splitam(Jconf *jconf, char *arg[], int argnum)
+{
+  split_am_enable = TRUE;
+  return TRUE;
+}
+static boolean
+opt_lexcache(Jconf *jconf, char *arg[], int argnum)
+{
+  lexicon_dir = (char *)malloc(strlen(arg[0]) + 1);
+  strcpy(lexicon_dir, arg[0]);
+  return TRUE;
+}
+
+/**
+ * Give each recognition process whose acoustic model is used by an
+ * earlier one a copy of it, so that the 2nd pass of the processes
+ * searches on threads of their own in the pthread build (see
+ * pass2_parallel() in recogmain.c).  Each copy is loaded from the
+ * files again as a model of its own, and named after the original and
+ * the process: the memory of the model is taken once per copy.
+ *
+ * @param jconf [i/o] finalized configuration
+ *
+ * @return TRUE on success, FALSE if a copy could not be registered.
+ */
+static boolean
+split_am(Jconf *jconf)
+{
+  JCONF_SEARCH *s, *t;
+  JCONF_AM *am;
+  char name[JCONF_MODULENAME_MAXLEN];
+
+  for(s=jconf->search_root;s;s=s->next) {
+    for(t=jconf->search_root;t!=s;t=t->next) {
+      if (t->amconf == s->amconf) break;
+    }
+    if (t == s) continue;
+    am = (JCONF_AM *)mymalloc(sizeof(JCONF_AM));
+    memcpy(am, s->amconf, sizeof(JCONF_AM));
+    am->next = NULL;
+    snprintf(name, JCONF_MODULENAME_MAXLEN, "%s_%s", s->amconf->name, s->name);
+    if (j_jconf_am_regist(jconf, am, name) == FALSE) {
+      fprintf(stderr, "ERROR: failed to copy AM \"%s\" for SR \"%s\"\n", s->amconf->name, s->name);
+      free(am);
+      return FALSE;
+    }
+    jlog("STAT: SR%02d %s: searches on its own copy of AM \"%s\"\n", s->id, s->name, s->amconf->name);
+    s->amconf = am;
+  }
+  return TRUE;
+}
    
 /**********************************************************************/
 int
@@ -79,6 +208,7 @@ main(int argc, char *argv[])
   FILE *fp;
   Recog *recog;
   Jconf *jconf;
+  int heap_load, heap_fusion;
 
   /* inihibit system log output (default: stdout) */
   // jlog_set_output(NULL);
@@ -102,6 +232,18 @@ main(int argc, char *argv[])
   j_add_option("-logfile", 1, 1, "output log to file", opt_logfile);
   j_add_option("-nolog", 0, 0, "not output any log", opt_nolog);
   j_add_option("-outfile", 0, 0, "save result in separate .out file", opt_outfile);
+  j_add_option("-pass1final", 1, 1, "output 1st pass result as final when it leads by the score margin", opt_pass1final);
+  j_add_option("-pass1verify", 0, 0, "with -pass1final, still run 2nd pass to verify", opt_pass1verify);
+  j_add_option("-nosimd", 0, 0, "compute MFCC and output probabilities without vectors", opt_nosimd);
+  j_add_option("-simdcheck", 0, 0, "check vectorized MFCC and output probabilities against the original", opt_simdcheck);
+  j_add_option("-simdbench", 0, 0, "benchmark vectorized output probabilities at startup", opt_simdbench);
+  j_add_option("-obatch", 1, 1, "score each state on this many available frames at once", opt_obatch);
+  j_add_option("-hquant", 1, 1, "quantized Gaussians for the skeleton hmmdefs (see bin/hquant.js)", opt_hquant);
+  j_add_option("-gselect", 1, 1, "compute only the Gaussians near each frame (see bin/gselect.js)", opt_gselect);
+  j_add_option("-spot", 1, 1, "detect keywords of a filler grammar on 1st pass at this log likelihood ratio per frame (see bin/mkspot.js)", opt_spot);
+  j_add_option("-cascade", 2, 2, "run the named -SR alone until it hears the wake phrase, then the others for one input (0) or seconds", opt_cascade);
+  j_add_option("-splitam", 0, 0, "give each -SR its own copy of a shared -AM (loaded again), to run its 2nd pass on a thread of its own", opt_splitam);
+  j_add_option("-lexcache", 1, 1, "keep lexicon trees of grammars in this directory, and read them back (see event_lexicon.c)", opt_lexcache);
   j_add_option("-help", 0, 0, "display this help", opt_help);
   j_add_option("--help", 0, 0, "display this help", opt_help);
 
@@ -112,6 +254,11 @@ main(int argc, char *argv[])
     fprintf(stderr, "Try `-help' for more information.\n");
     return -1;
   }
+  /* Gaussians are selected for one frame at a time */
+  if (gselect_file && outprob_batch > 1) {
+    fprintf(stderr, "ERROR: \"-gselect\" cannot be used with \"-obatch\"\n");
+    return -1;
+  }
 
   /* output system log to a file */
   if (nolog) {
@@ -133,12 +280,17 @@ main(int argc, char *argv[])
     if (logfile) fclose(fp);
     return -1;
   }
+  if (split_am_enable && split_am(jconf) == FALSE) {
+    if (logfile) fclose(fp);
+    return -1;
+  }
 
   /* create a recognition instance */
   recog = j_recog_new();
   /* assign configuration to the instance */
   recog->jconf = jconf;
   /* load all files according to the configurations */
+  heap_load = event_stats(NULL)->heap_inuse;
   if (j_load_all(recog, jconf) == FALSE) {
     fprintf(stderr, "ERROR: Error in loading model\n");
     if (logfile) fclose(fp);
@@ -155,14 +307,67 @@ main(int argc, char *argv[])
     }
 #endif
 
+  heap_load = event_stats(NULL)->heap_inuse - heap_load;
+
+  /* lexicon trees of grammars from the cache, from the first one on */
+  if (lexicon_dir) event_lexicon_setup(recog, lexicon_dir);
+
   /* checkout for recognition: build lexicon tree, allocate cache */
+  heap_fusion = event_stats(NULL)->heap_inuse;
   if (j_final_fusion(recog) == FALSE) {
     fprintf(stderr, "ERROR: Error while setup work area for recognition\n");
     j_recog_free(recog);
     if (logfile) fclose(fp);
     return -1;
   }
+  /* vectorized output probabilities (before the trace hooks them);
+     quantized Gaussians and Gaussian selection need them */
+  if (hquant_file && event_outprob_simd_quant(hquant_file) == FALSE) {
+    fprintf(stderr, "ERROR: Error in loading quantized Gaussians\n");
+    j_recog_free(recog);
+    if (logfile) fclose(fp);
+    return -1;
+  }
+  if (gselect_file && event_outprob_simd_gselect(gselect_file) == FALSE) {
+    fprintf(stderr, "ERROR: Error in loading Gaussian selection\n");
+    j_recog_free(recog);
+    if (logfile) fclose(fp);
+    return -1;
+  }
+  /* vectors by default only where the libraries are compiled with them
+     (recognizer-simd.js); this file is not, even in that build */
+  if (! wmp_simd_available()) simd_enable = FALSE;
+  if (simd_enable || hquant_file || gselect_file || outprob_batch > 1) {
+    if (event_outprob_simd_setup(recog, outprob_batch, simd_check, simd_bench) == FALSE) {
+      fprintf(stderr, "ERROR: Error while packing Gaussians\n");
+      j_recog_free(recog);
+      if (logfile) fclose(fp);
+      return -1;
+    }
+  }
+  if (outprob_batch > 1) {
+    /* the real-time 1st pass searches behind the input, so that a batch
+       finds the following frames computed */
+    event_set_pass1_lookahead((outprob_batch > 8 ? 8 : outprob_batch) - 1);
+  }
+  heap_fusion = event_stats(NULL)->heap_inuse - heap_fusion;
+  /* record model memory for telemetry */
+  event_stats_model(heap_load, heap_fusion);
+
+#ifdef EVENT_TRACE
+  /* time output probability computation */
+  event_trace_setup(recog);
+#endif
   
+  /* finalize confident results on the 1st pass if specified */
+  event_set_pass1_final(pass1_final_margin, pass1_final_verify);
+  /* detect keywords on the 1st pass if specified */
+  if (spot_enable) event_spot_setup(recog, spot_threshold);
+  /* measure real-time factor and latency of each utterance */
+  event_gauge_setup(recog);
+  /* select vectorized or original MFCC computation */
+  wmp_simd_setup(simd_enable, simd_check);
+
   /* Set up some application functions */
   /* set character conversion mode */
   if (charconv_setup() == FALSE) {
@@ -191,6 +396,13 @@ main(int argc, char *argv[])
   /* setup recording if option was specified */
   record_setup(recog, NULL);
 
+  /* switch stages after the results are output */
+  if (cascade_wake && event_cascade_setup(recog, cascade_wake, cascade_sec) == FALSE) {
+    j_recog_free(recog);
+    if (logfile) fclose(fp);
+    return -1;
+  }
+
   /* on module connect with client */
   if (is_module_mode()) module_server();
 
@@ -232,8 +444,18 @@ main(int argc, char *argv[])
   // TODO: Bubble up the USE_WEBAUDIO definition
   /* initialize recognition loop */
   init_event_recognition_stream_loop(recog);
+#ifdef HAVE_PTHREAD
+  /* decode on a thread of its own (pthread build) */
+  if (start_event_recognition_thread() == FALSE) {
+    if (logfile) fclose(fp);
+    return -1;
+  }
+#else
   /* kick off event-based looping */
-  EM_ASM( setTimeout(Module.cwrap('main_event_recognition_stream_loop'), 0); );
+  event_sched_next_input();
+  /* natively, the loop runs here until recognition ends */
+  event_sched_run();
+#endif
 
   /* the remainder of the ending calls (i.e. j_recog_free) have been moved to end_recognition_stream_loop */
 
@@ -25,7 +25,9 @@
 
 #include "app.h"
 
-#include <emscripten.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 extern boolean outfile_enabled;
 
@@ -197,12 +199,41 @@ main_recognition_stream_loop(Recog *recog)
 
 }
 
+/**
+ * Task of the scheduler opening the next input stream (see
+ * libjulius/src/event_sched.c).  Inputs that failed to open, or were
+ * recognized at once, are followed by the next.
+ *
+ * @param dummy [in] task argument (unused)
+ */
+static void
+stream_loop_task(void *dummy)
+{
+  if (main_event_recognition_stream_loop() == 0) {
+    event_sched_post(stream_loop_task, NULL);
+  }
+}
+
+/**
+ * Task of the scheduler ending recognition.
+ *
+ * @param dummy [in] task argument (unused)
+ */
+static void
+stream_end_task(void *dummy)
+{
+  end_event_recognition_stream_loop();
+}
+
 void
 init_event_recognition_stream_loop(Recog *recognizer)
 {
   recog = recognizer;
   jconf = recog->jconf;
 
+  /* called back by the event-driven loop of libjulius */
+  event_sched_set_input(stream_loop_task, stream_end_task);
+
   /* reset file count */
   file_counter = 0;
   
@@ -217,6 +248,55 @@ init_event_recognition_stream_loop(Recog *recognizer)
   }
 }
 
+/**
+ * Get memory telemetry of the running engine.  All zero until main()
+ * has set the engine up.
+ *
+ * @return pointer to static statistics (see EventStats in julius/event.h)
+ */
+EventStats *
+get_stats()
+{
+  static EventStats none;
+
+  if (recog == NULL) {
+    memset(&none, 0, sizeof(EventStats));
+    return(&none);
+  }
+  return(event_stats(recog));
+}
+
+/**
+ * Add words to categories of the grammar, or remove them, at the next
+ * input (see event_slot_words() in libjulius/src/recogmain.c).
+ *
+ * @param lines [i/o] dictionary lines separated by newlines
+ * @param remove [in] non-zero to remove the words
+ *
+ * @return the number of words added or removed, or -1 on error
+ */
+int
+slot_words(char *lines, int remove)
+{
+  return(event_slot_words(recog, lines, remove ? TRUE : FALSE));
+}
+
+/**
+ * Replace the grammar with another one at the next input (see
+ * event_grammar_use() in libjulius/src/recogmain.c).
+ *
+ * @param name [in] name of the grammar
+ * @param dfa [in] grammar file
+ * @param dict [in] dictionary file
+ *
+ * @return the number of words of the grammar, or -1 on error
+ */
+int
+use_grammar(char *name, char *dfa, char *dict)
+{
+  return(event_grammar_use(recog, name, dfa, dict));
+}
+
 void
 end_event_recognition_stream_loop()
 {
@@ -329,6 +409,10 @@ main_event_recognition_stream_loop()
       case -2:			/* end of recognition process */
 	if (jconf->input.speech_input == SP_RAWFILE) {
 	  fprintf(stderr, "%d files processed\n", file_counter);
+	  /* tell a batch runner that all files are done (see bin/batch.js) */
+	  EVENT_ASM_ARGS({
+	    if (typeof filesDone === 'function') filesDone($0);
+	  }, file_counter);
 	} else if (jconf->input.speech_input == SP_STDIN) {
 	  fprintf(stderr, "reached end of input on stdin\n");
 	} else {
@@ -339,6 +423,12 @@ main_event_recognition_stream_loop()
       if (outfile_enabled) {
 	outfile_set_fname(j_get_current_filename(recog));
       }
+      if (jconf->input.speech_input == SP_RAWFILE) {
+	/* results until the next file are of this one */
+	EVENT_ASM_ARGS({
+	  if (typeof fileBegin === 'function') fileBegin(UTF8ToString($0));
+	}, j_get_current_filename(recog));
+      }
       
       /* count number of processed files */
       if (jconf->input.speech_input == SP_RAWFILE) {
@@ -346,9 +436,14 @@ main_event_recognition_stream_loop()
       }
 
       /* start recognizing the stream */
-      EM_ASM_ARGS({
-        setTimeout(Module.cwrap('event_recognize_stream', 'number', ['number']).bind(null, $0), 0);
-      }, recog);
+#ifdef HAVE_PTHREAD
+      /* on the decoding thread, until the stream ends */
+      if (event_recognize_stream_thread(recog) == -1) {
+	end_event_recognition_stream_loop(); return -1;
+      }
+      return 0;
+#else
+      event_recognize_stream_start(recog);
       /* how to stop:
    add a function to CALLBACK_POLL and call j_request_pause() or
    j_request_terminate() in the function.
@@ -357,6 +452,42 @@ main_event_recognition_stream_loop()
    Julius resume the search.
       */
       return 2;
+#endif
     }
   return -1;
 }
+
+#ifdef HAVE_PTHREAD
+/**
+ * Decoding thread of the pthread build: open and recognize input
+ * streams until recognition ends.
+ *
+ * @param dummy [in] thread argument (unused)
+ */
+static void *
+event_recognition_thread_main(void *dummy)
+{
+  while(main_event_recognition_stream_loop() == 0);
+  return NULL;
+}
+
+/**
+ * Start the decoding thread of the pthread build, in place of the
+ * event-based loop.  A/D-in runs on another thread, created when the
+ * stream is opened.
+ *
+ * @return TRUE on success, FALSE on failure.
+ */
+boolean
+start_event_recognition_thread()
+{
+  pthread_t thread;
+
+  if (pthread_create(&thread, NULL, event_recognition_thread_main, NULL) != 0) {
+    fprintf(stderr, "ERROR: failed to create decoding thread\n");
+    return FALSE;
+  }
+  pthread_detach(thread);
+  return TRUE;
+}
+#endif
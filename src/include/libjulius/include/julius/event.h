@@ -0,0 +1,189 @@
+/**
+ * @file   event.h
+ *
+ * <EN>
+ * @brief  Additions to JuliusLib for the event-driven (Web Audio) port.
+ *
+ * Functions declared here are specific to JuliusJS and are not part of
+ * the upstream Julius API.  See the attached script (`emscript.sh`) for
+ * how they are merged into the library.
+ *
+ * For more details, see https://github.com/zzmp/juliusjs
+ * </EN>
+ *
+ * @author Zachary POMERANTZ
+ * @date   Wed Jul 16 13:06:00 2014
+ *
+ * $Revision: 1.00 $
+ *
+ */
+/*
+ * Copyright (c) 2014 Zachary Pomerantz, @zzmp
+ * Using the MIT License
+ */
+
+#ifndef __J_EVENT_H__
+#define __J_EVENT_H__
+
+/**
+ * The event-driven loop also builds natively (`NATIVE=1`, see
+ * emscript.sh and event_sched.c), where there is no handling script to
+ * call: its calls are dropped, and time is read from a monotonic clock.
+ */
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#else
+#define EM_ASM(...) ((void)0)
+#define EM_ASM_ARGS(...) ((void)0)
+#define MAIN_THREAD_EM_ASM(...) ((void)0)
+#define emscripten_get_now() event_sched_now()
+#endif
+
+/// A task of the scheduler (see event_sched.c)
+typedef void (*EventTask)(void *arg);
+
+/**
+ * Memory telemetry of the engine, as returned by event_stats().
+ * Values are in bytes unless noted.  All members are int, so that the
+ * handling script can read them as consecutive 32-bit integers; keep
+ * the order in sync with `statsFields` in worker.js.
+ */
+typedef struct {
+  int heap_size;		///< Total heap size
+  int heap_used;		///< Heap obtained by malloc
+  int heap_inuse;		///< Heap allocated and in use
+  int heap_free;		///< Heap obtained by malloc but free
+  int input_num;		///< Number of inputs processed (count)
+  int ring_size;		///< Web Audio ring buffer length (samples)
+  int ring_fill;		///< Samples waiting in the ring buffer (samples)
+  int speech;			///< Speech buffer recog->speech
+  int adin_buffer;		///< A/D-in temporary buffer
+  int adin_cbuf;		///< A/D-in cycle buffer
+  int adin_swapbuf;		///< A/D-in swap buffer for re-triggering
+  int adin_buffer48;		///< A/D-in buffer for 48kHz down sampling
+  int model_load;		///< Heap taken by loading all models
+  int model_fusion;		///< Heap taken by lexicon trees and work areas
+  int am;			///< Acoustic model parameters (estimated)
+  int dict;			///< Word dictionaries (estimated)
+  int dfa;			///< Grammars (estimated)
+  int wchmm;			///< Lexicon trees (estimated)
+  int adin_speech;		///< Buffer of the A/D-in thread (pthread build)
+  int buffer_resizes;		///< Times the ring and A/D-in buffers were resized (count)
+} EventStats;
+
+/**
+ * Stage timers (see event_trace.c).  Run the build scripts with
+ * TRACE=1 to have this defined.
+ */
+/* #define EVENT_TRACE */
+
+/// Stages timed by event_trace.c
+enum {
+  TRACE_CONVERT,		///< Audio conversion in worker.js
+  TRACE_TICK,			///< One call of event_recognize_stream()
+  TRACE_ADIN,			///< adin_go(), including the 1st pass
+  TRACE_PASS1,			///< MFCC computation and 1st pass search
+  TRACE_OUTPROB,		///< Output probability computation
+  TRACE_PASS2,			///< 2nd pass search and alignment
+  TRACE_STAGE_NUM
+};
+
+#ifdef EVENT_TRACE
+#define TRACE_BEGIN(S) event_trace_begin(S)
+#define TRACE_END(S) event_trace_end(S)
+#define TRACE_INPUT_END() event_trace_input_end()
+#define EVENT_PIPELINE event_trace_pipeline
+#else
+#define TRACE_BEGIN(S)
+#define TRACE_END(S)
+#define TRACE_INPUT_END()
+#define EVENT_PIPELINE RealTimePipeLine
+#endif
+
+/**
+ * Calls to the JavaScript of worker.js.  In the pthread build
+ * (`PTHREAD=1`, see emscript.sh), decoding runs on its own thread, and
+ * they are run on the thread of the worker, where worker.js lives.
+ */
+#ifdef HAVE_PTHREAD
+#define EVENT_ASM_ARGS MAIN_THREAD_EM_ASM
+#else
+#define EVENT_ASM_ARGS EM_ASM_ARGS
+#endif
+
+/* recogmain.c */
+void event_set_pass1_final(float margin, boolean verify);
+void event_set_pass1_lookahead(int frames);
+void event_spot_setup(Recog *recog, float threshold);
+boolean event_cascade_setup(Recog *recog, char *wake, float sec);
+int event_slot_words(Recog *recog, char *lines, boolean remove);
+int event_grammar_use(Recog *recog, char *name, char *dfafile, char *dictfile);
+void event_gauge_setup(Recog *recog);
+void event_stats_model(int load, int fusion);
+EventStats *event_stats(Recog *recog);
+void event_recognize_stream(Recog *recog);
+void event_recognize_stream_start(Recog *recog);
+#ifdef HAVE_PTHREAD
+int event_recognize_stream_thread(Recog *recog);
+void event_gauge_idle(double msec);
+#endif
+
+/* adin-cut.c */
+void adin_buffer_status(ADIn *a, int *speech, int *resizes);
+
+/* event_sched.c */
+void event_sched_dispatch();
+void event_sched_post(EventTask task, void *arg);
+void event_sched_post_fast(EventTask task, void *arg);
+void event_sched_manual(boolean flag);
+void event_sched_observe(boolean flag);
+int event_sched_pending();
+void event_sched_set_input(EventTask next, EventTask end);
+void event_sched_next_input();
+void event_sched_end_input();
+int event_sched_run();
+double event_sched_now();
+
+/* event_trace.c */
+void event_trace_add(int stage, double ts, double dur);
+char *event_trace_json(int reset);
+#ifdef EVENT_TRACE
+void event_trace_begin(int stage);
+void event_trace_end(int stage);
+void event_trace_input_end();
+int event_trace_pipeline(SP16 *Speech, int nowlen, Recog *recog);
+void event_trace_setup(Recog *recog);
+#endif
+
+/* beam.c, whose decode_proceed() and decode_end() are renamed by the
+   build scripts and replaced by the ones of recogmain.c */
+boolean decode_proceed_serial(Recog *recog);
+void decode_end_serial(Recog *recog);
+
+/* event_lexicon.c */
+void event_lexicon_setup(Recog *recog, char *dir);
+
+/* wchmm.c, whose build_wchmm2() is renamed by the build scripts and
+   wrapped by the one of event_lexicon.c */
+boolean build_wchmm2_tree(WCHMM_INFO *wchmm, JCONF_LM *lmconf);
+
+/* outprob_simd.c */
+boolean event_outprob_simd_quant(char *filename);
+boolean event_outprob_simd_gselect(char *filename);
+boolean event_outprob_simd_setup(Recog *recog, int batch, boolean check, boolean bench);
+
+/* libsent/src/adin/adin_mic_webaudio.c */
+#ifdef USE_WEBAUDIO
+void adin_mic_buffer_status(int *len, int *fill, int *resized);
+void adin_mic_replay(const SP16 *samples, int len);
+#ifndef HAVE_PTHREAD
+boolean adin_mic_decode(SP16 *samples, int len);
+boolean adin_mic_offline();
+#endif
+#endif
+
+/* libsent/src/wav2mfcc/wav2mfcc-simd.c */
+void wmp_simd_setup(boolean enable, boolean check);
+boolean wmp_simd_available();
+
+#endif /* __J_EVENT_H__ */
@@ -106,17 +106,136 @@
  */
 
 #include <julius/julius.h>
+#include <julius/event.h>
 #ifdef HAVE_PTHREAD
 #include <pthread.h>
 #endif
 
-#include <emscripten.h>
-
 /// Define this if you want to output a debug message for threading
 #undef THREAD_DEBUG
 /// Enable some fixes relating adinnet+module
 #define TMP_FIX_200602		
 
+/**
+ * Number of times the buffers of A/D-in were resized (see
+ * adin_buffer_resize()), for the memory telemetry of event_stats().
+ */
+static int adin_resizes = 0;
+
+/** 
+ * <EN>
+ * @brief  Length of the temporary buffer at rest.
+ *
+ * Samples are read to the temporary buffer and processed by chunks,
+ * so one head margin and a chunk are enough to read a full cycle at a
+ * time.  The buffer grows on demand (see adin_buffer_grow()) and is
+ * brought back to this length at the start of the next input.
+ * </EN>
+ * 
+ * @param a [in] AD-in work area
+ * 
+ * @return length in samples.
+ */
+static int
+adin_buffer_base(ADIn *a)
+{
+  int len;
+
+  len = a->c_length + a->chunk_size;
+  return((len < MAXSPEECHLEN) ? len : MAXSPEECHLEN);
+}
+
+/** 
+ * <EN>
+ * Resize the temporary buffer (and the 48kHz buffer for down
+ * sampling).  Samples in it are kept, up to the new length.
+ * </EN>
+ * 
+ * @param a [i/o] AD-in work area
+ * @param len [in] new length in samples
+ */
+static void
+adin_buffer_resize(ADIn *a, int len)
+{
+  a->buffer = (SP16 *)myrealloc(a->buffer, sizeof(SP16) * len);
+  if (a->down_sample) {
+    a->buffer48 = (SP16 *)myrealloc(a->buffer48, sizeof(SP16) * len * a->io_rate);
+  }
+  a->bpmax = len;
+  if (a->bp > len) a->bp = len;
+  adin_resizes++;
+}
+
+/** 
+ * <EN>
+ * Grow the temporary buffer when it has no room left for new samples,
+ * by doubling it up to MAXSPEECHLEN.
+ * </EN>
+ * 
+ * @param a [i/o] AD-in work area
+ */
+static void
+adin_buffer_grow(ADIn *a)
+{
+  if (a->bp < a->bpmax || a->bpmax >= MAXSPEECHLEN) return;
+  adin_buffer_resize(a, (a->bpmax * 2 < MAXSPEECHLEN) ? a->bpmax * 2 : MAXSPEECHLEN);
+}
+
+/** 
+ * <EN>
+ * Bring the temporary buffer back to its length at rest, once it is
+ * empty at the start of an input.
+ * </EN>
+ * 
+ * @param a [i/o] AD-in work area
+ */
+static void
+adin_buffer_shrink(ADIn *a)
+{
+  if (a->bpmax > adin_buffer_base(a)) adin_buffer_resize(a, adin_buffer_base(a));
+}
+
+#ifdef HAVE_PTHREAD
+/** 
+ * <EN>
+ * Length of the buffer to which the A/D-in thread stores triggered
+ * samples.  Samples past the freeze length (see adin_setup_param())
+ * are never processed, so it need not be longer when a maximum input
+ * length is given by "-rejectlong".
+ * </EN>
+ * 
+ * @param a [in] AD-in work area
+ * 
+ * @return length in samples.
+ */
+static int
+adin_speech_len(ADIn *a)
+{
+  return((a->freezelen < MAXSPEECHLEN) ? a->freezelen : MAXSPEECHLEN);
+}
+#endif
+
+/** 
+ * <EN>
+ * Get the current sizes of the buffers of A/D-in not in the work area,
+ * for the memory telemetry of event_stats().
+ * </EN>
+ * 
+ * @param a [in] AD-in work area
+ * @param speech [out] bytes of the buffer of the A/D-in thread (0 when
+ * not threaded)
+ * @param resizes [out] number of times the buffers were resized
+ */
+void
+adin_buffer_status(ADIn *a, int *speech, int *resizes)
+{
+  *speech = 0;
+#ifdef HAVE_PTHREAD
+  if (a->speech) *speech = adin_speech_len(a) * sizeof(SP16);
+#endif
+  *resizes = adin_resizes;
+}
+
 /** 
  * <EN>
  * @brief  Set up parameters for A/D-in and input detection.
@@ -192,12 +311,16 @@ adin_setup_param(ADIn *adin, Jconf *jconf)
   /**********************/
   /* initialize buffers */
   /**********************/
-  adin->buffer = (SP16 *)mymalloc(sizeof(SP16) * MAXSPEECHLEN);
+  /* the temporary buffer is sized from the chunk and head margin, and
+     grows on demand */
+  adin->bp = 0;
+  adin->bpmax = adin_buffer_base(adin);
+  adin->buffer = (SP16 *)mymalloc(sizeof(SP16) * adin->bpmax);
   adin->cbuf = (SP16 *)mymalloc(sizeof(SP16) * adin->c_length);
   adin->swapbuf = (SP16 *)mymalloc(sizeof(SP16) * adin->sbsize);
   if (adin->down_sample) {
     adin->io_rate = 3;		/* 48 / 16 (fixed) */
-    adin->buffer48 = (SP16 *)mymalloc(sizeof(SP16) * MAXSPEECHLEN * adin->io_rate);
+    adin->buffer48 = (SP16 *)mymalloc(sizeof(SP16) * adin->bpmax * adin->io_rate);
   }
   if (adin->adin_cut_on) {
     init_count_zc_e(&(adin->zc), adin->c_length);
@@ -331,8 +454,8 @@ adin_cut(int (*ad_process)(SP16 *, int, Recog *), int (*ad_check)(Recog *), Reco
    */
 
   if (a->need_init) {
-    a->bpmax = MAXSPEECHLEN;
     a->bp = 0;
+    adin_buffer_shrink(a);
     a->is_valid_data = FALSE;
     /* reset zero-cross status */
     if (a->adin_cut_on) {
@@ -381,6 +504,7 @@ adin_cut(int (*ad_process)(SP16 *, int, Recog *), int (*ad_check)(Recog *), Reco
 	receive end ack from tcpip client), it will return -1.
 	If error, returns -2. If the device requests segmentation, returns -3.
       */
+      adin_buffer_grow(a);
       if (a->down_sample) {
 	/* get 48kHz samples to temporal buffer */
 	cnt = (*(a->ad_read))(a->buffer48, (a->bpmax - a->bp) * a->io_rate);
@@ -967,8 +1091,8 @@ adin_event(int (*ad_process)(SP16 *, int, Recog *), int (*ad_check)(Recog *), Re
    */
 
   if (a->need_init) {
-    a->bpmax = MAXSPEECHLEN;
     a->bp = 0;
+    adin_buffer_shrink(a);
     a->is_valid_data = FALSE;
     /* reset zero-cross status */
     if (a->adin_cut_on) {
@@ -1017,6 +1141,7 @@ adin_event(int (*ad_process)(SP16 *, int, Recog *), int (*ad_check)(Recog *), Re
   receive end ack from tcpip client), it will return -1.
   If error, returns -2. If the device requests segmentation, returns -3.
       */
+      adin_buffer_grow(a);
       if (a->down_sample) {
   /* get 48kHz samples to temporal buffer */
   cnt = (*(a->ad_read))(a->buffer48, (a->bpmax - a->bp) * a->io_rate);
@@ -1579,7 +1704,9 @@ adin_store_buffer(SP16 *now, int len, Recog *recog)
   ADIn *a;
 
   a = recog->adin;
-  if (a->speechlen + len > MAXSPEECHLEN) {
+  if (a->speechlen + len > adin_speech_len(a)) {
+    /* past the freeze length, samples would not be processed: drop them */
+    if (adin_speech_len(a) < MAXSPEECHLEN) return(0);
     /* just mark as overflowed, and continue this thread */
     pthread_mutex_lock(&(a->mutex));
     a->adinthread_buffer_overflowed = TRUE;
@@ -1648,8 +1775,8 @@ adin_thread_create(Recog *recog)
 
   a = recog->adin;
 
-  /* init storing buffer */
-  a->speech = (SP16 *)mymalloc(sizeof(SP16) * MAXSPEECHLEN);
+  /* init storing buffer, up to the freeze length */
+  a->speech = (SP16 *)mymalloc(sizeof(SP16) * adin_speech_len(a));
   a->speechlen = 0;
 
   a->transfer_online = FALSE; /* tell adin-mic thread to wait at initial */
@@ -1767,6 +1894,7 @@ adin_thread_process(int (*ad_process)(SP16 *, int, Recog *), int (*ad_check)(Rec
   boolean overflowed_p;
   boolean transfer_online_local;
   boolean ended_p;
+  double wait_start;
   ADIn *a;
 
   a = recog->adin;
@@ -1876,7 +2004,10 @@ adin_thread_process(int (*ad_process)(SP16 *, int, Recog *), int (*ad_check)(Rec
 	pthread_mutex_unlock(&(a->mutex));
         break;
       }
+      wait_start = emscripten_get_now();
       usleep(50000);   /* wait = 0.05sec*/            
+      /* not decoding time for the gauges */
+      event_gauge_idle(emscripten_get_now() - wait_start);
     }
   }
 
@@ -0,0 +1,882 @@
+/**
+ * @file   event_lexicon.c
+ *
+ * <EN>
+ * @brief  Cache of lexicon trees built for grammars.
+ *
+ * Building the lexicon tree of a grammar (build_wchmm2() of wchmm.c)
+ * takes most of the time of loading or switching grammars with large
+ * dictionaries.  With "-lexcache dir", the tree of each grammar process
+ * is written to a file of its own once built, and read back instead of
+ * built when the same grammar is given again, in this run or a later
+ * one (worker.js keeps the files in IndexedDB).
+ *
+ * Files are named by a hash of what the tree is built from: the name
+ * and file sizes of the acoustic model, and once loaded, its
+ * transition matrices and the names and IDs of its states and of the
+ * physical HMMs each logical one maps to; the category pairs of the
+ * grammar; and the categories and phones of each word of the
+ * dictionary.  A model retrained to the same sizes thus gets other
+ * keys, while the Gaussians, which the tree does not hold, are left
+ * out.  They hold the tree nodes with their
+ * transitions, word ends and start nodes.  Pointers of the nodes to the
+ * acoustic model are written as state IDs, or as the word, phone and
+ * state they were made for: pseudo phone sets of word heads are looked
+ * up again by category, and the right context information of word tails
+ * is allocated again.  Successor lists are not made for category trees,
+ * only the successor list ID of each node is kept.  Trees that do not
+ * follow this layout are not cached.
+ *
+ * Only grammars with a category tree, triphones and no multi-path model
+ * are cached; other trees are built as usual.  The build scripts rename
+ * build_wchmm2() of wchmm.c to build_wchmm2_tree(), which is called
+ * here on a miss.
+ * </EN>
+ *
+ * @author Zachary POMERANTZ
+ * @date   Mon Aug 11 10:12:00 2014
+ *
+ * $Revision: 1.00 $
+ *
+ */
+/*
+ * Copyright (c) 2014 Zachary Pomerantz, @zzmp
+ * Using the MIT License
+ */
+
+#include <julius/julius.h>
+#include <julius/event.h>
+#include <sys/stat.h>
+
+#define LEXICON_MAGIC "JLEX"	///< First bytes of a file
+#define LEXICON_VERSION 1	///< Format of the files
+#define LEXICON_KEY_LEN 16	///< Hex digits of a key
+#define LEXICON_AM_MAX 8	///< Max number of acoustic models
+
+/// FNV-1a hash, in two halves of different seeds
+typedef struct {
+  unsigned int h[2];
+} LexiconHash;
+
+/// Identity of an acoustic model, taken while its files are there
+typedef struct {
+  PROCESS_AM *am;		///< Acoustic model instance
+  int hmmsize;			///< Size of the HMM definition file
+  int mapsize;			///< Size of the HMM list file
+  boolean hashed;		///< TRUE once @a model is computed
+  LexiconHash model;		///< Hash of the loaded model (model_hash())
+} LexiconAM;
+
+static Recog *e_lexicon_recog = NULL; ///< Engine instance, NULL to disable
+static char *e_lexicon_dir = NULL;   ///< Directory of the files
+static LexiconAM e_lexicon_am[LEXICON_AM_MAX];
+static int e_lexicon_am_num = 0;
+
+/// Tree node made for a state of a phone of a word
+typedef struct {
+  int w;			///< Word
+  int j;			///< Phone in the word
+  int s;			///< State in the phone, from 0
+} LexiconOwner;
+
+/**
+ * Add bytes to a hash.
+ *
+ * @param hash [i/o] hash
+ * @param p [in] bytes
+ * @param len [in] number of bytes
+ */
+static void
+hash_add(LexiconHash *hash, void *p, int len)
+{
+  unsigned char *c;
+  int i;
+
+  c = (unsigned char *)p;
+  for(i = 0; i < len; i++) {
+    hash->h[0] = (hash->h[0] ^ c[i]) * 16777619U;
+    hash->h[1] = (hash->h[1] ^ c[i]) * 16777619U;
+  }
+}
+
+static void
+hash_int(LexiconHash *hash, int v)
+{
+  hash_add(hash, &v, sizeof(int));
+}
+
+static void
+hash_str(LexiconHash *hash, char *s)
+{
+  if (s) hash_add(hash, s, strlen(s));
+  hash_add(hash, "", 1);
+}
+
+/**
+ * Size of a file, 0 if it cannot be read.
+ *
+ * @param filename [in] file name, may be NULL
+ *
+ * @return the size in bytes.
+ */
+static int
+file_size(char *filename)
+{
+  struct stat st;
+
+  if (filename == NULL || stat(filename, &st) != 0) return 0;
+  return((int)st.st_size);
+}
+
+/**
+ * Find the acoustic model a tree is built on.
+ *
+ * @param wchmm [in] lexicon tree
+ *
+ * @return the identity of the acoustic model, or NULL if not found.
+ */
+static LexiconAM *
+lexicon_am(WCHMM_INFO *wchmm)
+{
+  int i;
+
+  for(i = 0; i < e_lexicon_am_num; i++) {
+    if (e_lexicon_am[i].am->hmminfo == wchmm->hmminfo) return &(e_lexicon_am[i]);
+  }
+  return NULL;
+}
+
+static void
+hash_init(LexiconHash *hash)
+{
+  hash->h[0] = 2166136261U;
+  hash->h[1] = 2166136261U ^ 0x5bd1e995U;
+}
+
+/**
+ * Hash what a tree takes from a loaded acoustic model: the values of
+ * the transition matrices, which are copied into the tree, the names
+ * and IDs of the states, which the file refers to, and for each
+ * logical HMM the physical one, or the state sets of the pseudo one,
+ * it maps to.
+ *
+ * @param hmminfo [in] HMM definitions
+ * @param hash [out] hash
+ */
+static void
+model_hash(HTK_HMM_INFO *hmminfo, LexiconHash *hash)
+{
+  HTK_HMM_Trans *tr;
+  HTK_HMM_State *st;
+  HTK_HMM_Data *d;
+  HMM_Logical *lg;
+  CD_Set *cd;
+  int i, j;
+
+  hash_init(hash);
+  hash_int(hash, hmminfo->totalhmmnum);
+  hash_int(hash, hmminfo->totallogicalnum);
+  hash_int(hash, hmminfo->totalstatenum);
+  hash_int(hash, hmminfo->totalmixnum);
+
+  for(tr = hmminfo->trstart; tr; tr = tr->next) {
+    hash_int(hash, tr->id);
+    hash_int(hash, tr->statenum);
+    for(i = 0; i < tr->statenum; i++) hash_add(hash, tr->a[i], sizeof(LOGPROB) * tr->statenum);
+  }
+  for(st = hmminfo->ststart; st; st = st->next) {
+    hash_str(hash, st->name);
+    hash_int(hash, st->id);
+  }
+  for(lg = hmminfo->lgstart; lg; lg = lg->next) {
+    hash_str(hash, lg->name);
+    hash_int(hash, lg->is_pseudo);
+    if (lg->is_pseudo) {
+      cd = lg->body.pseudo;
+      hash_str(hash, cd->name);
+      hash_int(hash, cd->state_num);
+      for(i = 0; i < cd->state_num; i++) {
+	hash_int(hash, cd->stateset[i].num);
+	for(j = 0; j < cd->stateset[i].num; j++) hash_int(hash, cd->stateset[i].s[j]->id);
+      }
+    } else {
+      d = lg->body.defined;
+      hash_str(hash, d->name);
+      hash_int(hash, d->tr ? d->tr->id : -1);
+      hash_int(hash, d->state_num);
+      for(i = 0; i < d->state_num; i++) hash_int(hash, d->s[i] ? d->s[i]->id : -1);
+    }
+  }
+}
+
+/**
+ * Compute the key of the tree to be built: a hash of the acoustic
+ * model, the grammar and the dictionary.
+ *
+ * @param wchmm [in] lexicon tree, set up for build_wchmm2()
+ * @param am [in] identity of the acoustic model
+ * @param key [out] key as hex digits, LEXICON_KEY_LEN + 1 bytes
+ */
+static void
+lexicon_key(WCHMM_INFO *wchmm, LexiconAM *am, char *key)
+{
+  LexiconHash hash;
+  DFA_INFO *dfa;
+  WORD_INFO *winfo;
+  int i, j;
+
+  hash_init(&hash);
+
+  hash_int(&hash, LEXICON_VERSION);
+  hash_int(&hash, sizeof(LOGPROB));
+  hash_int(&hash, sizeof(WORD_ID));
+  hash_int(&hash, wchmm->ccd_flag);
+
+  /* acoustic model: name, file sizes and contents, hashed once */
+  if (! am->hashed) {
+    model_hash(wchmm->hmminfo, &(am->model));
+    am->hashed = TRUE;
+  }
+  hash_str(&hash, am->am->config->name);
+  hash_int(&hash, am->hmmsize);
+  hash_int(&hash, am->mapsize);
+  hash_add(&hash, am->model.h, sizeof(am->model.h));
+
+  /* grammar: category pairs */
+  dfa = wchmm->dfa;
+  hash_int(&hash, dfa->term_num);
+  for(i = 0; i < dfa->term_num; i++) {
+    hash_int(&hash, dfa_cp_begin(dfa, i));
+    hash_int(&hash, dfa_cp_end(dfa, i));
+    for(j = 0; j < dfa->term_num; j++) hash_int(&hash, dfa_cp(dfa, i, j));
+  }
+
+  /* dictionary: category and phones of each word */
+  winfo = wchmm->winfo;
+  hash_int(&hash, winfo->num);
+  for(i = 0; i < winfo->num; i++) {
+    hash_int(&hash, winfo->wton[i]);
+    hash_int(&hash, winfo->wlen[i]);
+    for(j = 0; j < winfo->wlen[i]; j++) hash_str(&hash, winfo->wseq[i][j]->name);
+  }
+
+  sprintf(key, "%08x%08x", hash.h[0], hash.h[1]);
+}
+
+/**
+ * Path of the file of a key.
+ *
+ * @param key [in] key
+ *
+ * @return the path, to be freed with free().
+ */
+static char *
+lexicon_path(char *key)
+{
+  char *path;
+
+  path = (char *)mymalloc(strlen(e_lexicon_dir) + LEXICON_KEY_LEN + 6);
+  sprintf(path, "%s/%s.lex", e_lexicon_dir, key);
+  return path;
+}
+
+/**
+ * Find the word, phone and state each node was made for.
+ *
+ * @param wchmm [in] lexicon tree
+ *
+ * @return the owner of each node, to be freed with free(); w is -1 for
+ * nodes of no phone.
+ */
+static LexiconOwner *
+lexicon_owners(WCHMM_INFO *wchmm)
+{
+  LexiconOwner *owner;
+  WORD_INFO *winfo;
+  int w, j, s, len, node;
+
+  owner = (LexiconOwner *)mymalloc(sizeof(LexiconOwner) * wchmm->n);
+  for(node = 0; node < wchmm->n; node++) owner[node].w = -1;
+  winfo = wchmm->winfo;
+  for(w = 0; w < winfo->num; w++) {
+    for(j = 0; j < winfo->wlen[w]; j++) {
+      len = hmm_logical_state_num(winfo->wseq[w][j]) - 2;
+      for(s = 0; s < len; s++) {
+	node = wchmm->offset[w][j] + s;
+	if (node < 0 || node >= wchmm->n || owner[node].w >= 0) continue;
+	owner[node].w = w;
+	owner[node].j = j;
+	owner[node].s = s;
+      }
+    }
+  }
+  return owner;
+}
+
+/**
+ * Pseudo phone set of a word head, as wchmm_add_word() looks it up.
+ *
+ * @param wchmm [in] lexicon tree
+ * @param w [in] word
+ *
+ * @return the set, or NULL if none.
+ */
+static CD_Set *
+lexicon_lcdset(WCHMM_INFO *wchmm, int w)
+{
+  CD_Set *lcd;
+  HMM_Logical *hmm;
+
+  hmm = wchmm->winfo->wseq[w][0];
+  lcd = lcdset_lookup_with_category(wchmm, hmm, wchmm->winfo->wton[w]);
+  if (lcd == NULL) lcd = lcdset_lookup_by_hmmname(wchmm->hmminfo, hmm->name);
+  return lcd;
+}
+
+static boolean
+put(FILE *fp, void *p, int size, int num)
+{
+  if (num <= 0) return TRUE;
+  return(fwrite(p, size, num, fp) == (size_t)num);
+}
+
+static boolean
+get(FILE *fp, void *p, int size, int num)
+{
+  if (num <= 0) return TRUE;
+  return(fread(p, size, num, fp) == (size_t)num);
+}
+
+/**
+ * Encode the acoustic output of a node.
+ *
+ * @param wchmm [in] lexicon tree
+ * @param node [in] node
+ * @param owner [in] owner of the node
+ * @param spec [out] 3 values, as described in lexicon_save()
+ *
+ * @return FALSE if the output does not follow the expected layout.
+ */
+static boolean
+spec_encode(WCHMM_INFO *wchmm, int node, LexiconOwner *owner, int *spec)
+{
+  WCHMM_STATE *st;
+  CD_Set *lcd;
+  int w;
+
+  st = &(wchmm->state[node]);
+  spec[0] = spec[1] = spec[2] = -1;
+  if (st->out.state == NULL) return TRUE;
+  w = owner->w;
+  switch(wchmm->outstyle[node]) {
+  case AS_STATE:
+    spec[0] = st->out.state->id;
+    return TRUE;
+  case AS_LSET:
+    if (w < 0 || owner->j != 0 || (lcd = lexicon_lcdset(wchmm, w)) == NULL) return FALSE;
+    if (st->out.lset != &(lcd->stateset[owner->s + 1])) return FALSE;
+    spec[0] = w;
+    spec[1] = owner->s;
+    return TRUE;
+  case AS_RSET:
+    if (w < 0 || st->out.rset->hmm != wchmm->winfo->wseq[w][owner->j]) return FALSE;
+    if (st->out.rset->state_loc != owner->s + 1) return FALSE;
+    spec[0] = w;
+    spec[1] = owner->j;
+    spec[2] = owner->s;
+    return TRUE;
+  case AS_LRSET:
+    if (w < 0 || st->out.lrset->hmm != wchmm->winfo->wseq[w][owner->j]) return FALSE;
+    if (st->out.lrset->state_loc != owner->s + 1) return FALSE;
+    spec[0] = w;
+    spec[1] = owner->s;
+    spec[2] = st->out.lrset->category;
+    return TRUE;
+  }
+  return FALSE;
+}
+
+/**
+ * @brief  Write a tree to a file.
+ *
+ * After the header ("JLEX", version, nodes, words, start nodes), in
+ * native byte order:
+ *  - for each node: its output style, 3 ints of acoustic output (state
+ *    ID; word and state of a word head; word, phone and state of a word
+ *    tail; word, state and category of a one-phone word), self and next
+ *    transitions, word ended, successor list ID, and number of other
+ *    transitions;
+ *  - the other transitions, as (node, log probability);
+ *  - for each word: end node, end transition, and node of each phone;
+ *  - the start nodes, and the word of each.
+ *
+ * @param wchmm [in] lexicon tree
+ * @param path [in] file name
+ *
+ * @return the size of the file, or -1 on failure.
+ */
+static int
+lexicon_save(WCHMM_INFO *wchmm, char *path)
+{
+  FILE *fp;
+  LexiconOwner *owner;
+  A_CELL2 *ac;
+  boolean ok;
+  int header[4], spec[3];
+  int node, w, i, num;
+  long size;
+
+  /* not made for category trees, and not written */
+  if (wchmm->sclist != NULL) {
+    jlog("WARNING: lexicon cache: tree has successor lists, not cached\n");
+    return -1;
+  }
+  owner = lexicon_owners(wchmm);
+  if ((fp = fopen(path, "wb")) == NULL) {
+    free(owner);
+    return -1;
+  }
+  header[0] = LEXICON_VERSION;
+  header[1] = wchmm->n;
+  header[2] = wchmm->winfo->num;
+  header[3] = wchmm->startnum;
+  ok = put(fp, LEXICON_MAGIC, 1, 4) && put(fp, header, sizeof(int), 4);
+
+  for(node = 0; ok && node < wchmm->n; node++) {
+    if (spec_encode(wchmm, node, &(owner[node]), spec) == FALSE) {
+      jlog("WARNING: lexicon cache: node %d is not in the expected layout, not cached\n", node);
+      ok = FALSE;
+      break;
+    }
+    num = 0;
+    for(ac = wchmm->ac[node]; ac; ac = ac->next) num += ac->n;
+    ok = put(fp, &(wchmm->outstyle[node]), sizeof(unsigned char), 1)
+      && put(fp, spec, sizeof(int), 3)
+      && put(fp, &(wchmm->self_a[node]), sizeof(LOGPROB), 1)
+      && put(fp, &(wchmm->next_a[node]), sizeof(LOGPROB), 1)
+      && put(fp, &(wchmm->stend[node]), sizeof(WORD_ID), 1)
+      && put(fp, &(wchmm->state[node].scid), sizeof(int), 1)
+      && put(fp, &num, sizeof(int), 1);
+  }
+  for(node = 0; ok && node < wchmm->n; node++) {
+    for(ac = wchmm->ac[node]; ok && ac; ac = ac->next) {
+      for(i = 0; ok && i < ac->n; i++) {
+	ok = put(fp, &(ac->arc[i]), sizeof(int), 1) && put(fp, &(ac->a[i]), sizeof(LOGPROB), 1);
+      }
+    }
+  }
+  for(w = 0; ok && w < wchmm->winfo->num; w++) {
+    ok = put(fp, &(wchmm->wordend[w]), sizeof(int), 1)
+      && put(fp, &(wchmm->wordend_a[w]), sizeof(LOGPROB), 1)
+      && put(fp, wchmm->offset[w], sizeof(int), wchmm->winfo->wlen[w]);
+  }
+  if (ok) {
+    ok = put(fp, wchmm->startnode, sizeof(int), wchmm->startnum)
+      && put(fp, wchmm->start2wid, sizeof(WORD_ID), wchmm->startnum);
+  }
+  size = ftell(fp);
+  if (fclose(fp) != 0) ok = FALSE;
+  free(owner);
+  if (!ok) {
+    remove(path);
+    return -1;
+  }
+  return((int)size);
+}
+
+/**
+ * Append a transition to a node, as add_ac() of wchmm.c does.
+ *
+ * @param wchmm [i/o] lexicon tree
+ * @param node [in] node
+ * @param arc [in] destination node
+ * @param a [in] log probability
+ */
+static void
+lexicon_add_ac(WCHMM_INFO *wchmm, int node, int arc, LOGPROB a)
+{
+  A_CELL2 *ac;
+
+  ac = wchmm->ac[node];
+  if (ac == NULL || ac->n >= A_CELL2_ALLOC_STEP) {
+    ac = (A_CELL2 *)mybmalloc2(sizeof(A_CELL2), &(wchmm->malloc_root));
+    ac->n = 0;
+    ac->next = wchmm->ac[node];
+    wchmm->ac[node] = ac;
+  }
+  ac->arc[ac->n] = arc;
+  ac->a[ac->n] = a;
+  ac->n++;
+}
+
+/**
+ * Check the acoustic output of a node read from a file.
+ *
+ * @param wchmm [in] lexicon tree, with pseudo phone sets registered
+ * @param style [in] output style
+ * @param spec [in] 3 values written by spec_encode()
+ *
+ * @return FALSE if the values do not match the model or dictionary.
+ */
+static boolean
+spec_check(WCHMM_INFO *wchmm, unsigned char style, int *spec)
+{
+  WORD_INFO *winfo;
+  CD_Set *lcd;
+  int w;
+
+  winfo = wchmm->winfo;
+  w = spec[0];
+  if (w < 0) return TRUE;
+  switch(style) {
+  case AS_STATE:
+    return(w < wchmm->hmminfo->totalstatenum);
+  case AS_LSET:
+    if (w >= winfo->num || (lcd = lexicon_lcdset(wchmm, w)) == NULL) return FALSE;
+    return(spec[1] >= 0 && spec[1] + 1 < lcd->state_num);
+  case AS_RSET:
+    return(w < winfo->num && spec[1] >= 0 && spec[1] < winfo->wlen[w] && spec[2] >= 0);
+  case AS_LRSET:
+    return(w < winfo->num && spec[1] >= 0);
+  }
+  return FALSE;
+}
+
+/**
+ * Set the acoustic output of a node, checked by spec_check().
+ *
+ * @param wchmm [i/o] lexicon tree
+ * @param node [in] node
+ * @param spec [in] 3 values written by spec_encode()
+ * @param states [in] HMM states by ID
+ */
+static void
+spec_decode(WCHMM_INFO *wchmm, int node, int *spec, HTK_HMM_State **states)
+{
+  WCHMM_STATE *st;
+  WORD_INFO *winfo;
+  RC_INFO *rset;
+  LRC_INFO *lrset;
+  int w;
+
+  st = &(wchmm->state[node]);
+  winfo = wchmm->winfo;
+  st->out.state = NULL;
+  w = spec[0];
+  if (w < 0) return;
+  switch(wchmm->outstyle[node]) {
+  case AS_STATE:
+    st->out.state = states[w];
+    break;
+  case AS_LSET:
+    st->out.lset = &(lexicon_lcdset(wchmm, w)->stateset[spec[1] + 1]);
+    break;
+  case AS_RSET:
+    rset = (RC_INFO *)mybmalloc2(sizeof(RC_INFO), &(wchmm->malloc_root));
+    memset(rset, 0, sizeof(RC_INFO));
+    rset->hmm = winfo->wseq[w][spec[1]];
+    rset->state_loc = spec[2] + 1;
+    rset->lastwid_cache = WORD_INVALID;
+    st->out.rset = rset;
+    break;
+  case AS_LRSET:
+    lrset = (LRC_INFO *)mybmalloc2(sizeof(LRC_INFO), &(wchmm->malloc_root));
+    memset(lrset, 0, sizeof(LRC_INFO));
+    lrset->hmm = winfo->wseq[w][0];
+    lrset->state_loc = spec[1] + 1;
+    lrset->category = spec[2];
+    lrset->lastwid_cache = WORD_INVALID;
+    st->out.lrset = lrset;
+    break;
+  }
+}
+
+/// Contents of a file, as read before they are given to the tree
+typedef struct {
+  int n;			///< Number of nodes
+  int startnum;			///< Number of start nodes
+  unsigned char *outstyle;	///< Output style of each node
+  int *spec;			///< 3 values of acoustic output of each node
+  LOGPROB *self_a;		///< Self transition of each node
+  LOGPROB *next_a;		///< Next transition of each node
+  WORD_ID *stend;		///< Word ended on each node
+  int *scid;			///< Successor list ID of each node
+  int *acnum;			///< Number of other transitions of each node
+  int *arc;			///< Destination of other transitions
+  LOGPROB *a;			///< Log probability of other transitions
+  int *wordend;			///< End node of each word
+  LOGPROB *wordend_a;		///< End transition of each word
+  int *offset;			///< Node of each phone of each word
+  int *startnode;		///< Start nodes
+  WORD_ID *start2wid;		///< Word of each start node
+} LexiconFile;
+
+static void
+file_free(LexiconFile *f)
+{
+  if (f->outstyle) free(f->outstyle);
+  if (f->spec) free(f->spec);
+  if (f->self_a) free(f->self_a);
+  if (f->next_a) free(f->next_a);
+  if (f->stend) free(f->stend);
+  if (f->scid) free(f->scid);
+  if (f->acnum) free(f->acnum);
+  if (f->arc) free(f->arc);
+  if (f->a) free(f->a);
+  if (f->wordend) free(f->wordend);
+  if (f->wordend_a) free(f->wordend_a);
+  if (f->offset) free(f->offset);
+  if (f->startnode) free(f->startnode);
+  if (f->start2wid) free(f->start2wid);
+}
+
+/**
+ * Read a file written by lexicon_save() for the words of a tree.
+ *
+ * @param f [out] contents, to be freed with file_free()
+ * @param fp [in] file
+ * @param winfo [in] dictionary the tree is built for
+ *
+ * @return TRUE on success, FALSE if the file is not complete or does
+ * not match the dictionary.
+ */
+static boolean
+file_read(LexiconFile *f, FILE *fp, WORD_INFO *winfo)
+{
+  char magic[4];
+  int header[4];
+  int node, w, i, total, phones;
+  boolean ok;
+
+  memset(f, 0, sizeof(LexiconFile));
+  if (!get(fp, magic, 1, 4) || strncmp(magic, LEXICON_MAGIC, 4) != 0
+      || !get(fp, header, sizeof(int), 4) || header[0] != LEXICON_VERSION
+      || header[1] <= 0 || header[2] != winfo->num || header[3] <= 0) {
+    return FALSE;
+  }
+  f->n = header[1];
+  f->startnum = header[3];
+  f->outstyle = (unsigned char *)mymalloc(sizeof(unsigned char) * f->n);
+  f->spec = (int *)mymalloc(sizeof(int) * f->n * 3);
+  f->self_a = (LOGPROB *)mymalloc(sizeof(LOGPROB) * f->n);
+  f->next_a = (LOGPROB *)mymalloc(sizeof(LOGPROB) * f->n);
+  f->stend = (WORD_ID *)mymalloc(sizeof(WORD_ID) * f->n);
+  f->scid = (int *)mymalloc(sizeof(int) * f->n);
+  f->acnum = (int *)mymalloc(sizeof(int) * f->n);
+
+  ok = TRUE;
+  total = 0;
+  for(node = 0; ok && node < f->n; node++) {
+    ok = get(fp, &(f->outstyle[node]), sizeof(unsigned char), 1)
+      && get(fp, &(f->spec[node * 3]), sizeof(int), 3)
+      && get(fp, &(f->self_a[node]), sizeof(LOGPROB), 1)
+      && get(fp, &(f->next_a[node]), sizeof(LOGPROB), 1)
+      && get(fp, &(f->stend[node]), sizeof(WORD_ID), 1)
+      && get(fp, &(f->scid[node]), sizeof(int), 1)
+      && get(fp, &(f->acnum[node]), sizeof(int), 1)
+      && f->acnum[node] >= 0;
+    if (ok) total += f->acnum[node];
+  }
+  if (!ok) return FALSE;
+
+  f->arc = (int *)mymalloc(sizeof(int) * (total + 1));
+  f->a = (LOGPROB *)mymalloc(sizeof(LOGPROB) * (total + 1));
+  for(i = 0; ok && i < total; i++) {
+    ok = get(fp, &(f->arc[i]), sizeof(int), 1) && get(fp, &(f->a[i]), sizeof(LOGPROB), 1)
+      && f->arc[i] >= 0 && f->arc[i] < f->n;
+  }
+  if (!ok) return FALSE;
+
+  phones = 0;
+  for(w = 0; w < winfo->num; w++) phones += winfo->wlen[w];
+  f->wordend = (int *)mymalloc(sizeof(int) * winfo->num);
+  f->wordend_a = (LOGPROB *)mymalloc(sizeof(LOGPROB) * winfo->num);
+  f->offset = (int *)mymalloc(sizeof(int) * (phones + 1));
+  for(w = 0, i = 0; ok && w < winfo->num; i += winfo->wlen[w], w++) {
+    ok = get(fp, &(f->wordend[w]), sizeof(int), 1)
+      && get(fp, &(f->wordend_a[w]), sizeof(LOGPROB), 1)
+      && get(fp, &(f->offset[i]), sizeof(int), winfo->wlen[w]);
+  }
+  if (!ok) return FALSE;
+
+  f->startnode = (int *)mymalloc(sizeof(int) * f->startnum);
+  f->start2wid = (WORD_ID *)mymalloc(sizeof(WORD_ID) * f->startnum);
+  ok = get(fp, f->startnode, sizeof(int), f->startnum)
+    && get(fp, f->start2wid, sizeof(WORD_ID), f->startnum);
+  /* nothing may follow */
+  if (ok && fgetc(fp) != EOF) ok = FALSE;
+
+  return ok;
+}
+
+/**
+ * @brief  Read a tree from a file, into a tree set up for build_wchmm2().
+ *
+ * The file is read and checked against the dictionary and the model
+ * first; the tree is only given its contents when all match, and is
+ * left as it was otherwise.
+ *
+ * @param wchmm [i/o] lexicon tree
+ * @param path [in] file name
+ *
+ * @return the size of the file, 0 if there is none, or -1 if it does not
+ * match.
+ */
+static int
+lexicon_load(WCHMM_INFO *wchmm, char *path)
+{
+  FILE *fp;
+  LexiconFile f;
+  WORD_INFO *winfo;
+  HTK_HMM_State **states;
+  HTK_HMM_State *s;
+  int node, w, i, j;
+  long size;
+  boolean ok, registered;
+
+  if ((fp = fopen(path, "rb")) == NULL) return 0;
+  winfo = wchmm->winfo;
+  ok = file_read(&f, fp, winfo);
+  size = ftell(fp);
+  fclose(fp);
+
+  /* pseudo phone sets of word heads, by category, as build_wchmm2() */
+  registered = FALSE;
+  if (ok) ok = registered = lcdset_register_with_category_all(wchmm);
+  for(node = 0; ok && node < f.n; node++) {
+    ok = spec_check(wchmm, f.outstyle[node], &(f.spec[node * 3]));
+  }
+  if (!ok) {
+    if (registered) lcdset_remove_with_category_all(wchmm);
+    file_free(&f);
+    return -1;
+  }
+
+  /* as wchmm_init() allocates them, to the size of the tree */
+  wchmm->maxwcn = wchmm->n = f.n;
+  wchmm->state = (WCHMM_STATE *)mymalloc(sizeof(WCHMM_STATE) * f.n);
+  wchmm->ac = (A_CELL2 **)mymalloc(sizeof(A_CELL2 *) * f.n);
+  wchmm->outstyle = f.outstyle;
+  wchmm->self_a = f.self_a;
+  wchmm->next_a = f.next_a;
+  wchmm->stend = f.stend;
+  wchmm->wordend = f.wordend;
+  wchmm->wordend_a = f.wordend_a;
+  wchmm->maxstartnum = wchmm->startnum = f.startnum;
+  wchmm->startnode = f.startnode;
+  wchmm->start2wid = f.start2wid;
+  f.outstyle = NULL;
+  f.self_a = f.next_a = f.wordend_a = NULL;
+  f.stend = f.start2wid = NULL;
+  f.wordend = f.startnode = NULL;
+
+  states = (HTK_HMM_State **)mymalloc(sizeof(HTK_HMM_State *) * wchmm->hmminfo->totalstatenum);
+  for(s = wchmm->hmminfo->ststart; s; s = s->next) states[s->id] = s;
+  for(node = 0, i = 0; node < f.n; i += f.acnum[node], node++) {
+    spec_decode(wchmm, node, &(f.spec[node * 3]), states);
+    wchmm->state[node].scid = f.scid[node];
+    /* written from the head of each list, so prepend in reverse */
+    wchmm->ac[node] = NULL;
+    for(j = f.acnum[node] - 1; j >= 0; j--) lexicon_add_ac(wchmm, node, f.arc[i + j], f.a[i + j]);
+  }
+  free(states);
+
+  wchmm->offset = (int **)mymalloc(sizeof(int *) * winfo->num);
+  for(w = 0, i = 0; w < winfo->num; i += winfo->wlen[w], w++) {
+    wchmm->offset[w] = (int *)mymalloc(sizeof(int) * winfo->wlen[w]);
+    memcpy(wchmm->offset[w], &(f.offset[i]), sizeof(int) * winfo->wlen[w]);
+  }
+  file_free(&f);
+
+  return((int)size);
+}
+
+/**
+ * <EN>
+ * @brief  Build the lexicon tree of a grammar, or read it from the cache.
+ *
+ * This replaces build_wchmm2() of wchmm.c, which the build scripts
+ * rename to build_wchmm2_tree().  Whether the tree was read or built,
+ * the time it took and the size of its file are logged and given to
+ * "lexiconBuilt()" of the handling script, which stores new files.
+ * </EN>
+ *
+ * @param wchmm [i/o] lexicon tree, set up with models
+ * @param lmconf [in] language model configuration
+ *
+ * @return TRUE on success, FALSE on failure.
+ *
+ * @callgraph
+ * @callergraph
+ */
+boolean
+build_wchmm2(WCHMM_INFO *wchmm, JCONF_LM *lmconf)
+{
+  LexiconAM *am;
+  char key[LEXICON_KEY_LEN + 1];
+  char *path;
+  double start, msec;
+  int size;
+  boolean hit;
+
+  if (e_lexicon_recog == NULL || wchmm->lmtype != LM_DFA || !wchmm->category_tree
+      || !wchmm->ccd_flag || wchmm->hmminfo->multipath || (am = lexicon_am(wchmm)) == NULL) {
+    return(build_wchmm2_tree(wchmm, lmconf));
+  }
+
+  start = emscripten_get_now();
+  lexicon_key(wchmm, am, key);
+  path = lexicon_path(key);
+  size = lexicon_load(wchmm, path);
+  hit = (size > 0) ? TRUE : FALSE;
+  if (!hit) {
+    if (size < 0) jlog("WARNING: lexicon cache: %s does not match, building the tree\n", path);
+    if (build_wchmm2_tree(wchmm, lmconf) == FALSE) {
+      free(path);
+      return FALSE;
+    }
+    size = lexicon_save(wchmm, path);
+  }
+  msec = emscripten_get_now() - start;
+  jlog("STAT: lexicon cache: %s, %d words, %d nodes %s in %.1f ms\n", key, wchmm->winfo->num, wchmm->n, hit ? "read" : "built", msec);
+  EVENT_ASM_ARGS({
+    if (typeof lexiconBuilt === 'function') lexiconBuilt(UTF8ToString($0), !!$1, $2, $3, $4);
+  }, key, hit, msec, wchmm->winfo->num, size);
+  free(path);
+
+  return TRUE;
+}
+
+/**
+ * <EN>
+ * @brief  Cache lexicon trees of grammars in a directory.
+ *
+ * To be called once the models are loaded, before the lexicon trees
+ * are built (j_final_fusion()): the acoustic models are identified by
+ * the sizes of their files, which the handling script may remove later.
+ * </EN>
+ *
+ * @param recog [in] engine instance
+ * @param dir [in] directory of the files, which must exist
+ *
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+void
+event_lexicon_setup(Recog *recog, char *dir)
+{
+  PROCESS_AM *am;
+
+  e_lexicon_am_num = 0;
+  for(am = recog->amlist; am && e_lexicon_am_num < LEXICON_AM_MAX; am = am->next) {
+    e_lexicon_am[e_lexicon_am_num].am = am;
+    e_lexicon_am[e_lexicon_am_num].hmmsize = file_size(am->config->hmmfilename);
+    e_lexicon_am[e_lexicon_am_num].mapsize = file_size(am->config->mapfilename);
+    e_lexicon_am[e_lexicon_am_num].hashed = FALSE;
+    e_lexicon_am_num++;
+  }
+  e_lexicon_recog = recog;
+  e_lexicon_dir = strcpy((char *)mymalloc(strlen(dir) + 1), dir);
+  jlog("STAT: lexicon cache: trees of grammars are kept in %s\n", dir);
+}
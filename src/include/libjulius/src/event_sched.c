@@ -0,0 +1,313 @@
+/**
+ * @file   event_sched.c
+ *
+ * <EN>
+ * @brief  Scheduler of the event-driven (Web Audio) port.
+ *
+ * The event-driven loop never blocks: each step of recognition returns
+ * to the caller, and the next one is posted as a task, along with the
+ * opening of the next input stream once one ends.  Tasks run in the
+ * order they are posted, one per turn of the event loop of the host.
+ *
+ * On Emscripten, a turn is a `setTimeout` of the handling script, or a
+ * message on a `MessageChannel` for tasks posted with
+ * event_sched_post_fast(), which browsers do not throttle as nested
+ * timeouts.  Natively, event_sched_run() is a plain run loop that runs
+ * tasks until none is left, so that the same event-driven code builds
+ * as a native binary (`NATIVE=1`, see emscript.sh) for profilers and
+ * sanitizers; calls to the handling script are then dropped (see
+ * julius/event.h).
+ *
+ * For capture and replay of sessions, the handling script can be told
+ * of each task run (event_sched_observe()), and can run the tasks
+ * itself, in the recorded order against its input, instead of the
+ * event loop (event_sched_manual()).
+ * </EN>
+ *
+ * @author Zachary POMERANTZ
+ * @date   Mon Jul 28 10:14:00 2014
+ *
+ * $Revision: 1.00 $
+ *
+ */
+/*
+ * Copyright (c) 2014 Zachary Pomerantz, @zzmp
+ * Using the MIT License
+ */
+
+#include <julius/julius.h>
+#include <julius/event.h>
+
+#ifndef __EMSCRIPTEN__
+#include <time.h>
+#endif
+
+#define SCHED_TASK_MAX 16	///< Max number of pending tasks
+
+/// A posted task
+typedef struct {
+  EventTask task;		///< Function to run
+  void *arg;			///< Its argument
+} SchedTask;
+
+static SchedTask queue[SCHED_TASK_MAX]; ///< Pending tasks, as a ring
+static int queue_head = 0;	///< Index of the next task to run
+static int queue_len = 0;	///< Number of pending tasks
+
+static EventTask next_input = NULL; ///< Opens the next input stream
+static EventTask end_input = NULL; ///< Ends recognition
+
+static boolean manual = FALSE;	///< Tasks are run by the handling script
+static boolean observed = FALSE; ///< The handling script is told of each task
+
+/**
+ * Append a task to the queue.
+ *
+ * @param task [in] function to run
+ * @param arg [in] its argument
+ *
+ * @return TRUE on success, FALSE if the queue is full.
+ */
+static boolean
+enqueue(EventTask task, void *arg)
+{
+  SchedTask *t;
+
+  if (queue_len >= SCHED_TASK_MAX) {
+    jlog("ERROR: event_sched: more than %d tasks pending, task dropped\n", SCHED_TASK_MAX);
+    return FALSE;
+  }
+  t = &(queue[(queue_head + queue_len) % SCHED_TASK_MAX]);
+  t->task = task;
+  t->arg = arg;
+  queue_len++;
+  return TRUE;
+}
+
+/**
+ * <EN>
+ * Run the oldest pending task.  On Emscripten, called by the handling
+ * script once per posted task.
+ * </EN>
+ *
+ * @callgraph
+ * @callergraph
+ */
+void
+event_sched_dispatch()
+{
+  SchedTask t;
+  double start = 0.0;
+
+  if (queue_len == 0) return;
+  t = queue[queue_head];
+  queue_head = (queue_head + 1) % SCHED_TASK_MAX;
+  queue_len--;
+  if (observed) start = event_sched_now();
+  (*(t.task))(t.arg);
+  if (observed) {
+    EM_ASM_ARGS({
+      schedTask($0, $1);
+    }, start, event_sched_now() - start);
+  }
+}
+
+/**
+ * <EN>
+ * Post a task to run on a later turn of the event loop, after events
+ * already waiting (e.g. new samples) are handled.
+ * </EN>
+ *
+ * @param task [in] function to run
+ * @param arg [in] its argument
+ *
+ * @callgraph
+ * @callergraph
+ */
+void
+event_sched_post(EventTask task, void *arg)
+{
+  if (enqueue(task, arg) == FALSE || manual) return;
+#ifdef __EMSCRIPTEN__
+  EM_ASM( setTimeout(function() { Module.ccall('event_sched_dispatch'); }, 0); );
+#endif
+}
+
+/**
+ * <EN>
+ * Post a task to run as soon as possible on a later turn, when nothing
+ * is waited for (e.g. samples read from memory), without the throttling
+ * of nested timeouts.  Natively the same as event_sched_post().
+ * </EN>
+ *
+ * @param task [in] function to run
+ * @param arg [in] its argument
+ *
+ * @callgraph
+ * @callergraph
+ */
+void
+event_sched_post_fast(EventTask task, void *arg)
+{
+  if (enqueue(task, arg) == FALSE || manual) return;
+#ifdef __EMSCRIPTEN__
+  EM_ASM({
+    if (!Module.schedChannel) {
+      Module.schedChannel = new MessageChannel();
+      Module.schedChannel.port1.onmessage = function() {
+        Module.ccall('event_sched_dispatch');
+      };
+    }
+    Module.schedChannel.port2.postMessage(null);
+  });
+#endif
+}
+
+/**
+ * <EN>
+ * Let the handling script run the tasks: posted tasks are only queued,
+ * and run by calls to event_sched_dispatch(), e.g. to replay a session
+ * with the order of tasks and input of its recording.
+ * </EN>
+ *
+ * @param flag [in] TRUE to run tasks from the handling script, FALSE
+ * to run them from the event loop again
+ *
+ * @callgraph
+ * @callergraph
+ */
+void
+event_sched_manual(boolean flag)
+{
+  manual = flag;
+}
+
+/**
+ * <EN>
+ * Tell the handling script of each task run, with its start time and
+ * duration in milliseconds (`schedTask(start, duration)`), e.g. to
+ * record a session.
+ * </EN>
+ *
+ * @param flag [in] TRUE to tell of tasks, FALSE to stop
+ *
+ * @callgraph
+ * @callergraph
+ */
+void
+event_sched_observe(boolean flag)
+{
+  observed = flag;
+}
+
+/**
+ * <EN>
+ * Number of tasks waiting to run.
+ * </EN>
+ *
+ * @return number of pending tasks.
+ *
+ * @callgraph
+ * @callergraph
+ */
+int
+event_sched_pending()
+{
+  return(queue_len);
+}
+
+/**
+ * <EN>
+ * Set the functions of the application that open the next input stream
+ * and end recognition, which the library calls through
+ * event_sched_next_input() and event_sched_end_input().
+ * </EN>
+ *
+ * @param next [in] opens the next input stream
+ * @param end [in] ends recognition
+ *
+ * @callgraph
+ * @callergraph
+ */
+void
+event_sched_set_input(EventTask next, EventTask end)
+{
+  next_input = next;
+  end_input = end;
+}
+
+/**
+ * <EN>
+ * Post the opening of the next input stream.
+ * </EN>
+ *
+ * @callgraph
+ * @callergraph
+ */
+void
+event_sched_next_input()
+{
+  if (next_input != NULL) event_sched_post(next_input, NULL);
+}
+
+/**
+ * <EN>
+ * End recognition now.
+ * </EN>
+ *
+ * @callgraph
+ * @callergraph
+ */
+void
+event_sched_end_input()
+{
+  if (end_input != NULL) (*end_input)(NULL);
+}
+
+/**
+ * <EN>
+ * Run tasks until none is left.  Natively, this is the event loop;
+ * on Emscripten, tasks run from the loop of the host, and this returns
+ * immediately.
+ * </EN>
+ *
+ * @return number of tasks run.
+ *
+ * @callgraph
+ * @callergraph
+ */
+int
+event_sched_run()
+{
+  int n = 0;
+
+#ifndef __EMSCRIPTEN__
+  while(queue_len > 0) {
+    event_sched_dispatch();
+    n++;
+  }
+#endif
+  return(n);
+}
+
+/**
+ * <EN>
+ * Current time of a monotonic clock.
+ * </EN>
+ *
+ * @return time in milliseconds.
+ */
+double
+event_sched_now()
+{
+#ifdef __EMSCRIPTEN__
+  return(emscripten_get_now());
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0);
+#endif
+}
+
+/* end of file */
@@ -0,0 +1,508 @@
+/**
+ * @file   event_trace.c
+ *
+ * <EN>
+ * @brief  Stage timers for the event-driven (Web Audio) port.
+ *
+ * When compiled with EVENT_TRACE (see julius/event.h), the hot path of
+ * the engine is timed per stage: audio conversion in worker.js, A/D-in
+ * triggering, MFCC computation with the 1st pass, output probability
+ * computation and the 2nd pass.  Spans are kept in a timeline ring, and
+ * their sums per tick (one call of event_recognize_stream()) and per
+ * utterance are counted in log2 histograms.  The whole is exported as
+ * Chrome trace-event JSON by event_trace_json().
+ *
+ * Without EVENT_TRACE, only no-op stubs of the exported functions are
+ * compiled, so the handling script need not know how it was built.
+ * </EN>
+ *
+ * @author Zachary POMERANTZ
+ * @date   Mon Jul 21 11:42:00 2014
+ *
+ * $Revision: 1.00 $
+ *
+ */
+/*
+ * Copyright (c) 2014 Zachary Pomerantz, @zzmp
+ * Using the MIT License
+ */
+
+#include <julius/julius.h>
+#include <julius/event.h>
+#include <stdarg.h>
+
+#ifdef EVENT_TRACE
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+/* worker.js adds spans from the main thread of the page while the
+   engine runs on its own, so the timeline and sums are locked */
+static pthread_mutex_t trace_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define TRACE_LOCK() pthread_mutex_lock(&trace_mutex)
+#define TRACE_UNLOCK() pthread_mutex_unlock(&trace_mutex)
+#else
+#define TRACE_LOCK()
+#define TRACE_UNLOCK()
+#endif
+
+#define TRACE_EVENT_MAX 8192	///< Length of the timeline ring
+#define TRACE_UTT_MAX 64	///< Number of utterances kept in the timeline
+#define TRACE_HIST_BINS 24	///< Histogram bins, log2 of microseconds
+#define TRACE_MIN_DUR 0.05	///< Shorter spans (ms) are only counted
+#define TRACE_AM_MAX 8		///< Max number of acoustic models to hook
+
+/// A span on the timeline
+typedef struct {
+  int stage;			///< Stage ID (TRACE_*)
+  double ts;			///< Start time (ms)
+  double dur;			///< Duration (ms)
+} TraceEvent;
+
+/// An utterance on the timeline, with the time spent in each stage
+typedef struct {
+  double ts;			///< Start time (ms)
+  double dur;			///< Duration (ms)
+  double sum[TRACE_STAGE_NUM];	///< Time spent in each stage (ms)
+} TraceUtterance;
+
+static char *stage_name[TRACE_STAGE_NUM] = {
+  "convert", "tick", "adin", "pass1", "outprob", "pass2"
+};
+
+static TraceEvent events[TRACE_EVENT_MAX];
+static int event_head = 0, event_num = 0;
+static TraceUtterance utts[TRACE_UTT_MAX];
+static int utt_head = 0, utt_num = 0;
+
+static double begin_time[TRACE_STAGE_NUM];
+static double tick_sum[TRACE_STAGE_NUM];
+static double utt_sum[TRACE_STAGE_NUM];
+static double utt_begin = -1.0;
+static double total[TRACE_STAGE_NUM];
+static int count[TRACE_STAGE_NUM];
+static int hist_tick[TRACE_STAGE_NUM][TRACE_HIST_BINS];
+static int hist_utt[TRACE_STAGE_NUM][TRACE_HIST_BINS];
+static int input_num = 0;
+
+/* output probability computation is far too frequent to be timed by
+   spans: the hook only sums up, and the sum is put on the timeline at
+   the end of the enclosing pass.  Sums are kept per model, as models
+   may score on search threads of their own (see recogmain.c), which
+   are joined before a pass ends */
+static double outprob_sum[TRACE_AM_MAX];
+static double outprob_mark[TRACE_STAGE_NUM];
+static HMMWork *outprob_wrk[TRACE_AM_MAX];
+static LOGPROB (*outprob_orig[TRACE_AM_MAX])(HMMWork *);
+static int outprob_num = 0;
+
+static char *json = NULL;
+static int json_len = 0, json_pos = 0;
+
+/**
+ * Histogram bin of a duration: bin 0 holds less than 1us, and bin k
+ * holds [2^(k-1), 2^k) us.  The last bin holds everything beyond.
+ *
+ * @param ms [in] duration in msec.
+ *
+ * @return the bin.
+ */
+static int
+hist_bin(double ms)
+{
+  double us;
+  int k;
+
+  us = ms * 1000.0;
+  for(k = 0; us >= 1.0 && k < TRACE_HIST_BINS - 1; k++) us /= 2.0;
+  return(k);
+}
+
+/**
+ * Time spent computing output probabilities so far, of all models.
+ *
+ * @return the time in msec.
+ */
+static double
+outprob_total()
+{
+  double sum;
+  int i;
+
+  sum = 0.0;
+  for(i = 0; i < outprob_num; i++) sum += outprob_sum[i];
+  return(sum);
+}
+
+/**
+ * Add a span of a stage, with the lock held (see event_trace_add()).
+ *
+ * @param stage [in] stage ID (TRACE_*)
+ * @param ts [in] start time in msec.
+ * @param dur [in] duration in msec.
+ */
+static void
+trace_add(int stage, double ts, double dur)
+{
+  TraceEvent *e;
+
+  tick_sum[stage] += dur;
+  utt_sum[stage] += dur;
+  total[stage] += dur;
+  count[stage]++;
+
+  if (dur < TRACE_MIN_DUR) return;
+
+  e = &(events[event_head]);
+  e->stage = stage;
+  e->ts = ts;
+  e->dur = dur;
+  event_head = (event_head + 1) % TRACE_EVENT_MAX;
+  if (event_num < TRACE_EVENT_MAX) event_num++;
+}
+
+/**
+ * <EN>
+ * Add a span of a stage: count it in the current tick and utterance,
+ * and put it on the timeline if long enough.  This is also called
+ * from worker.js for the audio conversion.
+ * </EN>
+ *
+ * @param stage [in] stage ID (TRACE_*)
+ * @param ts [in] start time in msec., as performance.now()
+ * @param dur [in] duration in msec.
+ *
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+void
+event_trace_add(int stage, double ts, double dur)
+{
+  if (stage < 0 || stage >= TRACE_STAGE_NUM) return;
+
+  TRACE_LOCK();
+  trace_add(stage, ts, dur);
+  TRACE_UNLOCK();
+}
+
+/**
+ * <EN>
+ * Start timing of a stage.  Stages do not recurse.
+ * </EN>
+ *
+ * @param stage [in] stage ID (TRACE_*)
+ *
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+void
+event_trace_begin(int stage)
+{
+  begin_time[stage] = emscripten_get_now();
+  outprob_mark[stage] = outprob_total();
+  if (stage == TRACE_PASS1 && utt_begin < 0.0) {
+    /* speech has been triggered: a new utterance begins */
+    int s;
+    TRACE_LOCK();
+    utt_begin = begin_time[stage];
+    for(s = 0; s < TRACE_STAGE_NUM; s++) utt_sum[s] = 0.0;
+    TRACE_UNLOCK();
+  }
+}
+
+/**
+ * <EN>
+ * End timing of a stage.  At the end of a tick, the sums of the stages
+ * within the tick are counted in the tick histograms.
+ * </EN>
+ *
+ * @param stage [in] stage ID (TRACE_*)
+ *
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+void
+event_trace_end(int stage)
+{
+  double now, sum;
+  int s;
+
+  now = emscripten_get_now();
+  sum = outprob_total();
+  TRACE_LOCK();
+  if ((stage == TRACE_PASS1 || stage == TRACE_PASS2)
+      && sum > outprob_mark[stage]) {
+    trace_add(TRACE_OUTPROB, begin_time[stage], sum - outprob_mark[stage]);
+  }
+  trace_add(stage, begin_time[stage], now - begin_time[stage]);
+
+  if (stage == TRACE_TICK) {
+    for(s = 0; s < TRACE_STAGE_NUM; s++) {
+      if (tick_sum[s] > 0.0) {
+	hist_tick[s][hist_bin(tick_sum[s])]++;
+	tick_sum[s] = 0.0;
+      }
+    }
+  }
+  TRACE_UNLOCK();
+}
+
+/**
+ * <EN>
+ * Close the current utterance at the end of an input, and count the
+ * time spent in each stage in the utterance histograms.  Inputs in
+ * which speech was never triggered are not counted.
+ * </EN>
+ *
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+void
+event_trace_input_end()
+{
+  TraceUtterance *u;
+  int s;
+
+  TRACE_LOCK();
+  input_num++;
+  if (utt_begin < 0.0) {
+    TRACE_UNLOCK();
+    return;
+  }
+
+  u = &(utts[utt_head]);
+  u->ts = utt_begin;
+  u->dur = emscripten_get_now() - utt_begin;
+  for(s = 0; s < TRACE_STAGE_NUM; s++) {
+    u->sum[s] = utt_sum[s];
+    if (utt_sum[s] > 0.0) hist_utt[s][hist_bin(utt_sum[s])]++;
+  }
+  utt_head = (utt_head + 1) % TRACE_UTT_MAX;
+  if (utt_num < TRACE_UTT_MAX) utt_num++;
+
+  utt_begin = -1.0;
+  TRACE_UNLOCK();
+}
+
+/**
+ * <EN>
+ * RealTimePipeLine() with timing of the 1st pass.  MFCC computation is
+ * done within it per frame, so it is counted with the 1st pass.
+ * </EN>
+ *
+ * @param Speech [in] input speech segment
+ * @param nowlen [in] length of @a Speech
+ * @param recog [i/o] engine instance
+ *
+ * @return as RealTimePipeLine().
+ *
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+int
+event_trace_pipeline(SP16 *Speech, int nowlen, Recog *recog)
+{
+  int ret;
+
+  event_trace_begin(TRACE_PASS1);
+  ret = RealTimePipeLine(Speech, nowlen, recog);
+  event_trace_end(TRACE_PASS1);
+
+  return(ret);
+}
+
+/**
+ * Hook of the state output probability function to sum up its time.
+ *
+ * @param wrk [i/o] HMM computation work area
+ *
+ * @return the output probability.
+ */
+static LOGPROB
+outprob_hook(HMMWork *wrk)
+{
+  double t;
+  LOGPROB p;
+  int i;
+
+  for(i = 0; i < outprob_num; i++) if (outprob_wrk[i] == wrk) break;
+  t = emscripten_get_now();
+  p = (*(outprob_orig[i]))(wrk);
+  outprob_sum[i] += emscripten_get_now() - t;
+
+  return(p);
+}
+
+/**
+ * <EN>
+ * Hook the output probability computation of all acoustic models.
+ * Should be called after j_final_fusion().
+ * </EN>
+ *
+ * @param recog [i/o] engine instance
+ *
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+void
+event_trace_setup(Recog *recog)
+{
+  PROCESS_AM *am;
+
+  for(am=recog->amlist;am;am=am->next) {
+    if (outprob_num >= TRACE_AM_MAX) {
+      jlog("WARNING: event_trace: too many AMs, outprob of \"%s\" not timed\n", am->config->name);
+      continue;
+    }
+    if (am->hmmwrk.calc_outprob_state == outprob_hook) continue;
+    outprob_wrk[outprob_num] = &(am->hmmwrk);
+    outprob_orig[outprob_num] = am->hmmwrk.calc_outprob_state;
+    outprob_sum[outprob_num] = 0.0;
+    outprob_num++;
+    am->hmmwrk.calc_outprob_state = outprob_hook;
+  }
+}
+
+/**
+ * Append formatted text to the JSON buffer, expanding it as needed.
+ *
+ * @param fmt [in] format string, as printf()
+ */
+static void
+json_printf(char *fmt, ...)
+{
+  va_list ap;
+  int n;
+
+  for(;;) {
+    va_start(ap, fmt);
+    n = vsnprintf(json + json_pos, json_len - json_pos, fmt, ap);
+    va_end(ap);
+    if (n < json_len - json_pos) break;
+    json_len *= 2;
+    json = (char *)myrealloc(json, json_len);
+  }
+  json_pos += n;
+}
+
+/**
+ * Output a histogram as a JSON array.
+ *
+ * @param hist [in] histogram bins
+ */
+static void
+json_hist(int *hist)
+{
+  int k;
+
+  json_printf("[");
+  for(k = 0; k < TRACE_HIST_BINS; k++) {
+    json_printf(k ? ",%d" : "%d", hist[k]);
+  }
+  json_printf("]");
+}
+
+/**
+ * Clear all timings and histograms.
+ *
+ */
+static void
+trace_reset()
+{
+  int s, k;
+
+  event_head = event_num = 0;
+  utt_head = utt_num = 0;
+  input_num = 0;
+  for(s = 0; s < TRACE_STAGE_NUM; s++) {
+    tick_sum[s] = utt_sum[s] = total[s] = 0.0;
+    count[s] = 0;
+    for(k = 0; k < TRACE_HIST_BINS; k++) hist_tick[s][k] = hist_utt[s][k] = 0;
+  }
+}
+
+/**
+ * <EN>
+ * @brief  Export the trace as Chrome trace-event JSON.
+ *
+ * The timeline is in "traceEvents" as complete events, one per span
+ * and one per utterance with the time spent in each stage as args.
+ * Totals and histograms per stage are in "otherData".  The result can
+ * be loaded to chrome://tracing as is.
+ * </EN>
+ *
+ * @param reset [in] TRUE to clear the trace after export
+ *
+ * @return the JSON string, valid until the next call, or NULL when not
+ * compiled with EVENT_TRACE.
+ *
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+char *
+event_trace_json(int reset)
+{
+  TraceEvent *e;
+  TraceUtterance *u;
+  int i, s;
+
+  TRACE_LOCK();
+  if (json == NULL) {
+    json_len = 65536;
+    json = (char *)mymalloc(json_len);
+  }
+  json_pos = 0;
+
+  json_printf("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  json_printf("{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"recognizer\"}}");
+  for(i = 0; i < event_num; i++) {
+    e = &(events[(event_head - event_num + i + TRACE_EVENT_MAX) % TRACE_EVENT_MAX]);
+    json_printf(",{\"name\":\"%s\",\"cat\":\"stage\",\"ph\":\"X\",\"ts\":%.1f,\"dur\":%.1f,\"pid\":1,\"tid\":1}", stage_name[e->stage], e->ts * 1000.0, e->dur * 1000.0);
+  }
+  for(i = 0; i < utt_num; i++) {
+    u = &(utts[(utt_head - utt_num + i + TRACE_UTT_MAX) % TRACE_UTT_MAX]);
+    json_printf(",{\"name\":\"utterance\",\"cat\":\"input\",\"ph\":\"X\",\"ts\":%.1f,\"dur\":%.1f,\"pid\":1,\"tid\":2,\"args\":{", u->ts * 1000.0, u->dur * 1000.0);
+    for(s = 0; s < TRACE_STAGE_NUM; s++) {
+      json_printf(s ? ",\"%s\":%.3f" : "\"%s\":%.3f", stage_name[s], u->sum[s]);
+    }
+    json_printf("}}");
+  }
+  json_printf("],\"otherData\":{\"inputs\":%d,\"histogramUnit\":\"log2 us\",\"stages\":{", input_num);
+  for(s = 0; s < TRACE_STAGE_NUM; s++) {
+    json_printf(s ? ",\"%s\":{" : "\"%s\":{", stage_name[s]);
+    json_printf("\"count\":%d,\"total\":%.3f,\"tick\":", count[s], total[s]);
+    json_hist(hist_tick[s]);
+    json_printf(",\"utterance\":");
+    json_hist(hist_utt[s]);
+    json_printf("}");
+  }
+  json_printf("}}}");
+
+  if (reset) trace_reset();
+  TRACE_UNLOCK();
+
+  return(json);
+}
+
+#else  /* ~EVENT_TRACE */
+
+void
+event_trace_add(int stage, double ts, double dur)
+{
+}
+
+char *
+event_trace_json(int reset)
+{
+  return(NULL);
+}
+
+#endif /* EVENT_TRACE */
+
+/* end of file */
@@ -79,8 +79,9 @@ adin_select(ADIn *a, int source, int dev)
       a->ad_pause	     = adin_mic_pause;
       a->ad_terminate	     = adin_mic_terminate;
       a->ad_resume	     = adin_mic_resume;
-    /* web audio integration */
-#ifdef USE_WEBAUDIO
+    /* web audio integration: the A/D-in thread runs only in the
+       pthread build (see `PTHREAD=1` in emscript.sh) */
+#if defined(USE_WEBAUDIO) && !defined(HAVE_PTHREAD)
       a->enable_thread = FALSE;
 #endif
       break;
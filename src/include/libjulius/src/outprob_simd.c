@@ -0,0 +1,1368 @@
+/**
+ * @file   outprob_simd.c
+ *
+ * <EN>
+ * @brief  Vectorized state output probability for diagonal Gaussians.
+ *
+ * When Gaussian pruning is off ("-gprune none", the default for
+ * non-tied models such as the voxforge one), calc_outprob_state of the
+ * acoustic models is replaced by a kernel working on 4 floats at a
+ * time.  At setup, the Gaussians of each state are packed in 16-byte
+ * aligned blocks holding the means, the precomputed -0.5/var and the
+ * constant term -0.5*gconst + log(weight):
+ *
+ *  - states with 4 or more mixtures are laid out as structure of
+ *    arrays, 4 mixtures per group, so that one vector operation per
+ *    dimension advances 4 mixtures;
+ *  - states with fewer mixtures keep one mixture per row, padded to
+ *    4 dimensions, and vectors run over the dimensions.
+ *
+ * The mixtures are then summed by log-add, as calc_mix() does.  States
+ * not handled (multiple streams, tied mixtures) use the original
+ * function.  Vectors are written with GCC/Clang vector extensions, so
+ * they become WebAssembly SIMD with `-msimd128` (see the SIMD variant
+ * in `emscript.sh`).
+ *
+ * With "-obatch K", a state whose output probability is requested at
+ * frame t is also scored against the next K-1 frames when they are
+ * already computed, so that its parameters are read once for K frames.
+ * The results are kept until the search asks for them.  Future frames
+ * are available with "-norealtime"; the real-time 1st pass searches K-1
+ * frames behind the input for them (see event_set_pass1_lookahead() in
+ * recogmain.c).  The 2nd pass goes back in time, from the end of the
+ * input, so there the batch is the K-1 frames before t and t.
+ *
+ * With "-hquant file", the Gaussians are taken from a file written by
+ * `bin/hquant.js` instead of the (skeleton) hmmdefs.  Half float values
+ * are expanded into the blocks above.  8-bit values stay 8-bit: means
+ * and inverse variances are stored as int8/uint8 steps of a
+ * per-dimension scale, each frame is converted once to mean steps, and
+ * the kernel widens 4 values at a time to compute
+ * (a[d] + b[d] * ivar_q) * (x_q - mean_q)^2.
+ *
+ * With "-gselect file", a codebook written by `bin/gselect.js` selects
+ * the Gaussians to compute: each frame is matched to its nearest
+ * codeword, and only the Gaussians it lists are computed; the others
+ * take the value they have at the floor distance of the codebook.
+ * </EN>
+ *
+ * @author Zachary POMERANTZ
+ * @date   Wed Jul 23 15:04:00 2014
+ *
+ * $Revision: 1.00 $
+ *
+ */
+/*
+ * Copyright (c) 2014 Zachary Pomerantz, @zzmp
+ * Using the MIT License
+ */
+
+#include <julius/julius.h>
+#include <julius/event.h>
+
+#define SIMD_AM_MAX 8		///< Max number of acoustic models to install to
+#define SIMD_BATCH_MAX 8	///< Max number of frames of a batch
+#define SIMD_CHECK_REPORT 100000 ///< Computations between check reports
+#define SIMD_BENCH_FRAMES 200	///< Frames of the benchmark
+#define SIMD_LANE_ZERO -1.0e30	///< Constant term of padded lanes
+
+/// 4 floats, as one 128-bit vector
+typedef float v4sf __attribute__ ((vector_size (16)));
+/// 4 signed bytes, widened to v4sf
+typedef signed char v4qi __attribute__ ((vector_size (4)));
+/// 4 unsigned bytes, widened to v4sf
+typedef unsigned char v4qu __attribute__ ((vector_size (4)));
+
+/// Packed Gaussians of a state
+typedef struct {
+  short mix;			///< Number of mixtures, 0 if not packed
+  short soa;			///< TRUE if 4 mixtures per group
+  short quant;			///< TRUE if 8-bit
+  float *block;			///< Packed means, -0.5/var and constants
+} SimdState;
+
+/// Quantized Gaussians read from a file of bin/hquant.js
+typedef struct {
+  int format;			///< 8 or 16 (bits per value)
+  int veclen;			///< Vector length
+  int statenum;			///< Number of states
+  float *mean_offset;		///< Per-dimension mean offset (8-bit)
+  float *mean_scale;		///< Per-dimension mean step (8-bit)
+  float *ivar_offset;		///< Per-dimension inverse variance offset (8-bit)
+  float *ivar_scale;		///< Per-dimension inverse variance step (8-bit)
+  char **name;			///< State names, sorted
+  int *mix;			///< Number of mixtures of each state
+  unsigned char **data;		///< Mixtures of each state
+  unsigned char *buf;		///< File contents
+} QuantModel;
+
+/// Gaussian selection codebook read from a file of bin/gselect.js
+typedef struct {
+  int veclen;			///< Vector length
+  int vecpad;			///< Vector length padded to 4
+  int cbnum;			///< Number of codewords
+  int statenum;			///< Number of states
+  float threshold;		///< Mahalanobis distance of listed Gaussians
+  float floor;			///< Mahalanobis distance of the others
+  float *offset;		///< Per-dimension offset of normalization
+  float *scale;			///< Per-dimension scale of normalization
+  float *codeword;		///< Normalized codewords, padded to 4
+  char **name;			///< State names, sorted
+  int *first;			///< First Gaussian of each state
+  int *mix;			///< Number of mixtures of each state
+  int gnum;			///< Number of Gaussians
+  int *listnum;			///< Number of Gaussians listed by each codeword
+  int **list;			///< Gaussians listed by each codeword
+} GselModel;
+
+/// Packed acoustic model
+typedef struct {
+  HMMWork *wrk;			///< Work area the kernel is installed to
+  MFCCCalc *mfcc;		///< Parameters the model is computed on
+  LOGPROB (*orig)(HMMWork *);	///< Original calc_outprob_state
+  SimdState *state;		///< Packed states, indexed by state id
+  int statenum;			///< Number of states
+  int veclen;			///< Vector length
+  int vecpad;			///< Vector length padded to 4
+  float *x;			///< Frames of the batch, padded
+  VECT *x_vec;			///< First frame the padded ones were copied from
+  int x_time;			///< Frame time of the first padded one
+  int x_num;			///< Number of padded frames
+  LOGPROB *ahead;		///< Batched results, [state id][frame]
+  int *ahead_time;		///< Frame time of the first batched result
+  short *ahead_num;		///< Number of batched results
+  float *qa;			///< Per-dimension a[d] of 8-bit states, padded
+  float *qb;			///< Per-dimension b[d] of 8-bit states, padded
+  float *scores;		///< Mixture scores of a state, per frame
+  int scorelen;			///< Allocated length of scores
+  int *gs_first;		///< First codebook Gaussian of each state, or -1
+  int *gs_stamp;		///< Frame stamp of the last selection of each Gaussian
+  int gs_cur;			///< Stamp of the current frame
+  float *gs_z;			///< Normalized current frame, padded to 4
+  VECT *gs_vec;			///< Frame the selection was made for
+  int gs_time;			///< Frame time the selection was made for
+  int gs_computed;		///< Gaussians computed (statistics)
+  int gs_total;			///< Gaussians requested (statistics)
+  int check_num;		///< States checked against the original
+  LOGPROB check_maxdiff;	///< Largest difference found by the check
+  float *pool;			///< All the blocks
+} SimdAM;
+
+static SimdAM simd_am[SIMD_AM_MAX];
+static int simd_am_num = 0;
+
+static QuantModel *quant = NULL;   ///< Quantized Gaussians, if given
+static GselModel *gsel = NULL;	    ///< Gaussian selection, if given
+static int simd_batch = 1;	    ///< Frames per batch
+static boolean simd_backward = FALSE; ///< Batch the frames before, on the 2nd pass
+static boolean simd_check = FALSE;  ///< Compare with the original
+
+static v4sf
+load4(const float *p)
+{
+  v4sf v;
+  memcpy(&v, p, sizeof(v4sf));
+  return v;
+}
+
+static v4sf
+splat4(float x)
+{
+  v4sf v = {x, x, x, x};
+  return v;
+}
+
+/**
+ * Number of floats of the block of a state.
+ *
+ * @param mix [in] number of mixtures
+ * @param veclen [in] vector length
+ * @param vecpad [in] vector length padded to 4
+ *
+ * @return the number of floats, a multiple of 4.
+ */
+static int
+block_size(int mix, int veclen, int vecpad)
+{
+  if (quant && quant->format == 8) {
+    /* per mixture: int8 mean[vecpad], uint8 ivar[vecpad], const */
+    return(mix * (vecpad / 2 + 1));
+  }
+  if (mix >= 4) {
+    /* per group: mean[veclen][4], h[veclen][4], const[4] */
+    return(((mix + 3) / 4) * (veclen * 8 + 4));
+  }
+  /* per mixture: mean[vecpad], h[vecpad], const padded to 4 */
+  return(mix * (vecpad * 2 + 4));
+}
+
+/**
+ * Pack the Gaussians of a state into its block.
+ *
+ * @param mix [in] number of mixtures
+ * @param mean [in] mean vector of each mixture, NULL if none
+ * @param ivar [in] inverse variance vector of each mixture
+ * @param gconst [in] Gaussian constant of each mixture
+ * @param weight [in] log weight of each mixture
+ * @param block [out] block to fill
+ * @param veclen [in] vector length
+ * @param vecpad [in] vector length padded to 4
+ */
+static void
+block_pack(int mix, VECT **mean, VECT **ivar, LOGPROB *gconst, PROB *weight, float *block, int veclen, int vecpad)
+{
+  float *p;
+  int m, i, g, l;
+
+  if (mix >= 4) {
+    for(g = 0; g < (mix + 3) / 4; g++) {
+      p = block + g * (veclen * 8 + 4);
+      for(l = 0; l < 4; l++) {
+	m = g * 4 + l;
+	if (m >= mix || mean[m] == NULL) {
+	  for(i = 0; i < veclen; i++) p[i * 4 + l] = p[(veclen + i) * 4 + l] = 0.0;
+	  p[veclen * 8 + l] = SIMD_LANE_ZERO;
+	  continue;
+	}
+	for(i = 0; i < veclen; i++) {
+	  p[i * 4 + l] = mean[m][i];
+	  p[(veclen + i) * 4 + l] = -0.5 * ivar[m][i];
+	}
+	p[veclen * 8 + l] = -0.5 * gconst[m] + weight[m];
+      }
+    }
+  } else {
+    for(m = 0; m < mix; m++) {
+      p = block + m * (vecpad * 2 + 4);
+      for(i = 0; i < vecpad; i++) {
+	p[i] = (mean[m] && i < veclen) ? mean[m][i] : 0.0;
+	p[vecpad + i] = (mean[m] && i < veclen) ? -0.5 * ivar[m][i] : 0.0;
+      }
+      p[vecpad * 2] = mean[m] ? -0.5 * gconst[m] + weight[m] : SIMD_LANE_ZERO;
+      p[vecpad * 2 + 1] = p[vecpad * 2 + 2] = p[vecpad * 2 + 3] = 0.0;
+    }
+  }
+}
+
+/**
+ * Pack the Gaussians of a state from its mixture pdf.
+ *
+ * @param pdf [in] mixture pdf of the state
+ * @param block [out] block to fill
+ * @param veclen [in] vector length
+ * @param vecpad [in] vector length padded to 4
+ */
+static void
+block_pack_pdf(HTK_HMM_PDF *pdf, float *block, int veclen, int vecpad)
+{
+  VECT **mean, **ivar;
+  LOGPROB *gconst;
+  int m;
+
+  mean = (VECT **)mymalloc(sizeof(VECT *) * pdf->mix_num * 2);
+  ivar = mean + pdf->mix_num;
+  gconst = (LOGPROB *)mymalloc(sizeof(LOGPROB) * pdf->mix_num);
+  for(m = 0; m < pdf->mix_num; m++) {
+    mean[m] = pdf->b[m] ? pdf->b[m]->mean : NULL;
+    ivar[m] = pdf->b[m] ? pdf->b[m]->var->vec : NULL;
+    gconst[m] = pdf->b[m] ? pdf->b[m]->gconst : 0.0;
+  }
+  block_pack(pdf->mix_num, mean, ivar, gconst, pdf->bweight, block, veclen, vecpad);
+  free(gconst);
+  free(mean);
+}
+
+/**
+ * Convert an IEEE half float to float.
+ *
+ * @param h [in] half float bits
+ *
+ * @return the value.
+ */
+static float
+half_to_float(unsigned short h)
+{
+  float sign = (h & 0x8000) ? -1.0 : 1.0;
+  int exp = (h >> 10) & 0x1f;
+  int mant = h & 0x3ff;
+
+  if (exp == 0) return(sign * ldexpf(mant / 1024.0, -14));
+  if (exp == 31) return(sign * HUGE_VALF);
+  return(sign * ldexpf(1.0 + mant / 1024.0, exp - 15));
+}
+
+/**
+ * Pack the Gaussians of a state from the quantized file.  Half floats
+ * are expanded into a float block; 8-bit values are copied with the
+ * constant terms appended to each mixture.
+ *
+ * @param q [in] quantized Gaussians
+ * @param n [in] state index in the file
+ * @param block [out] block to fill
+ * @param veclen [in] vector length
+ * @param vecpad [in] vector length padded to 4
+ */
+static void
+block_pack_quant(QuantModel *q, int n, float *block, int veclen, int vecpad)
+{
+  VECT **mean, **ivar;
+  LOGPROB *gconst;
+  PROB *weight;
+  unsigned char *p, *b;
+  unsigned short h;
+  float w, g;
+  int m, i, mix;
+
+  mix = q->mix[n];
+  p = q->data[n];
+  if (q->format == 8) {
+    b = (unsigned char *)block;
+    for(m = 0; m < mix; m++) {
+      memcpy(&w, p, sizeof(float));
+      memcpy(&g, p + 4, sizeof(float));
+      memset(b, 0, vecpad * 2);
+      memcpy(b, p + 8, veclen);
+      memcpy(b + vecpad, p + 8 + veclen, veclen);
+      w = -0.5 * g + w;
+      memcpy(b + vecpad * 2, &w, sizeof(float));
+      b += vecpad * 2 + 4;
+      p += 8 + veclen * 2;
+    }
+    return;
+  }
+
+  mean = (VECT **)mymalloc(sizeof(VECT *) * mix * 2);
+  ivar = mean + mix;
+  gconst = (LOGPROB *)mymalloc(sizeof(LOGPROB) * mix);
+  weight = (PROB *)mymalloc(sizeof(PROB) * mix);
+  for(m = 0; m < mix; m++) {
+    mean[m] = (VECT *)mymalloc(sizeof(VECT) * veclen * 2);
+    ivar[m] = mean[m] + veclen;
+    memcpy(&w, p, sizeof(float));
+    memcpy(&g, p + 4, sizeof(float));
+    weight[m] = w;
+    gconst[m] = g;
+    for(i = 0; i < veclen * 2; i++) {
+      memcpy(&h, p + 8 + i * 2, sizeof(unsigned short));
+      mean[m][i] = half_to_float(h);
+    }
+    p += 8 + veclen * 4;
+  }
+  block_pack(mix, mean, ivar, gconst, weight, block, veclen, vecpad);
+  for(m = 0; m < mix; m++) free(mean[m]);
+  free(weight);
+  free(gconst);
+  free(mean);
+}
+
+/**
+ * Find the packed model installed to a work area.
+ *
+ * @param wrk [in] HMM computation work area
+ *
+ * @return the packed model.
+ */
+static SimdAM *
+simd_am_get(HMMWork *wrk)
+{
+  int i;
+
+  for(i = 0; i < simd_am_num - 1; i++) if (simd_am[i].wrk == wrk) break;
+  return(&(simd_am[i]));
+}
+
+/**
+ * Find a state in the sorted state names of a file.
+ *
+ * @param names [in] sorted state names
+ * @param num [in] number of names
+ * @param name [in] state name
+ *
+ * @return the state index in the file, or -1 if not found.
+ */
+static int
+name_find(char **names, int num, char *name)
+{
+  int lo, hi, mid, c;
+
+  if (name == NULL) return -1;
+  lo = 0;
+  hi = num - 1;
+  while(lo <= hi) {
+    mid = (lo + hi) / 2;
+    c = strcmp(name, names[mid]);
+    if (c == 0) return mid;
+    if (c < 0) hi = mid - 1;
+    else lo = mid + 1;
+  }
+  return -1;
+}
+
+/**
+ * Copy a frame into the padded batch.  For 8-bit states, the frame is
+ * converted to steps of the quantized means.
+ *
+ * @param a [i/o] packed model
+ * @param k [in] position in the batch
+ * @param vec [in] frame
+ */
+static void
+frame_set(SimdAM *a, int k, VECT *vec)
+{
+  float *x;
+  int i;
+
+  x = &(a->x[k * a->vecpad]);
+  if (a->qa) {
+    for(i = 0; i < a->veclen; i++) {
+      x[i] = (vec[i] - quant->mean_offset[i]) / quant->mean_scale[i];
+    }
+  } else {
+    memcpy(x, vec, sizeof(float) * a->veclen);
+  }
+}
+
+/**
+ * Copy frames into the padded batch, around the current frame of the
+ * work area: the current one and the following ones when they are
+ * already computed in the parameters the model is computed on, or on
+ * the 2nd pass, the preceding ones and the current one.  The batch
+ * starts at frame a->x_time.
+ *
+ * @param a [i/o] packed model
+ * @param wrk [in] HMM computation work area
+ * @param max [in] max number of frames
+ *
+ * @return the number of frames in the batch.
+ */
+static int
+frames_load(SimdAM *a, HMMWork *wrk, int max)
+{
+  HTK_Param *param;
+  VECT *vec;
+  int t, first, n, k;
+
+  vec = wrk->OP_vec_stream[0];
+  t = wrk->OP_time;
+  param = a->mfcc ? a->mfcc->param : NULL;
+  first = t;
+  n = 1;
+  if (max > 1 && param != NULL && t >= 0 && t < param->samplenum && param->parvec[t] == vec) {
+    if (simd_backward) {
+      n = (t + 1 < max) ? t + 1 : max;
+      first = t - n + 1;
+      vec = param->parvec[first];
+    } else {
+      n = param->samplenum - t;
+      if (n > max) n = max;
+    }
+  }
+
+  if (a->x_vec == vec && a->x_time == first && a->x_num >= n) return(n);
+
+  frame_set(a, 0, vec);
+  for(k = 1; k < n; k++) frame_set(a, k, param->parvec[first + k]);
+  a->x_vec = vec;
+  a->x_time = first;
+  a->x_num = n;
+  return(n);
+}
+
+/**
+ * Select the Gaussians to compute on a frame: find the nearest codeword
+ * of the normalized frame and stamp the Gaussians it lists.
+ *
+ * @param a [i/o] packed model
+ * @param vec [in] frame
+ */
+static void
+gs_update(SimdAM *a, VECT *vec)
+{
+  GselModel *g;
+  v4sf acc, diff;
+  float d, best_d;
+  int c, i, best, *list;
+
+  g = gsel;
+  for(i = 0; i < g->veclen; i++) a->gs_z[i] = (vec[i] - g->offset[i]) / g->scale[i];
+  best = 0;
+  best_d = 0.0;
+  for(c = 0; c < g->cbnum; c++) {
+    acc = splat4(0.0);
+    for(i = 0; i < g->vecpad; i += 4) {
+      diff = load4(a->gs_z + i) - load4(g->codeword + c * g->vecpad + i);
+      acc += diff * diff;
+    }
+    d = acc[0] + acc[1] + acc[2] + acc[3];
+    if (c == 0 || d < best_d) {
+      best_d = d;
+      best = c;
+    }
+  }
+  /* a new stamp unselects the Gaussians of the previous frame */
+  a->gs_cur++;
+  list = g->list[best];
+  for(i = 0; i < g->listnum[best]; i++) a->gs_stamp[list[i]] = a->gs_cur;
+}
+
+/**
+ * Log-add the mixture scores of a state.
+ *
+ * @param scores [in] scores in natural log, weights included
+ * @param n [in] number of scores
+ *
+ * @return the output probability in log10, as calc_mix().
+ */
+static LOGPROB
+mix_logadd(float *scores, int n)
+{
+  float max, sum, x;
+  int m;
+
+  max = scores[0];
+  for(m = 1; m < n; m++) if (max < scores[m]) max = scores[m];
+  if (max <= LOG_ZERO) return(LOG_ZERO);
+  sum = 0.0;
+  for(m = 0; m < n; m++) {
+    x = scores[m] - max;
+    if (x > -50.0) sum += expf(x);
+  }
+  return((max + logf(sum)) * INV_LOG_TEN);
+}
+
+/**
+ * Vectorized output probabilities of a state on the padded frames.
+ * Each parameter vector of the state is loaded once and applied to
+ * all the frames.
+ *
+ * With Gaussian selection, only the mixtures stamped by gs_update() are
+ * computed (a group of 4 when any of them is); the others take their
+ * constant term at the floor distance.
+ *
+ * @param a [i/o] packed model
+ * @param s [in] packed state
+ * @param nk [in] number of frames
+ * @param sel [in] first codebook Gaussian of the state, or -1 to compute
+ * all the mixtures
+ * @param out [out] output probabilities in log10, one per frame
+ */
+static void
+simd_calc(SimdAM *a, SimdState *s, int nk, int sel, LOGPROB *out)
+{
+  v4sf acc[SIMD_BATCH_MAX], diff, mean, h;
+  v4qi qm;
+  v4qu qh;
+  float *p, c, floor;
+  unsigned char *q;
+  int m, i, g, k, n, veclen, vecpad, *stamp;
+  float *scores;
+
+  veclen = a->veclen;
+  vecpad = a->vecpad;
+
+  /* scores of all the mixtures, per frame */
+  n = s->soa ? ((s->mix + 3) / 4) * 4 : s->mix;
+  /* kept per model, as processes of different ones may run on threads */
+  if (a->scorelen < n * nk) {
+    a->scorelen = n * nk;
+    a->scores = (float *)myrealloc(a->scores, sizeof(float) * a->scorelen);
+  }
+  scores = a->scores;
+
+  stamp = NULL;
+  floor = 0.0;
+  if (sel >= 0) {
+    stamp = a->gs_stamp + sel;
+    floor = -0.5 * gsel->floor;
+    a->gs_total += s->mix;
+  }
+
+  if (s->quant) {
+    for(m = 0; m < n; m++) {
+      q = (unsigned char *)s->block + m * (vecpad * 2 + 4);
+      memcpy(&c, q + vecpad * 2, sizeof(float));
+      if (stamp && stamp[m] != a->gs_cur) {
+	for(k = 0; k < nk; k++) scores[k * n + m] = c + floor;
+	continue;
+      }
+      if (stamp) a->gs_computed++;
+      for(k = 0; k < nk; k++) acc[k] = splat4(0.0);
+      for(i = 0; i < vecpad; i += 4) {
+	/* widen 4 steps of mean and inverse variance */
+	memcpy(&qm, q + i, sizeof(v4qi));
+	memcpy(&qh, q + vecpad + i, sizeof(v4qu));
+	mean = __builtin_convertvector(qm, v4sf);
+	h = load4(a->qa + i) + load4(a->qb + i) * __builtin_convertvector(qh, v4sf);
+	for(k = 0; k < nk; k++) {
+	  diff = load4(a->x + k * vecpad + i) - mean;
+	  acc[k] += diff * diff * h;
+	}
+      }
+      for(k = 0; k < nk; k++) {
+	scores[k * n + m] = acc[k][0] + acc[k][1] + acc[k][2] + acc[k][3] + c;
+      }
+    }
+  } else if (s->soa) {
+    for(g = 0; g < n / 4; g++) {
+      p = s->block + g * (veclen * 8 + 4);
+      if (stamp) {
+	for(i = 0, m = g * 4; m < g * 4 + 4 && m < s->mix; m++) {
+	  if (stamp[m] == a->gs_cur) i++;
+	}
+	if (i == 0) {
+	  for(k = 0; k < nk; k++) {
+	    for(m = 0; m < 4; m++) scores[k * n + g * 4 + m] = p[veclen * 8 + m] + floor;
+	  }
+	  continue;
+	}
+	a->gs_computed += i;
+      }
+      for(k = 0; k < nk; k++) acc[k] = load4(p + veclen * 8);
+      for(i = 0; i < veclen; i++) {
+	mean = load4(p + i * 4);
+	h = load4(p + (veclen + i) * 4);
+	for(k = 0; k < nk; k++) {
+	  diff = splat4(a->x[k * vecpad + i]) - mean;
+	  acc[k] += diff * diff * h;
+	}
+      }
+      for(k = 0; k < nk; k++) memcpy(&(scores[k * n + g * 4]), &(acc[k]), sizeof(v4sf));
+    }
+  } else {
+    for(m = 0; m < n; m++) {
+      p = s->block + m * (vecpad * 2 + 4);
+      if (stamp && stamp[m] != a->gs_cur) {
+	for(k = 0; k < nk; k++) scores[k * n + m] = p[vecpad * 2] + floor;
+	continue;
+      }
+      if (stamp) a->gs_computed++;
+      for(k = 0; k < nk; k++) acc[k] = splat4(0.0);
+      for(i = 0; i < vecpad; i += 4) {
+	mean = load4(p + i);
+	h = load4(p + vecpad + i);
+	for(k = 0; k < nk; k++) {
+	  diff = load4(a->x + k * vecpad + i) - mean;
+	  acc[k] += diff * diff * h;
+	}
+      }
+      for(k = 0; k < nk; k++) {
+	scores[k * n + m] = acc[k][0] + acc[k][1] + acc[k][2] + acc[k][3] + p[vecpad * 2];
+      }
+    }
+  }
+
+  for(k = 0; k < nk; k++) out[k] = mix_logadd(&(scores[k * n]), n);
+}
+
+/**
+ * Output probability of the current state: the vector kernel for
+ * packed states, the original function for the others.
+ *
+ * @param wrk [i/o] HMM computation work area
+ *
+ * @return the output probability.
+ */
+static LOGPROB
+outprob_simd(HMMWork *wrk)
+{
+  SimdAM *a;
+  SimdState *s;
+  LOGPROB p, q;
+  int id, t, n;
+
+  a = simd_am_get(wrk);
+  id = wrk->OP_state->id;
+  s = &(a->state[id]);
+  if (s->mix == 0) return((*(a->orig))(wrk));
+
+  t = wrk->OP_time;
+  if (simd_batch > 1) {
+    if (a->ahead_time[id] <= t && t < a->ahead_time[id] + a->ahead_num[id]) {
+      p = a->ahead[id * simd_batch + t - a->ahead_time[id]];
+    } else {
+      n = frames_load(a, wrk, simd_batch);
+      simd_calc(a, s, n, -1, &(a->ahead[id * simd_batch]));
+      a->ahead_time[id] = a->x_time;
+      a->ahead_num[id] = n;
+      p = a->ahead[id * simd_batch + t - a->x_time];
+    }
+  } else if (gsel && a->gs_first[id] >= 0) {
+    frames_load(a, wrk, 1);
+    if (a->gs_vec != wrk->OP_vec_stream[0] || a->gs_time != t) {
+      gs_update(a, wrk->OP_vec_stream[0]);
+      a->gs_vec = wrk->OP_vec_stream[0];
+      a->gs_time = t;
+    }
+    simd_calc(a, s, 1, a->gs_first[id], &p);
+  } else {
+    frames_load(a, wrk, 1);
+    simd_calc(a, s, 1, -1, &p);
+  }
+
+  if (simd_check) {
+    q = (*(a->orig))(wrk);
+    /* counted per model, as models may score on threads of their own */
+    if (p > LOG_ZERO && q > LOG_ZERO && fabs(p - q) > a->check_maxdiff) a->check_maxdiff = fabs(p - q);
+    if (++(a->check_num) % SIMD_CHECK_REPORT == 0) {
+      jlog("STAT: outprob SIMD check: %d states, max diff %f\n", a->check_num, a->check_maxdiff);
+    }
+    return(q);
+  }
+  return(p);
+}
+
+/**
+ * Forget the batched results, padded frames and selected Gaussians at
+ * the beginning of a pass, as frame times start over on a new input.
+ *
+ * @param recog [in] engine instance
+ * @param dummy [in] callback data (unused)
+ */
+static void
+simd_reset(Recog *recog, void *dummy)
+{
+  SimdAM *a;
+  int i, j;
+
+  for(i = 0; i < simd_am_num; i++) {
+    a = &(simd_am[i]);
+    a->x_vec = NULL;
+    a->x_time = -1;
+    a->x_num = 0;
+    a->gs_vec = NULL;
+    a->gs_time = -1;
+    if (a->ahead_num) for(j = 0; j < a->statenum; j++) a->ahead_num[j] = 0;
+  }
+}
+
+/**
+ * Start the 1st pass, which goes forward in time: batch the following
+ * frames.
+ *
+ * @param recog [in] engine instance
+ * @param dummy [in] callback data (unused)
+ */
+static void
+simd_pass1_begin(Recog *recog, void *dummy)
+{
+  simd_backward = FALSE;
+  simd_reset(recog, dummy);
+}
+
+/**
+ * Start the 2nd pass, which goes back in time: batch the preceding
+ * frames.
+ *
+ * @param recog [in] engine instance
+ * @param dummy [in] callback data (unused)
+ */
+static void
+simd_pass2_begin(Recog *recog, void *dummy)
+{
+  simd_backward = TRUE;
+  simd_reset(recog, dummy);
+}
+
+/**
+ * Time all states on the benchmark frames, in batches of nk frames.
+ *
+ * @param a [i/o] packed model
+ * @param states [in] packed states
+ * @param n [in] number of states
+ * @param frames [in] benchmark frames
+ * @param nk [in] frames per batch, 0 for the original function
+ * @param sel [in] TRUE to select Gaussians on each frame (nk should be 1)
+ * @param best [out] best state of each frame
+ *
+ * @return the time in milliseconds.
+ */
+static double
+bench_run(SimdAM *a, HTK_HMM_State **states, int n, float *frames, int nk, boolean sel, int *best)
+{
+  HMMWork *wrk;
+  LOGPROB out[SIMD_BATCH_MAX], best_p[SIMD_BATCH_MAX];
+  double t;
+  int f, i, k, num;
+
+  wrk = a->wrk;
+  t = emscripten_get_now();
+  for(f = 0; f < SIMD_BENCH_FRAMES; f += num) {
+    num = (nk == 0) ? 1 : nk;
+    if (f + num > SIMD_BENCH_FRAMES) num = SIMD_BENCH_FRAMES - f;
+    for(k = 0; k < num; k++) {
+      frame_set(a, k, &(frames[(f + k) * a->veclen]));
+      best_p[k] = LOG_ZERO;
+      best[f + k] = -1;
+    }
+    wrk->OP_vec_stream[0] = &(frames[f * a->veclen]);
+    if (sel) gs_update(a, wrk->OP_vec_stream[0]);
+    for(i = 0; i < n; i++) {
+      if (nk == 0) {
+	wrk->OP_state = states[i];
+	out[0] = (*(a->orig))(wrk);
+      } else {
+	simd_calc(a, &(a->state[states[i]->id]), num, sel ? a->gs_first[states[i]->id] : -1, out);
+      }
+      for(k = 0; k < num; k++) {
+	if (best[f + k] < 0 || out[k] > best_p[k]) {
+	  best_p[k] = out[k];
+	  best[f + k] = i;
+	}
+      }
+    }
+  }
+  return(emscripten_get_now() - t);
+}
+
+/**
+ * Mean of the first mixture of a state, for benchmark frames.
+ *
+ * @param st [in] state
+ * @param i [in] dimension
+ *
+ * @return the mean value.
+ */
+static float
+bench_mean(HTK_HMM_State *st, int i)
+{
+  unsigned char *p;
+  unsigned short h;
+  int n;
+
+  if (quant) {
+    n = name_find(quant->name, quant->statenum, st->name);
+    p = quant->data[n] + 8;
+    if (quant->format == 8) {
+      return(quant->mean_offset[i] + quant->mean_scale[i] * (signed char)p[i]);
+    }
+    memcpy(&h, p + i * 2, sizeof(unsigned short));
+    return(half_to_float(h));
+  }
+  return(st->pdf[0]->b[0] ? st->pdf[0]->b[0]->mean[i] : 0.0);
+}
+
+/**
+ * Compute all states on synthetic frames with the original function and
+ * the vector kernel, one frame and a batch at a time, and log the speed
+ * of each, the parameter bytes read per frame, the largest difference
+ * and how often the best state agrees.  Frames are state means of the
+ * model with a small deterministic perturbation.  With quantized
+ * Gaussians, the original function computes on the skeleton hmmdefs, so
+ * only speeds are logged (see bin/hquant.js for the accuracy).  With
+ * Gaussian selection, its speed, the share of Gaussians computed and
+ * how often its best state agrees with computing them all are logged.
+ *
+ * @param a [i/o] packed model
+ * @param hmminfo [in] HMM definition
+ * @param packed [in] bytes of packed parameters
+ */
+static void
+simd_bench(SimdAM *a, HTK_HMM_INFO *hmminfo, int packed)
+{
+  HMMWork *wrk;
+  HTK_HMM_State **states, *st;
+  HTK_HMM_State *s_state;
+  VECT *s_vec;
+  int s_time;
+  float *frames, *x;
+  LOGPROB p, q, maxdiff;
+  double t_orig, t_one, t_batch, t_sel;
+  int *best_orig, *best_one, *best_batch, *best_sel;
+  int f, i, n, agree, agree_batch, agree_sel;
+
+  wrk = a->wrk;
+  states = (HTK_HMM_State **)mymalloc(sizeof(HTK_HMM_State *) * a->statenum);
+  for(n = 0, st = hmminfo->ststart; st; st = st->next) {
+    if (a->state[st->id].mix > 0) states[n++] = st;
+  }
+  if (n == 0) {
+    free(states);
+    return;
+  }
+  frames = (float *)mymalloc(sizeof(float) * a->veclen * SIMD_BENCH_FRAMES);
+  for(f = 0; f < SIMD_BENCH_FRAMES; f++) {
+    st = states[(f * 7919) % n];
+    x = &(frames[f * a->veclen]);
+    for(i = 0; i < a->veclen; i++) {
+      x[i] = bench_mean(st, i) + 0.1 * (((f * 31 + i * 17) % 21) - 10) / 10.0;
+    }
+  }
+  best_orig = (int *)mymalloc(sizeof(int) * SIMD_BENCH_FRAMES * 4);
+  best_one = best_orig + SIMD_BENCH_FRAMES;
+  best_batch = best_one + SIMD_BENCH_FRAMES;
+  best_sel = best_batch + SIMD_BENCH_FRAMES;
+
+  s_state = wrk->OP_state; s_vec = wrk->OP_vec_stream[0]; s_time = wrk->OP_time;
+  wrk->OP_time = -1;
+  t_orig = bench_run(a, states, n, frames, 0, FALSE, best_orig);
+  t_one = bench_run(a, states, n, frames, 1, FALSE, best_one);
+  t_batch = bench_run(a, states, n, frames, simd_batch, FALSE, best_batch);
+  t_sel = 0.0;
+  if (gsel) {
+    a->gs_computed = a->gs_total = 0;
+    t_sel = bench_run(a, states, n, frames, 1, TRUE, best_sel);
+  }
+
+  /* spot check differences outside of the timed loops */
+  maxdiff = 0.0;
+  for(f = 0; f < SIMD_BENCH_FRAMES; f++) {
+    wrk->OP_vec_stream[0] = &(frames[f * a->veclen]);
+    frame_set(a, 0, wrk->OP_vec_stream[0]);
+    for(i = f % 7; i < n; i += 7) {
+      wrk->OP_state = states[i];
+      simd_calc(a, &(a->state[states[i]->id]), 1, -1, &p);
+      q = (*(a->orig))(wrk);
+      if (p > LOG_ZERO && q > LOG_ZERO && fabs(p - q) > maxdiff) maxdiff = fabs(p - q);
+    }
+  }
+  wrk->OP_state = s_state; wrk->OP_vec_stream[0] = s_vec; wrk->OP_time = s_time;
+  simd_reset(NULL, NULL);
+
+  agree = agree_batch = agree_sel = 0;
+  for(f = 0; f < SIMD_BENCH_FRAMES; f++) {
+    if (best_one[f] == best_orig[f]) agree++;
+    if (best_batch[f] == best_orig[f]) agree_batch++;
+    if (gsel && best_sel[f] == best_one[f]) agree_sel++;
+  }
+
+  jlog("STAT: outprob SIMD bench: %d states x %d frames\n", n, SIMD_BENCH_FRAMES);
+  jlog("STAT: outprob SIMD bench: original %.0f frames/sec\n", SIMD_BENCH_FRAMES * 1000.0 / t_orig);
+  jlog("STAT: outprob SIMD bench: SIMD %.0f frames/sec, %d KB params read/frame\n",
+       SIMD_BENCH_FRAMES * 1000.0 / t_one, packed / 1024);
+  jlog("STAT: outprob SIMD bench: SIMD batch %d %.0f frames/sec, %d KB params read/frame\n",
+       simd_batch, SIMD_BENCH_FRAMES * 1000.0 / t_batch, packed / simd_batch / 1024);
+  if (quant == NULL) {
+    jlog("STAT: outprob SIMD bench: max diff %f, best state agreed on %d/%d (batch %d/%d) frames\n",
+	 maxdiff, agree, SIMD_BENCH_FRAMES, agree_batch, SIMD_BENCH_FRAMES);
+  }
+  if (gsel) {
+    jlog("STAT: outprob SIMD bench: gselect %.0f frames/sec, %.1f%% of Gaussians computed, best state agreed with SIMD on %d/%d frames\n",
+	 SIMD_BENCH_FRAMES * 1000.0 / t_sel, a->gs_total ? 100.0 * a->gs_computed / a->gs_total : 0.0, agree_sel, SIMD_BENCH_FRAMES);
+  }
+
+  free(best_orig);
+  free(frames);
+  free(states);
+}
+
+/**
+ * Read a whole file.
+ *
+ * @param filename [in] file name
+ * @param len [out] file length
+ *
+ * @return newly allocated contents, or NULL if the file cannot be opened.
+ */
+static unsigned char *
+file_read(char *filename, int *len)
+{
+  FILE *fp;
+  unsigned char *buf;
+  int n;
+
+  if ((fp = fopen_readfile(filename)) == NULL) return NULL;
+  *len = 0;
+  buf = NULL;
+  do {
+    buf = (unsigned char *)myrealloc(buf, *len + 65536);
+    n = myfread(buf + *len, 1, 65536, fp);
+    if (n > 0) *len += n;
+  } while(n == 65536);
+  fclose_readfile(fp);
+  return buf;
+}
+
+/**
+ * <EN>
+ * @brief  Read the quantized Gaussians written by bin/hquant.js.
+ *
+ * They are used for the acoustic model by event_outprob_simd_setup(),
+ * which should be given the skeleton hmmdefs written along with them.
+ * </EN>
+ *
+ * @param filename [in] file name
+ *
+ * @return TRUE on success, FALSE on error.
+ *
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+boolean
+event_outprob_simd_quant(char *filename)
+{
+  QuantModel *q;
+  unsigned char *buf, *p, *end;
+  int len, i, m, h[4], namelen, vbytes;
+
+  if ((buf = file_read(filename, &len)) == NULL) {
+    jlog("ERROR: hquant: failed to open %s\n", filename);
+    return FALSE;
+  }
+
+  q = (QuantModel *)mymalloc(sizeof(QuantModel));
+  q->buf = buf;
+  end = buf + len;
+  if (len < 20 || strncmp((char *)buf, "JQHM", 4) != 0) {
+    jlog("ERROR: hquant: %s: not a quantized Gaussian file\n", filename);
+    free(buf);
+    free(q);
+    return FALSE;
+  }
+  memcpy(h, buf + 4, sizeof(int) * 4);
+  q->format = h[1];
+  q->veclen = h[2];
+  q->statenum = h[3];
+  if (h[0] != 1 || (q->format != 8 && q->format != 16) || q->veclen <= 0 || q->statenum <= 0
+      || len < 20 + q->veclen * 16) {
+    jlog("ERROR: hquant: %s: unsupported version or broken header\n", filename);
+    free(buf);
+    free(q);
+    return FALSE;
+  }
+  p = buf + 20;
+  q->mean_offset = (float *)mymalloc(sizeof(float) * q->veclen * 4);
+  memcpy(q->mean_offset, p, sizeof(float) * q->veclen * 4);
+  q->mean_scale = q->mean_offset + q->veclen;
+  q->ivar_offset = q->mean_scale + q->veclen;
+  q->ivar_scale = q->ivar_offset + q->veclen;
+  p += sizeof(float) * q->veclen * 4;
+
+  q->name = (char **)mymalloc(sizeof(char *) * q->statenum);
+  q->mix = (int *)mymalloc(sizeof(int) * q->statenum);
+  q->data = (unsigned char **)mymalloc(sizeof(unsigned char *) * q->statenum);
+  vbytes = q->veclen * 2 * (q->format / 8);
+  for(i = 0; i < q->statenum; i++) {
+    if (p + 1 > end) break;
+    namelen = *p++;
+    if (p + namelen + 4 > end) break;
+    q->name[i] = (char *)mymalloc(namelen + 1);
+    memcpy(q->name[i], p, namelen);
+    q->name[i][namelen] = '\0';
+    p += namelen;
+    memcpy(&m, p, sizeof(int));
+    p += 4;
+    if (m <= 0 || p + m * (8 + vbytes) > end) break;
+    q->mix[i] = m;
+    q->data[i] = p;
+    p += m * (8 + vbytes);
+  }
+  if (i < q->statenum) {
+    jlog("ERROR: hquant: %s: truncated at state %d\n", filename, i);
+    return FALSE;
+  }
+
+  quant = q;
+  jlog("STAT: hquant: %d states of %d dimensions, %d-bit, read from %s\n", q->statenum, q->veclen, q->format, filename);
+  return TRUE;
+}
+
+/**
+ * <EN>
+ * @brief  Read the Gaussian selection codebook written by bin/gselect.js.
+ *
+ * It is used for the acoustic models by event_outprob_simd_setup(),
+ * for the states it names.
+ * </EN>
+ *
+ * @param filename [in] file name
+ *
+ * @return TRUE on success, FALSE on error.
+ *
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+boolean
+event_outprob_simd_gselect(char *filename)
+{
+  GselModel *g;
+  unsigned char *buf, *p, *end;
+  int len, i, c, m, h[4], namelen;
+
+  if ((buf = file_read(filename, &len)) == NULL) {
+    jlog("ERROR: gselect: failed to open %s\n", filename);
+    return FALSE;
+  }
+  end = buf + len;
+  if (len < 28 || strncmp((char *)buf, "JGSL", 4) != 0) {
+    jlog("ERROR: gselect: %s: not a Gaussian selection file\n", filename);
+    free(buf);
+    return FALSE;
+  }
+  memcpy(h, buf + 4, sizeof(int) * 4);
+  if (h[0] != 1 || h[1] <= 0 || h[2] <= 0 || h[3] <= 0
+      || len < 28 + h[1] * 8 + h[2] * h[1] * 4) {
+    jlog("ERROR: gselect: %s: unsupported version or broken header\n", filename);
+    free(buf);
+    return FALSE;
+  }
+  g = (GselModel *)mymalloc(sizeof(GselModel));
+  g->veclen = h[1];
+  g->vecpad = (g->veclen + 3) & ~3;
+  g->cbnum = h[2];
+  g->statenum = h[3];
+  memcpy(&(g->threshold), buf + 20, sizeof(float));
+  memcpy(&(g->floor), buf + 24, sizeof(float));
+  p = buf + 28;
+  g->offset = (float *)mymalloc(sizeof(float) * g->veclen * 2);
+  g->scale = g->offset + g->veclen;
+  memcpy(g->offset, p, sizeof(float) * g->veclen * 2);
+  p += sizeof(float) * g->veclen * 2;
+
+  /* codewords, padded for the vector loads */
+  g->codeword = (float *)mymalloc(sizeof(float) * g->vecpad * g->cbnum);
+  for(i = 0; i < g->vecpad * g->cbnum; i++) g->codeword[i] = 0.0;
+  for(c = 0; c < g->cbnum; c++) {
+    memcpy(g->codeword + c * g->vecpad, p, sizeof(float) * g->veclen);
+    p += sizeof(float) * g->veclen;
+  }
+
+  g->name = (char **)mymalloc(sizeof(char *) * g->statenum);
+  g->first = (int *)mymalloc(sizeof(int) * g->statenum * 2);
+  g->mix = g->first + g->statenum;
+  g->gnum = 0;
+  for(i = 0; i < g->statenum; i++) {
+    if (p + 1 > end) break;
+    namelen = *p++;
+    if (p + namelen + 4 > end) break;
+    g->name[i] = (char *)mymalloc(namelen + 1);
+    memcpy(g->name[i], p, namelen);
+    g->name[i][namelen] = '\0';
+    p += namelen;
+    memcpy(&m, p, sizeof(int));
+    p += 4;
+    if (m <= 0) break;
+    g->first[i] = g->gnum;
+    g->mix[i] = m;
+    g->gnum += m;
+  }
+  if (i < g->statenum) {
+    jlog("ERROR: gselect: %s: truncated at state %d\n", filename, i);
+    return FALSE;
+  }
+
+  g->listnum = (int *)mymalloc(sizeof(int) * g->cbnum);
+  g->list = (int **)mymalloc(sizeof(int *) * g->cbnum);
+  for(c = 0; c < g->cbnum; c++) {
+    if (p + 4 > end) break;
+    memcpy(&m, p, sizeof(int));
+    p += 4;
+    if (m < 0 || p + m * 4 > end) break;
+    g->listnum[c] = m;
+    g->list[c] = (int *)mymalloc(sizeof(int) * (m > 0 ? m : 1));
+    memcpy(g->list[c], p, sizeof(int) * m);
+    p += m * 4;
+    for(i = 0; i < m; i++) if (g->list[c][i] < 0 || g->list[c][i] >= g->gnum) break;
+    if (i < m) break;
+  }
+  if (c < g->cbnum) {
+    jlog("ERROR: gselect: %s: broken list of codeword %d\n", filename, c);
+    return FALSE;
+  }
+  free(buf);
+
+  gsel = g;
+  jlog("STAT: gselect: %d codewords over %d Gaussians of %d states, floor distance %.1f, read from %s\n", g->cbnum, g->gnum, g->statenum, g->floor, filename);
+  return TRUE;
+}
+
+/**
+ * <EN>
+ * @brief  Install the vectorized output probability function.
+ *
+ * Acoustic models are packed and installed to when they use no Gaussian
+ * pruning, no tied mixtures and a single stream.  If quantized Gaussians
+ * were read by event_outprob_simd_quant(), the model must qualify and
+ * all its states are packed from them.  If a Gaussian selection
+ * codebook was read by event_outprob_simd_gselect(), it applies to the
+ * states it names, one frame at a time.  Should be called after
+ * j_final_fusion(), and before event_trace_setup() so that the trace
+ * times the installed function.
+ * </EN>
+ *
+ * @param recog [i/o] engine instance
+ * @param batch [in] number of frames to score a state on at once when
+ * they are available (1 to disable)
+ * @param check [in] TRUE to compute with both functions and log the
+ * largest difference (the original result is used)
+ * @param bench [in] TRUE to run a benchmark of both functions over the
+ * model now
+ *
+ * @return TRUE on success, FALSE if the quantized Gaussians or the
+ * codebook do not match the model, or a codebook is given with batches.
+ *
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+boolean
+event_outprob_simd_setup(Recog *recog, int batch, boolean check, boolean bench)
+{
+  PROCESS_AM *am;
+  HTK_HMM_State *st;
+  HTK_HMM_PDF *pdf;
+  SimdAM *a;
+  int size, total, m, n, i, selected;
+  float *p, scale;
+
+  if (batch < 1) batch = 1;
+  if (gsel && batch > 1) {
+    /* Gaussians are selected for one frame, outprob_simd() would
+       compute them all in batches */
+    jlog("ERROR: outprob SIMD: no batch with Gaussian selection\n");
+    return FALSE;
+  }
+  if (batch > SIMD_BATCH_MAX) {
+    jlog("WARNING: outprob SIMD: batch limited to %d frames\n", SIMD_BATCH_MAX);
+    batch = SIMD_BATCH_MAX;
+  }
+  simd_batch = batch;
+  simd_check = check;
+  if (quant && check) {
+    /* the original function computes on the skeleton hmmdefs */
+    jlog("WARNING: outprob SIMD: no check with quantized Gaussians\n");
+    simd_check = FALSE;
+  }
+
+  for(am=recog->amlist;am;am=am->next) {
+    if (simd_am_num >= SIMD_AM_MAX) break;
+    if (am->hmmwrk.compute_gaussian != gprune_none
+	|| am->hmminfo->is_tied_mixture
+	|| am->hmmwrk.OP_nstream != 1) {
+      if (quant) {
+	jlog("ERROR: AM%02d %s: quantized Gaussians need \"-gprune none\", no tied mixtures and one stream\n", am->config->id, am->config->name);
+	return FALSE;
+      }
+      jlog("STAT: AM%02d %s: outprob SIMD not applicable, using original\n", am->config->id, am->config->name);
+      continue;
+    }
+    if (quant && quant->veclen != am->hmmwrk.OP_veclen_stream[0]) {
+      jlog("ERROR: AM%02d %s: quantized Gaussians have %d dimensions, model has %d\n", am->config->id, am->config->name, quant->veclen, am->hmmwrk.OP_veclen_stream[0]);
+      return FALSE;
+    }
+    if (gsel && gsel->veclen != am->hmmwrk.OP_veclen_stream[0]) {
+      jlog("ERROR: AM%02d %s: Gaussian selection has %d dimensions, model has %d\n", am->config->id, am->config->name, gsel->veclen, am->hmmwrk.OP_veclen_stream[0]);
+      return FALSE;
+    }
+    a = &(simd_am[simd_am_num]);
+    a->wrk = &(am->hmmwrk);
+    a->mfcc = am->mfcc;
+    a->orig = am->hmmwrk.calc_outprob_state;
+    a->statenum = am->hmminfo->totalstatenum;
+    a->veclen = am->hmmwrk.OP_veclen_stream[0];
+    a->vecpad = (a->veclen + 3) & ~3;
+    a->x = (float *)mymalloc(sizeof(float) * a->vecpad * SIMD_BATCH_MAX);
+    for(m = 0; m < a->vecpad * SIMD_BATCH_MAX; m++) a->x[m] = 0.0;
+    a->state = (SimdState *)mymalloc(sizeof(SimdState) * a->statenum);
+    for(m = 0; m < a->statenum; m++) a->state[m].mix = 0;
+    if (batch > 1) {
+      a->ahead = (LOGPROB *)mymalloc(sizeof(LOGPROB) * a->statenum * batch);
+      a->ahead_time = (int *)mymalloc(sizeof(int) * a->statenum);
+      a->ahead_num = (short *)mymalloc(sizeof(short) * a->statenum);
+      for(m = 0; m < a->statenum; m++) a->ahead_time[m] = 0;
+    } else {
+      a->ahead = NULL;
+      a->ahead_time = NULL;
+      a->ahead_num = NULL;
+    }
+    if (quant && quant->format == 8) {
+      /* -0.5 * ivar * (x - mean)^2 in mean steps:
+	 (a[d] + b[d] * ivar_q) * (x_q - mean_q)^2 */
+      a->qa = (float *)mymalloc(sizeof(float) * a->vecpad * 2);
+      a->qb = a->qa + a->vecpad;
+      for(i = 0; i < a->vecpad; i++) {
+	if (i < a->veclen) {
+	  scale = quant->mean_scale[i] * quant->mean_scale[i];
+	  a->qa[i] = -0.5 * scale * quant->ivar_offset[i];
+	  a->qb[i] = -0.5 * scale * quant->ivar_scale[i];
+	} else {
+	  a->qa[i] = a->qb[i] = 0.0;
+	}
+      }
+    } else {
+      a->qa = a->qb = NULL;
+    }
+
+    /* size the pool, then pack the states into it, 16-byte aligned */
+    total = 0;
+    for(st = am->hmminfo->ststart; st; st = st->next) {
+      if (st->nstream != 1 || st->pdf[0]->tmix) {
+	if (quant) {
+	  jlog("ERROR: AM%02d %s: state %s is not supported with quantized Gaussians\n", am->config->id, am->config->name, st->name ? st->name : "(no name)");
+	  return FALSE;
+	}
+	continue;
+      }
+      if (quant) {
+	n = name_find(quant->name, quant->statenum, st->name);
+	if (n < 0 || quant->mix[n] != st->pdf[0]->mix_num) {
+	  jlog("ERROR: AM%02d %s: state %s not found in quantized Gaussians\n", am->config->id, am->config->name, st->name ? st->name : "(no name)");
+	  return FALSE;
+	}
+      }
+      total += block_size(st->pdf[0]->mix_num, a->veclen, a->vecpad);
+    }
+    a->pool = (float *)mymalloc(sizeof(float) * (total + 4));
+    p = (float *)(((size_t)a->pool + 15) & ~(size_t)15);
+    for(st = am->hmminfo->ststart; st; st = st->next) {
+      if (st->nstream != 1 || st->pdf[0]->tmix) continue;
+      pdf = st->pdf[0];
+      size = block_size(pdf->mix_num, a->veclen, a->vecpad);
+      a->state[st->id].mix = pdf->mix_num;
+      a->state[st->id].quant = (a->qa != NULL);
+      a->state[st->id].soa = (pdf->mix_num >= 4 && a->qa == NULL);
+      a->state[st->id].block = p;
+      if (quant) block_pack_quant(quant, name_find(quant->name, quant->statenum, st->name), p, a->veclen, a->vecpad);
+      else block_pack_pdf(pdf, p, a->veclen, a->vecpad);
+      p += size;
+    }
+
+    /* states named in the codebook with the same mixtures are selected
+       on, the others always computed */
+    a->scores = NULL;
+    a->scorelen = 0;
+    a->gs_first = NULL;
+    a->gs_stamp = NULL;
+    a->gs_z = NULL;
+    a->gs_cur = 0;
+    a->check_num = 0;
+    a->check_maxdiff = 0.0;
+    selected = 0;
+    if (gsel) {
+      a->gs_first = (int *)mymalloc(sizeof(int) * a->statenum);
+      for(m = 0; m < a->statenum; m++) a->gs_first[m] = -1;
+      for(st = am->hmminfo->ststart; st; st = st->next) {
+	if (a->state[st->id].mix == 0) continue;
+	n = name_find(gsel->name, gsel->statenum, st->name);
+	if (n < 0 || gsel->mix[n] != a->state[st->id].mix) continue;
+	a->gs_first[st->id] = gsel->first[n];
+	selected++;
+      }
+      a->gs_stamp = (int *)mymalloc(sizeof(int) * gsel->gnum);
+      for(m = 0; m < gsel->gnum; m++) a->gs_stamp[m] = 0;
+      a->gs_z = (float *)mymalloc(sizeof(float) * gsel->vecpad);
+      for(m = 0; m < gsel->vecpad; m++) a->gs_z[m] = 0.0;
+      jlog("STAT: AM%02d %s: Gaussian selection on %d states\n", am->config->id, am->config->name, selected);
+    }
+    simd_am_num++;
+    simd_reset(recog, NULL);
+
+    am->hmmwrk.calc_outprob_state = outprob_simd;
+    jlog("STAT: AM%02d %s: outprob SIMD installed, %d KB packed%s, batch %d\n", am->config->id, am->config->name, (int)(total * sizeof(float) / 1024), quant ? (quant->format == 8 ? " from 8-bit" : " from 16-bit") : "", batch);
+
+    if (bench) simd_bench(a, am->hmminfo, (int)(total * sizeof(float)));
+  }
+
+  /* frame times start over on each input, and frames of a new input
+     may be at the addresses of the last one's: each pass starts clean,
+     as even single frames are kept by address and time (frames_load()) */
+  if (simd_am_num > 0) {
+    callback_add(recog, CALLBACK_EVENT_PASS1_BEGIN, simd_pass1_begin, NULL);
+    callback_add(recog, CALLBACK_EVENT_PASS2_BEGIN, simd_pass2_begin, NULL);
+  }
+
+  return TRUE;
+}
+
+/* end of file */
@@ -160,13 +160,17 @@
 
 #define GLOBAL_VARIABLE_DEFINE	///< Actually make global vars in global.h
 #include <julius/julius.h>
+#include <julius/event.h>
 #include <signal.h>
+#include <malloc.h>
 #if defined(_WIN32) && !defined(__CYGWIN32__)
 #include <mbctype.h>
 #include <mbstring.h>
 #endif
 
-#include <emscripten.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 /* ---------- persistent variables for event_recognition_stream ---------*/
 int e_ret;
@@ -181,6 +185,69 @@ boolean e_on_the_fly;
 boolean e_pass2_p;
 short e_running = 0;
 
+/* ---------- 1st pass fast path ----------------------------------------*/
+#define PASS1_FINAL_MAX 8	///< Maximum number of processes finalized on 1st pass
+static float e_pass1_final_margin = -1.0; ///< Score margin to finalize on 1st pass, <0 disables
+static boolean e_pass1_final_verify = FALSE; ///< Still run 2nd pass to verify
+static RecogProcess *e_pass1_final[PASS1_FINAL_MAX]; ///< Processes finalized on this input
+static int e_pass1_final_num = 0;
+static int e_pass1_final_taken = 0; ///< Number of inputs finalized on 1st pass
+static int e_pass1_final_agreed = 0; ///< Number of verified inputs the 2nd pass agreed with
+
+/* ---------- 1st pass look-ahead ---------*/
+#define LOOKAHEAD_MFCC_MAX 8	///< Maximum number of MFCC instances to delay
+static int e_lookahead = 0;	///< Frames the real-time 1st pass searches behind the input
+static boolean e_lookahead_stopped = FALSE; ///< The search stopped on this input
+
+/* ---------- keyword spotting ---------*/
+#define SPOT_MAX 8		///< Maximum number of spotting processes
+#define SPOT_FILLER "<filler>"	///< Output string of filler words (see bin/mkspot.js)
+/// Spotting state of a process
+typedef struct {
+  RecogProcess *r;		///< Process instance
+  int filler;			///< Category of filler words, -1 if none
+  TRELLIS_ATOM *seen;		///< Last word end already examined
+  int last_end;			///< End frame of the last detection, -1 if none
+} SpotProcess;
+static float e_spot_threshold = 0.0; ///< Per-frame log likelihood ratio to detect a keyword
+static SpotProcess e_spot[SPOT_MAX];
+static int e_spot_num = 0;
+
+/* ---------- wake-word cascade ---------*/
+static RecogProcess *e_cascade_wake = NULL; ///< Process of the wake stage, NULL without cascade
+static float e_cascade_sec = 0.0;	///< Length of the main stage (sec.), 0 for one utterance
+static int e_cascade_stage = 0;		///< 0 while waiting for the wake phrase, 1 on the main stage
+static double e_cascade_until = 0.0;	///< Time the main stage ends (ms)
+static int e_cascade_fired = -1;	///< End frame of the wake phrase on this input, -1 if not heard
+static SP16 *e_cascade_speech = NULL;	///< Triggered samples of the input on the wake stage
+static int e_cascade_len = 0;
+static int e_cascade_alloc = 0;
+
+/* ---------- dynamic category slots ---------*/
+static boolean e_slot_polling = FALSE;	///< Poll callback registered
+static boolean e_slot_pending = FALSE;	///< Grammar changed, waiting is to be broken
+static int e_slot_changes = 0;		///< Words changed since the lexicon was built (count)
+static double e_slot_build = 0.0;	///< Time the grammar update began (ms)
+static boolean e_slot_grammar = FALSE;	///< Grammar replaced since the lexicon was built
+
+/* ---------- per-input sentence storage ---------*/
+static BMALLOC_BASE *e_sent_root = NULL; ///< Block allocation base of sentences and alignment headers of the current input
+static int e_input_num = 0;		  ///< Number of inputs processed
+
+/* ---------- memory telemetry ---------*/
+static int e_model_load = 0;	///< Heap taken by loading models
+static int e_model_fusion = 0;	///< Heap taken by lexicon trees and work areas
+
+/* ---------- per-utterance gauges ---------*/
+static boolean e_gauge_speech = FALSE;	///< TRUE while an utterance is being decoded
+static double e_gauge_cpu = 0.0;	///< Decoding time spent on the utterance (ms)
+static double e_gauge_tick = 0.0;	///< Time the current tick began (ms)
+static double e_gauge_speech_end = -1.0; ///< Time speech end was detected (ms), <0 if not yet
+static double e_gauge_pass1 = -1.0;	///< Latency of the 1st pass result (ms)
+
+/* ---------- offline decoding ---------*/
+#define OFFLINE_SLICE_MSEC 40.0	///< Steps run in a row on samples from memory (ms)
+
 /* ---------- utility functions -----------------------------------------*/
 #ifdef REPORT_MEMORY_USAGE
 /** 
@@ -203,6 +270,171 @@ print_mem()
   fflush(stderr);
 }
 #endif
+
+/** 
+ * <EN>
+ * Record heap taken for loading models and for the final fusion, as
+ * measured by the application around j_load_all() and j_final_fusion().
+ * </EN>
+ * 
+ * @param load [in] bytes taken by j_load_all()
+ * @param fusion [in] bytes taken by j_final_fusion()
+ * 
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+void
+event_stats_model(int load, int fusion)
+{
+  e_model_load = load;
+  e_model_fusion = fusion;
+}
+
+/** 
+ * <EN>
+ * Estimate size of acoustic model parameters.
+ * </EN>
+ * 
+ * @param hmminfo [in] HMM definition
+ * 
+ * @return estimated bytes.
+ */
+static int
+stats_am_size(HTK_HMM_INFO *hmminfo)
+{
+  return(hmminfo->totalmixnum * (sizeof(HTK_HMM_Dens) + 2 * sizeof(VECT) * hmminfo->opt.vec_size)
+	 + hmminfo->totalstatenum * sizeof(HTK_HMM_State)
+	 + hmminfo->totalhmmnum * sizeof(HTK_HMM_Data)
+	 + hmminfo->totallogicalnum * sizeof(HMM_Logical));
+}
+
+/** 
+ * <EN>
+ * Estimate size of a word dictionary.
+ * </EN>
+ * 
+ * @param winfo [in] word dictionary
+ * 
+ * @return estimated bytes.
+ */
+static int
+stats_dict_size(WORD_INFO *winfo)
+{
+  int size;
+  WORD_ID w;
+
+  size = winfo->maxnum * (sizeof(HMM_Logical **) + 2 * sizeof(char *) + sizeof(WORD_ID) + sizeof(LOGPROB) + sizeof(unsigned char));
+  for(w=0;w<winfo->num;w++) {
+    size += winfo->wlen[w] * sizeof(HMM_Logical *);
+    size += strlen(winfo->wname[w]) + strlen(winfo->woutput[w]) + 2;
+  }
+  return(size);
+}
+
+/** 
+ * <EN>
+ * @brief  Get current memory usage of the engine.
+ *
+ * This is callable at any time from the handling script, so that
+ * memory can be watched over long sessions.  Heap and buffer sizes are
+ * measured, model sizes per component are estimated from their
+ * element counts.  Without an engine instance, as while models are
+ * loaded, only the heap and the ring buffer are told.
+ * </EN>
+ * 
+ * @param recog [in] engine instance, or NULL
+ * 
+ * @return pointer to static statistics, valid until the next call.
+ * 
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+EventStats *
+event_stats(Recog *recog)
+{
+  static EventStats stats;
+  struct mallinfo mi;
+  ADIn *a;
+  PROCESS_AM *am;
+  PROCESS_LM *lm;
+  RecogProcess *r;
+  int resizes;
+
+  memset(&stats, 0, sizeof(EventStats));
+
+  /* heap */
+  mi = mallinfo();
+#ifdef __EMSCRIPTEN__
+  stats.heap_size = EM_ASM_INT_V({ return HEAP8.length; });
+#else
+  /* natively malloc's arena is all the heap there is to report */
+  stats.heap_size = mi.arena;
+#endif
+  stats.heap_used = mi.arena;
+  stats.heap_inuse = mi.uordblks;
+  stats.heap_free = mi.fordblks;
+  stats.input_num = e_input_num;
+
+  /* input buffers */
+#ifdef USE_WEBAUDIO
+  adin_mic_buffer_status(&(stats.ring_size), &(stats.ring_fill), &(stats.buffer_resizes));
+#endif
+  if (recog == NULL) return(&stats);
+  stats.speech = recog->speechalloclen * sizeof(SP16);
+  a = recog->adin;
+  if (a != NULL) {
+    adin_buffer_status(a, &(stats.adin_speech), &resizes);
+    stats.buffer_resizes += resizes;
+    stats.adin_buffer = a->bpmax * sizeof(SP16);
+    stats.adin_cbuf = a->c_length * sizeof(SP16);
+    stats.adin_swapbuf = a->sbsize * sizeof(SP16);
+    if (a->down_sample) {
+      stats.adin_buffer48 = a->bpmax * a->io_rate * sizeof(SP16);
+    }
+  }
+
+  /* models */
+  stats.model_load = e_model_load;
+  stats.model_fusion = e_model_fusion;
+  for(am=recog->amlist;am;am=am->next) {
+    if (am->hmminfo) stats.am += stats_am_size(am->hmminfo);
+  }
+  for(lm=recog->lmlist;lm;lm=lm->next) {
+    if (lm->winfo) stats.dict += stats_dict_size(lm->winfo);
+    if (lm->dfa) {
+      stats.dfa += lm->dfa->state_num * sizeof(DFA_STATE) + lm->dfa->arc_num * sizeof(DFA_ARC) + lm->dfa->term_num * lm->dfa->term_num / 8;
+    }
+  }
+  for(r=recog->process_list;r;r=r->next) {
+    if (r->wchmm) stats.wchmm += r->wchmm->n * sizeof(WCHMM_STATE);
+  }
+
+  return(&stats);
+}
+
+/** 
+ * <EN>
+ * @brief  Release the sentence storage of the last input at once.
+ *
+ * The Sentence arrays and SentenceAlign headers of an input are
+ * allocated from a per-input block area instead of one by one, so that
+ * they can be released in one step when the next input begins.  This
+ * covers only these two: the arrays of an alignment (word_align.c), the
+ * hypotheses of the 2nd pass and the word graphs are still allocated
+ * and freed one by one by the original code.
+ * </EN>
+ * 
+ * @callgraph
+ * @callergraph
+ */
+static void
+sentence_storage_reset()
+{
+  if (e_sent_root != NULL) mybfree2(&e_sent_root);
+  e_sent_root = NULL;
+}
 	  
 
 /** 
@@ -225,7 +457,7 @@ SentenceAlign *
 result_align_new()
 {
   SentenceAlign *new;
-  new = (SentenceAlign *)mymalloc(sizeof(SentenceAlign));
+  new = (SentenceAlign *)mybmalloc2(sizeof(SentenceAlign), &e_sent_root);
   new->w = NULL;
   new->ph = NULL;
   new->loc = NULL;
@@ -263,7 +495,7 @@ result_align_free(SentenceAlign *a)
   if (a->end_frame) free(a->end_frame);
   if (a->avgscore) free(a->avgscore);
   if (a->is_iwsp) free(a->is_iwsp);
-  free(a);
+  /* a itself will be released at sentence_storage_reset() */
 }
 
 /** 
@@ -285,7 +517,7 @@ void
 result_sentence_malloc(RecogProcess *r, int num)
 {
   int i;
-  r->result.sent = (Sentence *)mymalloc(sizeof(Sentence) * num);
+  r->result.sent = (Sentence *)mybmalloc2(sizeof(Sentence) * num, &e_sent_root);
   for(i=0;i<num;i++) r->result.sent[i].align = NULL;
   r->result.sentnum = 0;
 }
@@ -317,7 +549,7 @@ result_sentence_free(RecogProcess *r)
 	a = atmp;
       }
     }
-    free(r->result.sent);
+    /* r->result.sent will be released at sentence_storage_reset() */
     r->result.sent = NULL;
   }
 }
@@ -346,7 +578,8 @@ clear_result(RecogProcess *r)
   if (r->lmvar == LM_DFA_WORD) {
     if (r->result.status == J_RESULT_STATUS_SUCCESS) {
       /* clear word recog result of first pass as in final result */
-      free(r->result.sent);
+      /* (released at sentence_storage_reset()) */
+      r->result.sent = NULL;
     }
   } else {
     if (r->graphout) {
@@ -690,6 +923,372 @@ result_error(Recog *recog, int status)
   }
 }
 
+/** 
+ * <EN>
+ * Check whether a process runs the 2nd pass on the current input.
+ * </EN>
+ * 
+ * @param r [in] recognition process instance
+ * 
+ * @return TRUE if it is live, was not finalized on the 1st pass and did
+ * not fail there.
+ */
+static boolean
+pass2_wanted(RecogProcess *r)
+{
+  if (!r->live) return FALSE;
+  /* if [-1pass] is specified, just copy from 1st pass result */
+  if (skip_pass2(r)) return FALSE;
+  /* if search already failed on 1st pass, skip 2nd pass */
+  if (r->result.status < 0) return FALSE;
+  return TRUE;
+}
+
+/** 
+ * <EN>
+ * Run the 2nd pass of a process, whose result storage is prepared.
+ * </EN>
+ * 
+ * @param r [i/o] recognition process instance
+ */
+static void
+pass2_process(RecogProcess *r)
+{
+  if (r->lmtype == LM_PROB) {
+    wchmm_fbs(r->am->mfcc->param, r, 0, 0);
+  } else if (r->lmtype == LM_DFA) {
+    if (r->config->output.multigramout_flag) {
+      /* execute 2nd pass multiple times for each grammar sequencially */
+      /* to output result for each grammar */
+      MULTIGRAM *m;
+      boolean has_success = FALSE;
+      for(m = r->lm->grammars; m; m = m->next) {
+	if (m->active) {
+	  jlog("STAT: execute 2nd pass limiting words for gram #%d\n", m->id);
+	  wchmm_fbs(r->am->mfcc->param, r, m->cate_begin, m->dfa->term_num);
+	  if (r->result.status == J_RESULT_STATUS_SUCCESS) {
+	    has_success = TRUE;
+	  }
+	}
+      }
+      r->result.status = (has_success == TRUE) ? J_RESULT_STATUS_SUCCESS : J_RESULT_STATUS_FAIL;
+    } else {
+      /* only the best among all grammar will be output */
+      wchmm_fbs(r->am->mfcc->param, r, 0, r->lm->dfa->term_num);
+    }
+  }
+}
+
+#ifdef HAVE_PTHREAD
+#define SEARCH_THREAD_MAX 8	///< Maximum number of threads searching at once
+#define SEARCH_GROUP_MAX 16	///< Maximum number of processes of a group
+
+/// Processes of an acoustic model, searched one after another by a thread
+typedef struct {
+  Recog *recog;			///< Engine instance
+  PROCESS_AM *am;		///< Acoustic model of the processes
+  RecogProcess *proc[SEARCH_GROUP_MAX]; ///< Processes, in list order
+  int num;			///< Number of processes
+} SearchGroup;
+
+static SearchGroup search_group[SEARCH_THREAD_MAX];
+
+/* Persistent threads running the groups but the first in the 2nd pass:
+   each thread is a Web Worker in the browser, created once (see
+   PTHREAD_POOL_SIZE in emscript.sh) */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static EventTask pool_task[SEARCH_THREAD_MAX - 1]; ///< Task of each thread, NULL when idle
+static void *pool_arg[SEARCH_THREAD_MAX - 1]; ///< Argument of the task
+static int pool_num = 0;	///< Number of threads started
+static int pool_busy = 0;	///< Number of threads running a task
+static boolean pool_failed = FALSE; ///< A thread could not be started
+
+/** 
+ * <EN>
+ * Thread of the pool: run the tasks given to its slot.
+ * </EN>
+ * 
+ * @param arg [in] slot of the thread
+ */
+static void *
+pool_main(void *arg)
+{
+  EventTask task;
+  int i;
+
+  i = (int)(size_t)arg;
+  pthread_mutex_lock(&pool_mutex);
+  for(;;) {
+    while (pool_task[i] == NULL) pthread_cond_wait(&pool_start, &pool_mutex);
+    task = pool_task[i];
+    pthread_mutex_unlock(&pool_mutex);
+    (*task)(pool_arg[i]);
+    pthread_mutex_lock(&pool_mutex);
+    pool_task[i] = NULL;
+    if (--pool_busy == 0) pthread_cond_signal(&pool_done);
+  }
+  return NULL;
+}
+
+/** 
+ * <EN>
+ * Run a task on each group, the first one on the calling thread and the
+ * others on the threads of the pool, which are started on first use.
+ * Groups no thread is left for run on the calling thread too.  Returns
+ * when all are done.
+ * </EN>
+ * 
+ * @param task [in] task, given a SearchGroup
+ * @param n [in] number of groups
+ */
+static void
+search_run(EventTask task, int n)
+{
+  pthread_t thread;
+  int i, m;
+
+  while (pool_num < n - 1 && !pool_failed) {
+    if (pthread_create(&thread, NULL, pool_main, (void *)(size_t)pool_num) != 0) {
+      jlog("WARNING: failed to create search thread, %d running\n", pool_num);
+      pool_failed = TRUE;
+      break;
+    }
+    pthread_detach(thread);
+    pool_num++;
+  }
+  m = (n - 1 < pool_num) ? n - 1 : pool_num;
+
+  pthread_mutex_lock(&pool_mutex);
+  for(i=0;i<m;i++) {
+    pool_arg[i] = &(search_group[i + 1]);
+    pool_task[i] = task;
+  }
+  pool_busy = m;
+  if (m > 0) pthread_cond_broadcast(&pool_start);
+  pthread_mutex_unlock(&pool_mutex);
+
+  (*task)(&(search_group[0]));
+  for(i=m+1;i<n;i++) (*task)(&(search_group[i]));
+
+  pthread_mutex_lock(&pool_mutex);
+  while (pool_busy > 0) pthread_cond_wait(&pool_done, &pool_mutex);
+  pthread_mutex_unlock(&pool_mutex);
+}
+
+/** 
+ * <EN>
+ * Group the wanted processes by acoustic model.  Processes of a model
+ * share its output probability cache, so a group is searched by one
+ * thread; give each grammar its own "-AM" instance (or "-splitam") to
+ * have the 2nd pass of them all search in parallel.
+ * </EN>
+ * 
+ * @param recog [in] engine instance
+ * @param wanted [in] function telling whether a process is searched
+ * 
+ * @return the number of groups, or 0 if there are too many.
+ */
+static int
+search_groups(Recog *recog, boolean (*wanted)(RecogProcess *r))
+{
+  SearchGroup *g;
+  RecogProcess *r;
+  int i, n;
+
+  n = 0;
+  for(r=recog->process_list;r;r=r->next) {
+    if (!(*wanted)(r)) continue;
+    for(i=0;i<n;i++) if (search_group[i].am == r->am) break;
+    if (i == n) {
+      if (n >= SEARCH_THREAD_MAX) return 0;
+      search_group[n].recog = recog;
+      search_group[n].am = r->am;
+      search_group[n].num = 0;
+      n++;
+    }
+    g = &(search_group[i]);
+    if (g->num >= SEARCH_GROUP_MAX) return 0;
+    g->proc[g->num++] = r;
+  }
+  return(n);
+}
+
+/** 
+ * <EN>
+ * Task of the 2nd pass: search the processes of a group one after
+ * another.
+ * </EN>
+ * 
+ * @param arg [in] group (SearchGroup)
+ */
+static void
+pass2_group_main(void *arg)
+{
+  SearchGroup *g;
+  int i;
+
+  g = (SearchGroup *)arg;
+  for(i=0;i<g->num;i++) pass2_process(g->proc[i]);
+}
+
+/** 
+ * <EN>
+ * @brief  Run the 2nd pass of the processes on threads.
+ *
+ * Processes are grouped by acoustic model (see search_groups()), and
+ * each group searches on its own thread.  The input parameters are only
+ * read, and the function returns when all are done.
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ * 
+ * @return TRUE if the 2nd pass was run, FALSE if there are less than 2
+ * groups (the caller then runs it).
+ */
+static boolean
+pass2_parallel(Recog *recog)
+{
+  int n;
+
+  n = search_groups(recog, pass2_wanted);
+  if (n < 2) return FALSE;
+  search_run(pass2_group_main, n);
+  return TRUE;
+}
+#endif
+
+/** 
+ * <EN>
+ * Tell whether the 1st pass searches behind the input: only the
+ * real-time 1st pass without short-pause segmentation is delayed, as
+ * segments are detected on the frame just computed.
+ * </EN>
+ * 
+ * @param recog [in] engine instance
+ * 
+ * @return TRUE if frames are held before they are searched.
+ */
+static boolean
+lookahead_active(Recog *recog)
+{
+  MFCCCalc *mfcc;
+  int n;
+
+  if (e_lookahead <= 0) return FALSE;
+  if (!recog->jconf->decodeopt.realtime_flag || recog->jconf->decodeopt.segment) return FALSE;
+  n = 0;
+  for(mfcc=recog->mfcclist;mfcc;mfcc=mfcc->next) n++;
+  return(n <= LOOKAHEAD_MFCC_MAX);
+}
+
+/** 
+ * <EN>
+ * @brief  Proceed the 1st pass of all processes by a frame.
+ *
+ * This replaces decode_proceed() of beam.c, which the build scripts
+ * rename to decode_proceed_serial().  With a look-ahead set by
+ * event_set_pass1_lookahead(), the real-time 1st pass searches the
+ * frame computed that many frames before the current one, so that the
+ * output probabilities of a state can be computed on the following
+ * frames at once ("-obatch").  The first frames of an input are only
+ * held; the last ones are searched by decode_end().
+ *
+ * All processes proceed on the calling thread, in the pthread build
+ * too: decode_proceed_serial() reads and updates the engine instance
+ * and the MFCC instances the processes share, so only the 2nd pass is
+ * run on threads (see pass2_parallel()).
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ * 
+ * @return FALSE if the search of a process stopped on this frame.
+ *
+ * @callgraph
+ * @callergraph
+ */
+boolean
+decode_proceed(Recog *recog)
+{
+  MFCCCalc *mfcc;
+  boolean ret;
+  int held, i;
+
+  if (!lookahead_active(recog)) return(decode_proceed_serial(recog));
+
+  /* instances whose frame is not yet to be searched are skipped, the
+     others are set back to the frame to search */
+  held = 0;
+  for(i=0,mfcc=recog->mfcclist;mfcc;mfcc=mfcc->next,i++) {
+    if (!mfcc->valid) continue;
+    if (mfcc->f == 0) e_lookahead_stopped = FALSE;
+    if (mfcc->f < e_lookahead) {
+      mfcc->valid = FALSE;
+      held |= (1 << i);
+    } else {
+      mfcc->f -= e_lookahead;
+    }
+  }
+  ret = decode_proceed_serial(recog);
+  for(i=0,mfcc=recog->mfcclist;mfcc;mfcc=mfcc->next,i++) {
+    if (held & (1 << i)) {
+      mfcc->valid = TRUE;
+    } else if (mfcc->valid) {
+      mfcc->f += e_lookahead;
+    }
+  }
+  if (ret == FALSE) e_lookahead_stopped = TRUE;
+
+  return(ret);
+}
+
+/** 
+ * <EN>
+ * @brief  End the 1st pass.
+ *
+ * This replaces decode_end() of beam.c, which the build scripts rename
+ * to decode_end_serial().  Frames held by the look-ahead are searched
+ * first, unless the search stopped on this input.
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ *
+ * @callgraph
+ * @callergraph
+ */
+void
+decode_end(Recog *recog)
+{
+  MFCCCalc *mfcc;
+  boolean valid[LOOKAHEAD_MFCC_MAX];
+  int f[LOOKAHEAD_MFCC_MAX];
+  int i, k, t;
+
+  if (lookahead_active(recog) && !e_lookahead_stopped) {
+    for(i=0,mfcc=recog->mfcclist;mfcc;mfcc=mfcc->next,i++) {
+      valid[i] = mfcc->valid;
+      f[i] = mfcc->f;
+    }
+    /* the last e_lookahead frames of each instance were not searched */
+    for(k=0;k<e_lookahead;k++) {
+      for(mfcc=recog->mfcclist;mfcc;mfcc=mfcc->next) {
+	t = mfcc->param->samplenum - e_lookahead + k;
+	mfcc->valid = (t >= 0) ? TRUE : FALSE;
+	mfcc->f = t;
+      }
+      if (decode_proceed_serial(recog) == FALSE) break;
+    }
+    for(i=0,mfcc=recog->mfcclist;mfcc;mfcc=mfcc->next,i++) {
+      mfcc->valid = valid[i];
+      mfcc->f = f[i];
+    }
+  }
+  e_lookahead_stopped = FALSE;
+
+  decode_end_serial(recog);
+}
+
 /** 
  * <EN>
  * @brief  Execute recognition.
@@ -794,6 +1393,9 @@ j_recognize_stream_core(Recog *recog)
     
   start_recog:
 
+    /* release sentence storage of the last input */
+    sentence_storage_reset();
+
     /*************************************/
     /* Update recognition process status */
     /*************************************/
@@ -1419,6 +2021,8 @@ j_recognize_stream_core(Recog *recog)
     /* end of recognition */
     /**********************/
 
+    e_input_num++;
+
     /* update CMN info for next input (in case of realtime wave input) */
     if (jconf->input.type == INPUT_WAVEFORM && jconf->decodeopt.realtime_flag) {
       for(mfcc=recog->mfcclist;mfcc;mfcc=mfcc->next) {
@@ -1573,29 +2177,1018 @@ j_recognize_stream(Recog *recog)
   return 0;
 }
 
+/* ---------------------- 1st pass fast path -------------------------- */
+
 /** 
  * <EN>
- * @brief  Execute event-based recognition.
- *
- * This function mimics the functionality of j_recognize_stream_core,
- * but simulates multithreading using JavaScript eventing. This is done
- * for use with Web Audio, so that new audio samples can be made
- * available (through `processaudio` events) during the otherwise
- * blocking recognition loop.
+ * @brief  Output confident 1st pass results as final.
  *
- * See j_recognize_stream_core for a more detailed summary.
- * 
+ * When the best 1st pass hypothesis of a grammar process ends with a
+ * word that may end a sentence, and leads the next such word end on the
+ * last frame by at least @a margin, the 2nd pass is skipped and the 1st
+ * pass result is output as the final result, as "-1pass" does.  With
+ * @a verify, the 1st pass result is only announced to the handling
+ * script, and the 2nd pass still runs to confirm or correct it.
  * </EN>
  * 
- * @param recog [i/o] engine instance
- * 
- * @return 1 when stopped by application request, 0 when reached end of stream,
- * 3 when still looping, or -1 when an error occured.
- * Note that the input stream can still continues when 1 is returned.
+ * @param margin [in] score margin in log likelihood, negative to disable
+ * @param verify [in] TRUE to run the 2nd pass for verification
  * 
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
  */
-static int
-event_recognize_stream_core(Recog *recog)
+void
+event_set_pass1_final(float margin, boolean verify)
+{
+  e_pass1_final_margin = margin;
+  e_pass1_final_verify = verify;
+}
+
+/** 
+ * <EN>
+ * @brief  Delay the real-time 1st pass.
+ *
+ * The 1st pass searches each frame when @a frames more frames are
+ * computed, so that batches of output probabilities ("-obatch") find
+ * them.  The result of the 1st pass is delayed as much (10 msec. per
+ * frame).  Inputs decoded after the end of input ("-norealtime") and
+ * short-pause segmentation are not affected.
+ * </EN>
+ * 
+ * @param frames [in] number of frames, 0 to search each frame at once
+ * 
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+void
+event_set_pass1_lookahead(int frames)
+{
+  e_lookahead = frames;
+}
+
+/** 
+ * <EN>
+ * Compute the lead of the best 1st pass hypothesis over its runner-up.
+ * Only word ends on the last frame that may end a sentence are compared.
+ * </EN>
+ * 
+ * @param r [in] recognition process instance
+ * 
+ * @return the score margin, or LOG_ZERO if the 1st pass result does not
+ * end with the best acceptable word end.
+ */
+static LOGPROB
+pass1_margin(RecogProcess *r)
+{
+  BACKTRELLIS *bt;
+  TRELLIS_ATOM *tre, *best, *second;
+  int t, i;
+
+  bt = r->backtrellis;
+  t = bt->framelen - 1;
+  if (t < 0 || r->result.pass1.word_num == 0) return LOG_ZERO;
+
+  best = second = NULL;
+  for(i=0;i<bt->num[t];i++) {
+    tre = bt->rw[t][i];
+    if (! dfa_cp_end(r->lm->dfa, r->lm->winfo->wton[tre->wid])) continue;
+    if (best == NULL || tre->backscore > best->backscore) {
+      second = best;
+      best = tre;
+    } else if (second == NULL || tre->backscore > second->backscore) {
+      second = tre;
+    }
+  }
+  if (best == NULL) return LOG_ZERO;
+  if (best->wid != r->result.pass1.word[r->result.pass1.word_num - 1]) return LOG_ZERO;
+  /* no other word can end the sentence here */
+  if (second == NULL) return -LOG_ZERO;
+
+  return(best->backscore - second->backscore);
+}
+
+/** 
+ * <EN>
+ * Finalize confident 1st pass results just before the 2nd pass.
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ */
+static void
+pass1_final_check(Recog *recog)
+{
+  RecogProcess *r;
+  LOGPROB margin;
+
+  e_pass1_final_num = 0;
+  if (e_pass1_final_margin < 0.0) return;
+
+  for(r=recog->process_list;r;r=r->next) {
+    if (!r->live) continue;
+    if (r->result.status < 0) continue;
+    if (r->config->compute_only_1pass) continue;
+    if (r->lmtype != LM_DFA || r->lmvar != LM_DFA_GRAMMAR) continue;
+    if (e_pass1_final_num >= PASS1_FINAL_MAX) break;
+    margin = pass1_margin(r);
+    if (margin < e_pass1_final_margin) continue;
+    if (verbose_flag) {
+      jlog("%02d %s: 1st pass result leads by %f, output as final\n", r->config->id, r->config->name, margin);
+    }
+    if (e_pass1_final_verify) {
+      /* tell handling script to emit the 1st pass result right now */
+      EVENT_ASM_ARGS({
+        pass1final(+$0);
+      }, margin);
+    } else {
+      /* prepare result storage */
+      result_sentence_malloc(r, 1);
+      /* copy 1st pass result as final, as "-1pass" does */
+      pass2_finalize_on_no_result(r, TRUE);
+    }
+    e_pass1_final[e_pass1_final_num++] = r;
+    e_pass1_final_taken++;
+  }
+}
+
+/** 
+ * <EN>
+ * Check whether the 2nd pass should be skipped for the current input.
+ * </EN>
+ * 
+ * @param r [in] recognition process instance
+ * 
+ * @return TRUE if the final result is already determined on the 1st pass.
+ */
+static boolean
+skip_pass2(RecogProcess *r)
+{
+  int i;
+
+  if (r->config->compute_only_1pass) return TRUE;
+  if (e_pass1_final_verify) return FALSE;
+  for(i=0;i<e_pass1_final_num;i++) {
+    if (e_pass1_final[i] == r) return TRUE;
+  }
+  return FALSE;
+}
+
+/** 
+ * <EN>
+ * Compare the 2nd pass results with the 1st pass results already
+ * announced as final, and tell the handling script whether they agree.
+ * </EN>
+ * 
+ * @param recog [in] engine instance
+ */
+static void
+pass1_final_verify(Recog *recog)
+{
+  RecogProcess *r;
+  Sentence *s;
+  boolean agree;
+  int i, j;
+
+  if (!e_pass1_final_verify) return;
+
+  for(i=0;i<e_pass1_final_num;i++) {
+    r = e_pass1_final[i];
+    agree = FALSE;
+    if (r->result.status >= 0 && r->result.sentnum > 0) {
+      s = &(r->result.sent[0]);
+      if (s->word_num == r->result.pass1.word_num) {
+	for(j=0;j<s->word_num;j++) {
+	  if (s->word[j] != r->result.pass1.word[j]) break;
+	}
+	if (j == s->word_num) agree = TRUE;
+      }
+    }
+    if (agree) e_pass1_final_agreed++;
+    EVENT_ASM_ARGS({
+      pass1verified(!!$0, $1, $2);
+    }, agree, e_pass1_final_agreed, e_pass1_final_taken);
+  }
+}
+
+/* ---------------------- keyword spotting --------------------------- */
+
+/** 
+ * <EN>
+ * Find the category of the filler words in the grammar of a process.
+ * </EN>
+ * 
+ * @param r [in] recognition process instance
+ * 
+ * @return the category, or -1 if the grammar has no filler word.
+ */
+static int
+spot_filler(RecogProcess *r)
+{
+  WORD_INFO *winfo;
+  WORD_ID w;
+
+  if (r->lmtype != LM_DFA || r->lm->winfo == NULL) return -1;
+  winfo = r->lm->winfo;
+  for(w=0;w<winfo->num;w++) {
+    if (strmatch(winfo->woutput[w], SPOT_FILLER)) return(winfo->wton[w]);
+  }
+  return -1;
+}
+
+/** 
+ * <EN>
+ * Callback at 1st pass start: find the filler category of each spotting
+ * process, as grammars may have changed since the last input.
+ * </EN>
+ * 
+ * @param recog [in] engine instance
+ * @param dummy [in] callback data (unused)
+ */
+static void
+spot_begin(Recog *recog, void *dummy)
+{
+  SpotProcess *sp;
+  int i;
+
+  for(i=0;i<e_spot_num;i++) {
+    sp = &(e_spot[i]);
+    sp->filler = sp->r->live ? spot_filler(sp->r) : -1;
+    sp->seen = NULL;
+    sp->last_end = -1;
+  }
+}
+
+/** 
+ * <EN>
+ * @brief  Callback at each frame of the 1st pass: detect keywords.
+ *
+ * The word ends stored on the trellis since the last frame are
+ * examined.  A keyword ending here is compared with the best filler
+ * path ending at the same frame, and detected when its score per frame
+ * since the keyword began leads by the threshold.  Words starting
+ * before the end of the last detection are taken as the same keyword.
+ * </EN>
+ * 
+ * @param recog [in] engine instance
+ * @param dummy [in] callback data (unused)
+ */
+static void
+spot_frame(Recog *recog, void *dummy)
+{
+  SpotProcess *sp;
+  TRELLIS_ATOM *tre, *best;
+  LOGPROB filler, ratio, best_ratio;
+  WORD_INFO *winfo;
+  float frame_msec;
+  int i, t;
+
+  for(i=0;i<e_spot_num;i++) {
+    sp = &(e_spot[i]);
+    if (!sp->r->live || sp->filler < 0) continue;
+    tre = sp->r->backtrellis->list;
+    if (tre == NULL || tre == sp->seen) continue;
+    winfo = sp->r->lm->winfo;
+    t = tre->endtime;
+
+    /* best filler path ending on this frame */
+    filler = LOG_ZERO;
+    for(tre = sp->r->backtrellis->list; tre && tre != sp->seen; tre = tre->next) {
+      if (tre->endtime != t) continue;
+      if (winfo->wton[tre->wid] == sp->filler && tre->backscore > filler) filler = tre->backscore;
+    }
+    /* best keyword against it */
+    best = NULL;
+    best_ratio = 0.0;
+    if (filler > LOG_ZERO) {
+      for(tre = sp->r->backtrellis->list; tre && tre != sp->seen; tre = tre->next) {
+	if (tre->endtime != t || tre->begintime <= sp->last_end) continue;
+	/* fillers and silences of sentence start and end, as <s> </s> */
+	if (winfo->woutput[tre->wid][0] == '<') continue;
+	ratio = (tre->backscore - filler) / (LOGPROB)(tre->endtime - tre->begintime + 1);
+	if (ratio >= e_spot_threshold && (best == NULL || ratio > best_ratio)) {
+	  best = tre;
+	  best_ratio = ratio;
+	}
+      }
+    }
+    sp->seen = sp->r->backtrellis->list;
+    if (best == NULL) continue;
+
+    sp->last_end = best->endtime;
+    /* the first detection of the wake stage fires the cascade */
+    if (sp->r == e_cascade_wake && e_cascade_stage == 0 && e_cascade_fired < 0) {
+      e_cascade_fired = best->endtime;
+    }
+    frame_msec = (float)recog->jconf->input.period * (float)recog->jconf->input.frameshift / 10000.0;
+    if (verbose_flag) {
+      jlog("%02d %s: spotted \"%s\" at frames %d-%d, ratio %f\n", sp->r->config->id, sp->r->config->name, winfo->woutput[best->wid], best->begintime, best->endtime, best_ratio);
+    }
+    /* tell handling script with times from the utterance start */
+    EVENT_ASM_ARGS({
+      spotted(UTF8ToString($0), $1, $2, $3);
+    }, winfo->woutput[best->wid], best->begintime * frame_msec, (best->endtime + 1) * frame_msec, best_ratio);
+  }
+}
+
+/** 
+ * <EN>
+ * @brief  Set up keyword spotting.
+ *
+ * Grammar processes whose grammar has filler words, as built by
+ * bin/mkspot.js where keywords are embedded in a loop of one-phone
+ * filler words, are spotting.  Keywords are then detected on the 1st
+ * pass as soon as they outscore the fillers by @a threshold per frame,
+ * and the 2nd pass is not run, as "-1pass" does.  Should be called
+ * once after the engine instance is set up.
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ * @param threshold [in] log likelihood ratio per frame
+ * 
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+void
+event_spot_setup(Recog *recog, float threshold)
+{
+  RecogProcess *r;
+
+  e_spot_threshold = threshold;
+  e_spot_num = 0;
+  for(r=recog->process_list;r;r=r->next) {
+    if (spot_filler(r) < 0) continue;
+    if (e_spot_num >= SPOT_MAX) {
+      jlog("WARNING: spotting on the first %d grammar processes only\n", SPOT_MAX);
+      break;
+    }
+    /* detections are made on the 1st pass */
+    r->config->compute_only_1pass = TRUE;
+    e_spot[e_spot_num].r = r;
+    e_spot[e_spot_num].filler = -1;
+    e_spot_num++;
+  }
+  if (e_spot_num == 0) {
+    jlog("WARNING: no grammar has filler words \"%s\", spotting disabled\n", SPOT_FILLER);
+    return;
+  }
+  callback_add(recog, CALLBACK_EVENT_PASS1_BEGIN, spot_begin, NULL);
+  callback_add(recog, CALLBACK_EVENT_PASS1_FRAME, spot_frame, NULL);
+}
+
+/* ---------------------- wake-word cascade -------------------------- */
+
+/** 
+ * <EN>
+ * Switch the cascade to a stage.  The process status changes are
+ * applied at the start of the next input, as "-SR" (de)activation.
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ * @param stage [in] 0 for the wake stage, 1 for the main stage
+ */
+static void
+cascade_switch(Recog *recog, int stage)
+{
+  RecogProcess *r;
+
+  for(r=recog->process_list;r;r=r->next) {
+    if (r == e_cascade_wake) r->active = stage ? -1 : 1;
+    else r->active = stage ? 1 : -1;
+  }
+  e_cascade_stage = stage;
+  jlog("STAT: cascade: %s stage\n", stage ? "main" : "wake");
+  EVENT_ASM_ARGS({
+    cascade($0);
+  }, stage);
+}
+
+/** 
+ * <EN>
+ * Callback at speech trigger: start storing the input of the wake stage.
+ * </EN>
+ * 
+ * @param recog [in] engine instance
+ * @param dummy [in] callback data (unused)
+ */
+static void
+cascade_speech_start(Recog *recog, void *dummy)
+{
+  e_cascade_len = 0;
+  e_cascade_fired = -1;
+}
+
+/** 
+ * <EN>
+ * Callback on triggered samples: store them on the wake stage, to give
+ * the main stage what follows the wake phrase.
+ * </EN>
+ * 
+ * @param recog [in] engine instance
+ * @param buf [in] triggered samples
+ * @param len [in] number of samples
+ * @param dummy [in] callback data (unused)
+ */
+static void
+cascade_store(Recog *recog, SP16 *buf, int len, void *dummy)
+{
+  if (e_cascade_stage != 0) return;
+  if (e_cascade_len + len > e_cascade_alloc) {
+    e_cascade_alloc = (e_cascade_len + len) * 2;
+    e_cascade_speech = (SP16 *)myrealloc(e_cascade_speech, sizeof(SP16) * e_cascade_alloc);
+  }
+  memcpy(&(e_cascade_speech[e_cascade_len]), buf, sizeof(SP16) * len);
+  e_cascade_len += len;
+}
+
+/** 
+ * <EN>
+ * @brief  Callback after the results of an input: switch stages.
+ *
+ * On the wake stage, a keyword detected by a spotting grammar, or else
+ * any successful result, fires the main stage.  The samples after the
+ * end of the wake phrase are put back to the input, so that a command
+ * said in the same breath is recognized by the main stage.  On the main
+ * stage, the wake stage is back after one input, or after the given
+ * time.
+ * </EN>
+ * 
+ * @param recog [in] engine instance
+ * @param dummy [in] callback data (unused)
+ */
+static void
+cascade_result(Recog *recog, void *dummy)
+{
+  RecogProcess *r;
+  boolean spotting;
+  int i, start;
+
+  r = e_cascade_wake;
+  if (e_cascade_stage == 0) {
+    if (!r->live) return;
+    spotting = FALSE;
+    for(i=0;i<e_spot_num;i++) {
+      if (e_spot[i].r == r) spotting = TRUE;
+    }
+    if (!spotting && e_cascade_fired < 0 && r->result.status >= 0 && r->result.sentnum > 0) {
+      /* the whole input was the wake phrase */
+      e_cascade_fired = e_cascade_len / recog->jconf->input.frameshift;
+    }
+    if (e_cascade_fired < 0) return;
+    start = (e_cascade_fired + 1) * recog->jconf->input.frameshift;
+#ifdef USE_WEBAUDIO
+    if (start < e_cascade_len) {
+      adin_mic_replay(&(e_cascade_speech[start]), e_cascade_len - start);
+    }
+#endif
+    e_cascade_until = emscripten_get_now() + e_cascade_sec * 1000.0;
+    cascade_switch(recog, 1);
+  } else {
+    if (e_cascade_sec <= 0.0 || emscripten_get_now() >= e_cascade_until) {
+      cascade_switch(recog, 0);
+    }
+  }
+}
+
+/** 
+ * <EN>
+ * Callback polled while waiting for input: end the main stage after its
+ * time, and break waiting so that process changes are applied, as
+ * grammar changes are.  An input in progress is finished first.
+ * </EN>
+ * 
+ * @param recog [in] engine instance
+ * @param dummy [in] callback data (unused)
+ */
+static void
+cascade_poll(Recog *recog, void *dummy)
+{
+  if (e_cascade_stage == 1 && e_cascade_sec > 0.0 && emscripten_get_now() >= e_cascade_until) {
+    cascade_switch(recog, 0);
+  }
+  if (e_cascade_wake->active != 0) recog->process_want_reload = TRUE;
+}
+
+/** 
+ * <EN>
+ * @brief  Set up a two-stage wake-word cascade.
+ *
+ * The recognition process named @a wake (given by "-SR", typically with
+ * a tiny or spotting grammar and a narrow beam) runs alone until it
+ * hears the wake phrase.  All the other processes then run, for one
+ * input if @a sec is 0, or until @a sec seconds have passed, and the
+ * wake stage is back.  Processes may share an acoustic model instance.
+ * Should be called once after the engine instance is set up, after
+ * result output callbacks are registered.
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ * @param wake [in] name of the process of the wake stage
+ * @param sec [in] length of the main stage in seconds, 0 for one input
+ * 
+ * @return TRUE on success, FALSE if no such process, or it is alone.
+ * 
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+boolean
+event_cascade_setup(Recog *recog, char *wake, float sec)
+{
+  RecogProcess *r;
+
+  e_cascade_wake = NULL;
+  for(r=recog->process_list;r;r=r->next) {
+    if (strmatch(r->config->name, wake)) e_cascade_wake = r;
+  }
+  if (e_cascade_wake == NULL) {
+    jlog("ERROR: cascade: no recognition process named \"%s\"\n", wake);
+    return FALSE;
+  }
+  if (recog->process_list->next == NULL) {
+    jlog("ERROR: cascade: needs another recognition process for the main stage\n");
+    return FALSE;
+  }
+  e_cascade_sec = sec;
+  /* start on the wake stage */
+  for(r=recog->process_list;r;r=r->next) {
+    r->active = (r == e_cascade_wake) ? 1 : -1;
+  }
+  e_cascade_stage = 0;
+  callback_add(recog, CALLBACK_EVENT_SPEECH_START, cascade_speech_start, NULL);
+  callback_add_adin(recog, CALLBACK_ADIN_TRIGGERED, cascade_store, NULL);
+  callback_add(recog, CALLBACK_RESULT, cascade_result, NULL);
+  callback_add(recog, CALLBACK_POLL, cascade_poll, NULL);
+  return TRUE;
+}
+
+/** 
+ * <EN>
+ * Callback polled while waiting for input: break waiting once slots
+ * have changed, so that the lexicon is rebuilt before the next input.
+ * An input in progress is finished first.
+ * </EN>
+ * 
+ * @param recog [in] engine instance
+ * @param dummy [in] callback data (unused)
+ */
+static void
+slot_poll(Recog *recog, void *dummy)
+{
+  if (e_slot_pending) {
+    recog->process_want_reload = TRUE;
+    e_slot_pending = FALSE;
+  }
+}
+
+/** 
+ * <EN>
+ * Tell the handling script that the lexicons were rebuilt with the slot
+ * changes, and how long it took from the merge of the dictionaries
+ * until all live processes were rebuilt.
+ * </EN>
+ * 
+ * @param words [in] words of the lexicons rebuilt
+ */
+static void
+slot_built(int words)
+{
+  double msec;
+
+  if (e_slot_changes == 0) return;
+  msec = emscripten_get_now() - e_slot_build;
+  jlog("STAT: slot: %d words changed, lexicon of %d words rebuilt in %.1f ms\n", e_slot_changes, words, msec);
+  EVENT_ASM_ARGS({
+    slotsApplied($0, $1, $2);
+  }, e_slot_changes, words, msec);
+  e_slot_changes = 0;
+}
+
+/** 
+ * <EN>
+ * Tell the handling script that the lexicons were rebuilt with the
+ * grammar given by event_grammar_use(), and how long it took.
+ * </EN>
+ * 
+ * @param words [in] words of the lexicons rebuilt
+ */
+static void
+grammar_built(int words)
+{
+  double msec;
+
+  if (!e_slot_grammar) return;
+  msec = emscripten_get_now() - e_slot_build;
+  jlog("STAT: grammar: lexicon of %d words built in %.1f ms\n", words, msec);
+  EVENT_ASM_ARGS({
+    grammarApplied($0, $1);
+  }, words, msec);
+  e_slot_grammar = FALSE;
+}
+
+/** 
+ * <EN>
+ * Split a dictionary line into its category and output string, in
+ * place; the pronunciation is ignored.
+ * </EN>
+ * 
+ * @param line [i/o] dictionary line, e.g. "5 [JOHN] jh aa n"
+ * @param name [out] category ID as written
+ * @param output [out] output string
+ * 
+ * @return TRUE on success, FALSE if the line has no category or output.
+ */
+static boolean
+slot_parse(char *line, char **name, char **output)
+{
+  char *p;
+
+  p = line;
+  while (*p == ' ' || *p == '\t') p++;
+  if (*p < '0' || *p > '9') return FALSE;
+  *name = p;
+  while (*p >= '0' && *p <= '9') p++;
+  if (*p != ' ' && *p != '\t') return FALSE;
+  *p++ = '\0';
+  while (*p == ' ' || *p == '\t') p++;
+  if (*p != '[') return FALSE;
+  *output = ++p;
+  while (*p != '\0' && *p != ']') p++;
+  if (*p != ']') return FALSE;
+  *p = '\0';
+  return TRUE;
+}
+
+/** 
+ * <EN>
+ * Add the words of dictionary lines to a grammar, which must have their
+ * categories.
+ * </EN>
+ * 
+ * @param r [in] recognition process of the grammar
+ * @param m [i/o] grammar
+ * @param lines [i/o] dictionary lines, modified
+ * 
+ * @return the number of words added, or -1 on error.
+ */
+static int
+slot_add(RecogProcess *r, MULTIGRAM *m, char *lines)
+{
+  HTK_HMM_INFO *hmminfo;
+  WORD_INFO *words;
+  char *line, *next;
+  boolean ok;
+  int w, num;
+
+  hmminfo = r->am->hmminfo;
+  words = word_info_new();
+  voca_load_start(words, hmminfo, FALSE);
+  ok = TRUE;
+  for(line = lines; line; line = next) {
+    if ((next = strchr(line, '\n')) != NULL) *next++ = '\0';
+    if (line[0] == '\0') continue;
+    if (line[0] < '0' || line[0] > '9') {
+      jlog("ERROR: slot: no category in \"%s\"\n", line);
+      ok = FALSE;
+      continue;
+    }
+    if (voca_load_line(line, words, hmminfo) == FALSE) ok = FALSE;
+  }
+  if (voca_load_end(words) == FALSE) ok = FALSE;
+  for(w=0;w<words->num;w++) {
+    if (atoi(words->wname[w]) >= m->dfa->term_num) {
+      jlog("ERROR: slot: no category %s in grammar \"%s\"\n", words->wname[w], m->name);
+      ok = FALSE;
+    }
+  }
+  if (ok && words->num > 0) ok = multigram_add_words_to_grammar(r->lm, m, words);
+  num = ok ? words->num : -1;
+  word_info_free(words);
+  return(num);
+}
+
+/** 
+ * <EN>
+ * @brief  Remove the words of dictionary lines from a grammar.
+ *
+ * Words are matched by category and output string, so all their
+ * pronunciations are removed.  The dictionary of the grammar is made
+ * again from the words kept, whose phones are already converted.
+ * </EN>
+ * 
+ * @param r [in] recognition process of the grammar
+ * @param m [i/o] grammar
+ * @param lines [i/o] dictionary lines, modified
+ * 
+ * @return the number of words removed, or -1 on error.
+ */
+static int
+slot_remove(RecogProcess *r, MULTIGRAM *m, char *lines)
+{
+  HTK_HMM_INFO *hmminfo;
+  WORD_INFO *winfo, *kept;
+  boolean *gone;
+  char *line, *next, *name, *output, *buf, *p;
+  int w, j, len, maxlen, num;
+
+  hmminfo = r->am->hmminfo;
+  winfo = m->winfo;
+  gone = (boolean *)mymalloc(sizeof(boolean) * winfo->num);
+  for(w=0;w<winfo->num;w++) gone[w] = FALSE;
+  num = 0;
+  for(line = lines; line; line = next) {
+    if ((next = strchr(line, '\n')) != NULL) *next++ = '\0';
+    if (line[0] == '\0') continue;
+    if (slot_parse(line, &name, &output) == FALSE) {
+      jlog("ERROR: slot: no category or output string in \"%s\"\n", line);
+      free(gone);
+      return(-1);
+    }
+    for(w=0;w<winfo->num;w++) {
+      if (!gone[w] && strmatch(winfo->wname[w], name) && strmatch(winfo->woutput[w], output)) {
+	gone[w] = TRUE;
+	num++;
+      }
+    }
+  }
+  if (num == 0) {
+    free(gone);
+    return(0);
+  }
+
+  maxlen = 0;
+  for(w=0;w<winfo->num;w++) {
+    len = strlen(winfo->wname[w]) + strlen(winfo->woutput[w]) + 5;
+    for(j=0;j<winfo->wlen[w];j++) len += strlen(winfo->wseq[w][j]->name) + 1;
+    if (maxlen < len) maxlen = len;
+  }
+  buf = (char *)mymalloc(maxlen);
+  kept = word_info_new();
+  voca_load_start(kept, hmminfo, TRUE);
+  for(w=0;w<winfo->num;w++) {
+    if (gone[w]) continue;
+    p = buf + sprintf(buf, "%s\t[%s]\t", winfo->wname[w], winfo->woutput[w]);
+    for(j=0;j<winfo->wlen[w];j++) {
+      p += sprintf(p, "%s%s", j ? " " : "", winfo->wseq[w][j]->name);
+    }
+    voca_load_line(buf, kept, hmminfo);
+  }
+  free(buf);
+  free(gone);
+  if (voca_load_end(kept) == FALSE) {
+    jlog("ERROR: slot: failed to remove words from grammar \"%s\"\n", m->name);
+    word_info_free(kept);
+    return(-1);
+  }
+
+  word_info_free(m->winfo);
+  m->winfo = kept;
+  free_terminfo(&(m->dfa->term_info));
+  make_dfa_voca_ref(m->dfa, m->winfo);
+  m->hook |= MULTIGRAM_MODIFIED;
+  return(num);
+}
+
+/** 
+ * <EN>
+ * @brief  Add words to categories of the loaded grammar, or remove them.
+ *
+ * @a lines are lines of a dictionary (as made by mkdfa.pl, e.g. "5
+ * [JOHN] jh aa n"), whose categories are terminals of the grammar.
+ * The change takes effect at the next input: waiting for input is
+ * broken, the lexicon tree is rebuilt from the grammars, and
+ * "slotsApplied()" of the handling script is called with the number of
+ * words changed, the number of words in the lexicon and the time the
+ * rebuild took.  Changes made meanwhile are applied together.
+ *
+ * The grammar is the first one of the first process using a grammar;
+ * with a cascade, of the main stage.
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ * @param lines [i/o] dictionary lines separated by newlines, modified
+ * @param remove [in] TRUE to remove the words, FALSE to add them
+ * 
+ * @return the number of words added or removed, or -1 on error.
+ * 
+ * @callgraph
+ * @callergraph
+ * @ingroup grammar
+ */
+int
+event_slot_words(Recog *recog, char *lines, boolean remove)
+{
+  RecogProcess *r;
+  int num;
+
+  for(r=recog->process_list;r;r=r->next) {
+    if (r->lmtype == LM_DFA && r != e_cascade_wake) break;
+  }
+  if (r == NULL || r->lm->grammars == NULL) {
+    jlog("ERROR: slot: no grammar to change\n");
+    return(-1);
+  }
+  num = remove ? slot_remove(r, r->lm->grammars, lines) : slot_add(r, r->lm->grammars, lines);
+  if (num > 0) {
+    if (!e_slot_polling) {
+      callback_add(recog, CALLBACK_POLL, slot_poll, NULL);
+      e_slot_polling = TRUE;
+    }
+    e_slot_pending = TRUE;
+    e_slot_changes += num;
+  }
+  return(num);
+}
+
+/** 
+ * <EN>
+ * @brief  Replace the grammars with another one.
+ *
+ * The grammar and dictionary files are read now; the change takes
+ * effect at the next input, as with event_slot_words(): waiting for
+ * input is broken, the lexicon tree is built for the new grammar (or
+ * read back from "-lexcache", see event_lexicon.c), and
+ * "grammarApplied()" of the handling script is called with the number
+ * of words in the lexicon and the time it took.
+ *
+ * The grammars replaced are those of the first process using a grammar;
+ * with a cascade, of the main stage.  They are marked for deletion only
+ * once the new one is added, so that a failure leaves them in use.
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ * @param name [in] name of the grammar
+ * @param dfafile [in] grammar file
+ * @param dictfile [in] dictionary file
+ * 
+ * @return the number of words of the grammar, or -1 on error.
+ * 
+ * @callgraph
+ * @callergraph
+ * @ingroup grammar
+ */
+int
+event_grammar_use(Recog *recog, char *name, char *dfafile, char *dictfile)
+{
+  RecogProcess *r;
+  DFA_INFO *dfa;
+  WORD_INFO *winfo;
+  MULTIGRAM *m;
+  int gid;
+
+  for(r=recog->process_list;r;r=r->next) {
+    if (r->lmtype == LM_DFA && r != e_cascade_wake) break;
+  }
+  if (r == NULL || r->lmvar != LM_DFA_GRAMMAR) {
+    jlog("ERROR: grammar: no grammar to replace\n");
+    return(-1);
+  }
+  dfa = dfa_info_new();
+  if (init_dfa(dfa, dfafile) == FALSE) {
+    jlog("ERROR: grammar: failed to read grammar \"%s\"\n", dfafile);
+    dfa_info_free(dfa);
+    return(-1);
+  }
+  winfo = word_info_new();
+  if (init_voca(winfo, dictfile, r->am->hmminfo, FALSE, FALSE) == FALSE) {
+    jlog("ERROR: grammar: failed to read dictionary \"%s\"\n", dictfile);
+    word_info_free(winfo);
+    dfa_info_free(dfa);
+    return(-1);
+  }
+  gid = multigram_add(dfa, winfo, name, r->lm);
+  if (gid < 0) {
+    jlog("ERROR: grammar: failed to add grammar \"%s\"\n", name);
+    word_info_free(winfo);
+    dfa_info_free(dfa);
+    return(-1);
+  }
+  for(m=r->lm->grammars;m;m=m->next) {
+    if (m->id != gid) multigram_delete(m->id, r->lm);
+  }
+  if (!e_slot_polling) {
+    callback_add(recog, CALLBACK_POLL, slot_poll, NULL);
+    e_slot_polling = TRUE;
+  }
+  e_slot_pending = TRUE;
+  e_slot_grammar = TRUE;
+  return(winfo->num);
+}
+
+/** 
+ * <EN>
+ * Callback at speech trigger: start decoding time of an utterance.
+ * </EN>
+ * 
+ * @param recog [in] engine instance
+ * @param dummy [in] callback data (unused)
+ */
+static void
+gauge_speech_start(Recog *recog, void *dummy)
+{
+  e_gauge_speech = TRUE;
+  e_gauge_cpu = 0.0;
+  e_gauge_tick = emscripten_get_now();
+  e_gauge_speech_end = -1.0;
+  e_gauge_pass1 = -1.0;
+}
+
+/** 
+ * <EN>
+ * Callback at speech end: latencies are measured from here.
+ * </EN>
+ * 
+ * @param recog [in] engine instance
+ * @param dummy [in] callback data (unused)
+ */
+static void
+gauge_speech_stop(Recog *recog, void *dummy)
+{
+  if (e_gauge_speech_end < 0.0) e_gauge_speech_end = emscripten_get_now();
+}
+
+/** 
+ * <EN>
+ * Register callbacks to measure per-utterance gauges.  Should be called
+ * once after the engine instance is set up.
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ * 
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+void
+event_gauge_setup(Recog *recog)
+{
+  callback_add(recog, CALLBACK_EVENT_SPEECH_START, gauge_speech_start, NULL);
+  callback_add(recog, CALLBACK_EVENT_SPEECH_STOP, gauge_speech_stop, NULL);
+}
+
+/** 
+ * <EN>
+ * @brief  Hand the gauges of the current utterance to the handling script.
+ *
+ * Called just before a result is output, so that the script can attach
+ * them to the result: audio duration (from last_trigger_len), decoding
+ * time, real-time factor, and the latencies from the detected speech
+ * end to the 1st pass and final results.  All times are in msec., and
+ * latencies not known yet are negative.
+ * </EN>
+ * 
+ * @param recog [in] engine instance
+ * @param final [in] TRUE for the final result, FALSE for the 1st pass
+ */
+static void
+gauge_emit(Recog *recog, boolean final)
+{
+  Jconf *jconf;
+  double now, audio, cpu, latency;
+
+  if (! e_gauge_speech) return;
+
+  jconf = recog->jconf;
+  now = emscripten_get_now();
+
+  if (recog->adin != NULL && recog->adin->last_trigger_len > 0) {
+    audio = (double)recog->adin->last_trigger_len * 1000.0 / (double)jconf->input.sfreq;
+  } else {
+    audio = (double)recog->mfcclist->param->samplenum * (double)jconf->input.period * (double)jconf->input.frameshift / 10000.0;
+  }
+  cpu = e_gauge_cpu + (now - e_gauge_tick);
+  latency = (e_gauge_speech_end < 0.0) ? -1.0 : now - e_gauge_speech_end;
+  if (! final) e_gauge_pass1 = latency;
+
+  EVENT_ASM_ARGS({
+    gauges($0, $1, $2, $3, $4);
+  }, audio, cpu, (audio > 0.0) ? cpu / audio : 0.0, e_gauge_pass1, final ? latency : -1.0);
+}
+
+/** 
+ * <EN>
+ * @brief  Execute event-based recognition.
+ *
+ * This function mimics the functionality of j_recognize_stream_core,
+ * but simulates multithreading using JavaScript eventing. This is done
+ * for use with Web Audio, so that new audio samples can be made
+ * available (through `processaudio` events) during the otherwise
+ * blocking recognition loop.
+ *
+ * See j_recognize_stream_core for a more detailed summary.
+ * 
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ * 
+ * @return 1 when stopped by application request, 0 when reached end of stream,
+ * 3 when still looping, or -1 when an error occured.
+ * Note that the input stream can still continues when 1 is returned.
+ * 
+ */
+static int
+event_recognize_stream_core(Recog *recog)
 {
   Jconf *jconf;
   int ret;
@@ -1608,6 +3201,7 @@ event_recognize_stream_core(Recog *recog)
   boolean process_segment_last;
   boolean on_the_fly;
   boolean pass2_p;
+  int lexicon_words;		/* words of the lexicons rebuilt */
 
   jconf = recog->jconf;
 
@@ -1679,6 +3273,9 @@ event_recognize_stream_core(Recog *recog)
     
   start_recog:
 
+    /* release sentence storage of the last input */
+    sentence_storage_reset();
+
     /*************************************/
     /* Update recognition process status */
     /*************************************/
@@ -1738,17 +3335,22 @@ event_recognize_stream_core(Recog *recog)
     /*********************************************************/
     /* check for grammar to change, and rebuild if necessary */
     /*********************************************************/
+    e_slot_build = emscripten_get_now();
     for(lm=recog->lmlist;lm;lm=lm->next) {
       if (lm->lmtype == LM_DFA) {
   multigram_update(lm); /* some modification occured if return TRUE*/
       }
     }
+    lexicon_words = 0;
     for(r=recog->process_list;r;r=r->next) {
       if (!r->live) continue;
       if (r->lmtype == LM_DFA && r->lm->global_modified) {
   multigram_build(r);
+  lexicon_words += r->lm->winfo->num;
       }
     }
+    slot_built(lexicon_words);
+    grammar_built(lexicon_words);
     for(lm=recog->lmlist;lm;lm=lm->next) {
       if (lm->lmtype == LM_DFA) lm->global_modified = FALSE;
     }
@@ -1793,7 +3395,9 @@ event_recognize_stream_core(Recog *recog)
   /* the margin segment in the last input will be re-processed first,
      and then the speech input will be processed */
   /* process the last remaining parameters */
+  TRACE_BEGIN(TRACE_PASS1);
   ret = RealTimeResume(recog);
+  TRACE_END(TRACE_PASS1);
   if (ret < 0) {    /* error end in the margin */
     jlog("ERROR: failed to process last remaining samples on RealTimeResume\n"); /* exit now! */
     return -1;
@@ -1804,7 +3408,9 @@ event_recognize_stream_core(Recog *recog)
     /* process the incoming input */
     if (jconf->input.type == INPUT_WAVEFORM) {
       /* get speech and process it on real-time */
-      ret = adin_go(RealTimePipeLine, callback_check_in_adin, recog);
+      TRACE_BEGIN(TRACE_ADIN);
+      ret = adin_go(EVENT_PIPELINE, callback_check_in_adin, recog);
+      TRACE_END(TRACE_ADIN);
     } else {
       /* get feature vector and process it */
       ret = mfcc_go(recog, callback_check_in_adin);
@@ -1847,7 +3453,9 @@ process_incoming:
   /* process the incoming input */
   if (jconf->input.type == INPUT_WAVEFORM) {
     /* get speech and process it on real-time */
-    ret = adin_go(RealTimePipeLine, callback_check_in_adin, recog);
+    TRACE_BEGIN(TRACE_ADIN);
+    ret = adin_go(EVENT_PIPELINE, callback_check_in_adin, recog);
+    TRACE_END(TRACE_ADIN);
   } else {
     /* get feature vector and process it */
     ret = mfcc_go(recog, callback_check_in_adin);
@@ -1891,7 +3499,10 @@ process_incoming:
 #endif
       }
       /* last procedure of 1st-pass */
-      if (RealTimeParam(recog) == FALSE) {
+      TRACE_BEGIN(TRACE_PASS1);
+      ok_p = RealTimeParam(recog);
+      TRACE_END(TRACE_PASS1);
+      if (ok_p == FALSE) {
   jlog("ERROR: fatal error occured, program terminates now\n");
   return -1;
       }
@@ -1911,6 +3522,7 @@ process_incoming:
 
       /* execute callback for 1st pass result */
       /* result.status <0 must be skipped inside callback */
+      gauge_emit(recog, FALSE);
       callback_exec(CALLBACK_RESULT_PASS1, recog);
 #ifdef WORD_GRAPH
       /* result.wg1 == NULL should be skipped inside callback */
@@ -1988,7 +3600,9 @@ process_incoming:
     /* end of this input will be determined by either end of stream
        (in case of file input), or silence detection by adin_go(), or
        'TERMINATE' command from module (if module mode) */
+    TRACE_BEGIN(TRACE_ADIN);
     ret = adin_go(adin_cut_callback_store_buffer, callback_check_in_adin, recog);
+    TRACE_END(TRACE_ADIN);
     if (ret < 0) {    /* error end in adin_go */
       if (ret == -2 || recog->process_want_terminate) {
         /* terminated by module */
@@ -2072,7 +3686,10 @@ process_incoming:
       }
     
       /* execute computation of left-to-right backtrellis */
-      if (get_back_trellis(recog) == FALSE) {
+      TRACE_BEGIN(TRACE_PASS1);
+      ok_p = get_back_trellis(recog);
+      TRACE_END(TRACE_PASS1);
+      if (ok_p == FALSE) {
   jlog("ERROR: fatal error occured, program terminates now\n");
   return -1;
       }
@@ -2085,6 +3702,7 @@ process_incoming:
       
       /* execute callback for 1st pass result */
       /* result.status <0 must be skipped inside callback */
+      gauge_emit(recog, FALSE);
       callback_exec(CALLBACK_RESULT_PASS1, recog);
 #ifdef WORD_GRAPH
       /* result.wg1 == NULL should be skipped inside callback */
@@ -2184,6 +3802,10 @@ process_incoming:
       }
     }
 
+    /* for confident grammar results, output 1st pass result as final */
+    /* they will be skipped in the next pass */
+    pass1_final_check(recog);
+
     /***********************************************/
     /* 2nd-pass --- forward search with heuristics */
     /***********************************************/
@@ -2191,7 +3813,7 @@ process_incoming:
     for(r=recog->process_list;r;r=r->next) {
       if (!r->live) continue;
       /* if [-1pass] is specified, skip 2nd pass */
-      if (r->config->compute_only_1pass) continue;
+      if (skip_pass2(r)) continue;
       /* if search already failed on 1st pass, skip 2nd pass */
       if (r->result.status < 0) continue;
       pass2_p = TRUE;
@@ -2203,7 +3825,7 @@ process_incoming:
     for(r=recog->process_list;r;r=r->next) {
       if (!r->live) continue;
       /* if [-1pass] is specified, skip 2nd pass */
-      if (r->config->compute_only_1pass) continue;
+      if (skip_pass2(r)) continue;
       /* if search already failed on 1st pass, skip 2nd pass */
       if (r->result.status < 0) continue;
       if (! r->am->hmminfo->multipath) {
@@ -2218,42 +3840,24 @@ process_incoming:
 #endif
     
     /* execute stack-decoding search */
+    TRACE_BEGIN(TRACE_PASS2);
     for(r=recog->process_list;r;r=r->next) {
-      if (!r->live) continue;
-      /* if [-1pass] is specified, just copy from 1st pass result */
-      if (r->config->compute_only_1pass) continue;
-      /* if search already failed on 1st pass, skip 2nd pass */
-      if (r->result.status < 0) continue;
-      /* prepare result storage */
+      if (!pass2_wanted(r)) continue;
+      /* prepare result storage (serially, as it shares a block) */
       if (r->lmtype == LM_DFA && r->config->output.multigramout_flag) {
   result_sentence_malloc(r, r->config->output.output_hypo_maxnum * multigram_get_all_num(r->lm));
       } else {
   result_sentence_malloc(r, r->config->output.output_hypo_maxnum);
       }
-      /* do 2nd pass */
-      if (r->lmtype == LM_PROB) {
-  wchmm_fbs(r->am->mfcc->param, r, 0, 0);
-      } else if (r->lmtype == LM_DFA) {
-  if (r->config->output.multigramout_flag) {
-    /* execute 2nd pass multiple times for each grammar sequencially */
-    /* to output result for each grammar */
-    MULTIGRAM *m;
-    boolean has_success = FALSE;
-    for(m = r->lm->grammars; m; m = m->next) {
-      if (m->active) {
-        jlog("STAT: execute 2nd pass limiting words for gram #%d\n", m->id);
-        wchmm_fbs(r->am->mfcc->param, r, m->cate_begin, m->dfa->term_num);
-        if (r->result.status == J_RESULT_STATUS_SUCCESS) {
-    has_success = TRUE;
-        }
-      }
     }
-    r->result.status = (has_success == TRUE) ? J_RESULT_STATUS_SUCCESS : J_RESULT_STATUS_FAIL;
-  } else {
-    /* only the best among all grammar will be output */
-    wchmm_fbs(r->am->mfcc->param, r, 0, r->lm->dfa->term_num);
-  }
-      }
+#ifdef HAVE_PTHREAD
+    /* processes of different acoustic models search on threads */
+    if (pass2_parallel(recog) == FALSE)
+#endif
+    for(r=recog->process_list;r;r=r->next) {
+      if (!pass2_wanted(r)) continue;
+      /* do 2nd pass */
+      pass2_process(r);
     }
 
     /* do forced alignment if needed */
@@ -2264,8 +3868,13 @@ process_incoming:
       /* do needed alignment */
       do_alignment_all(r, r->am->mfcc->param);
     }
+    TRACE_END(TRACE_PASS2);
+
+    /* tell whether the 2nd pass agrees with the early results */
+    pass1_final_verify(recog);
 
     /* output result */
+    gauge_emit(recog, TRUE);
     callback_exec(CALLBACK_RESULT, recog);
 #ifdef ENABLE_PLUGIN
     plugin_exec_process_result(recog);
@@ -2275,7 +3884,7 @@ process_incoming:
     ok_p = FALSE;
     for(r=recog->process_list;r;r=r->next) {
       if (!r->live) continue;
-      if (r->config->compute_only_1pass) continue;
+      if (skip_pass2(r)) continue;
       if (r->result.status < 0) continue;
       if (r->config->graph.lattice) ok_p = TRUE;
     }
@@ -2285,7 +3894,7 @@ process_incoming:
     ok_p = FALSE;
     for(r=recog->process_list;r;r=r->next) {
       if (!r->live) continue;
-      if (r->config->compute_only_1pass) continue;
+      if (skip_pass2(r)) continue;
       if (r->result.status < 0) continue;
       if (r->config->graph.confnet) ok_p = TRUE;
     }
@@ -2312,6 +3921,12 @@ process_incoming:
     /* end of recognition */
     /**********************/
 
+    e_input_num++;
+    e_gauge_speech = FALSE;
+    TRACE_INPUT_END();
+
+    e_pass1_final_num = 0;
+
     /* update CMN info for next input (in case of realtime wave input) */
     if (jconf->input.type == INPUT_WAVEFORM && jconf->decodeopt.realtime_flag) {
       for(mfcc=recog->mfcclist;mfcc;mfcc=mfcc->next) {
@@ -2389,29 +4004,24 @@ process_incoming:
 
 /** 
  * <EN>
- * @brief  Recognize an event-based input stream.
- *
- * This function mimics the functionality of j_recognize_stream,
- * but simulates multithreading using JavaScript eventing. This is done
- * for use with Web Audio, so that new audio samples can be made
- * available (through `processaudio` events) during the otherwise
- * blocking recognition loop.
- *
- * See j_recognize_stream for a more detailed summary.
+ * Run one step of event_recognize_stream_core(), timed for the gauges,
+ * and the pause callbacks when it paused.
  * </EN>
  * 
  * @param recog [i/o] engine instance
  * 
- * @callgraph
- * @callergraph
- * @ingroup engine
+ * @return as event_recognize_stream_core().
  */
-void
-event_recognize_stream(Recog *recog)
+static int
+event_recognize_step(Recog *recog)
 {
   int ret;
     
+  e_gauge_tick = emscripten_get_now();
+  TRACE_BEGIN(TRACE_TICK);
   ret = event_recognize_stream_core(recog);
+  TRACE_END(TRACE_TICK);
+  if (e_gauge_speech) e_gauge_cpu += emscripten_get_now() - e_gauge_tick;
 
   switch(ret) {
   case 1:       /* paused by a callback (stream will continue) */
@@ -2428,20 +4038,152 @@ jlog("WARNING: engine will resume now immediately\n");
     /* call resume event callbacks */
     callback_exec(CALLBACK_EVENT_RESUME, recog);
     e_running = 0;
-  case 3:
-    EM_ASM_ARGS({
-      setTimeout(Module.cwrap('event_recognize_stream', 'number', ['number']).bind(null, $0), 0);
-    }, recog);
     break;
   case 0:     /* end of stream */
     e_running = 0;
+    break;
+  }
+  return(ret);
+}
+
+/**
+ * <EN>
+ * Task of the scheduler running a step of event_recognize_stream().
+ * </EN>
+ *
+ * @param recog [i/o] engine instance
+ */
+static void
+recognize_task(void *recog)
+{
+  event_recognize_stream((Recog *)recog);
+}
+
+/** 
+ * <EN>
+ * @brief  Recognize an event-based input stream.
+ *
+ * This function mimics the functionality of j_recognize_stream,
+ * but simulates multithreading using JavaScript eventing. This is done
+ * for use with Web Audio, so that new audio samples can be made
+ * available (through `processaudio` events) during the otherwise
+ * blocking recognition loop.
+ *
+ * See j_recognize_stream for a more detailed summary.
+ *
+ * Each call runs one step, and posts the next one (or the opening of
+ * the next input stream) to the scheduler (see event_sched.c).  When
+ * samples are read from memory (see adin_mic_decode()), nothing is
+ * waited for: steps run in a row for OFFLINE_SLICE_MSEC, and the next
+ * ones are posted with event_sched_post_fast(), so that other events
+ * are still handled.
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ * 
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+void
+event_recognize_stream(Recog *recog)
+{
+  int ret;
+#if defined(USE_WEBAUDIO) && !defined(HAVE_PTHREAD)
+  double start;
+
+  start = emscripten_get_now();
+  do {
+    ret = event_recognize_step(recog);
+  } while((ret == 1 || ret == 3) && adin_mic_offline()
+	  && emscripten_get_now() - start < OFFLINE_SLICE_MSEC);
+  if ((ret == 1 || ret == 3) && adin_mic_offline()) {
+    event_sched_post_fast(recognize_task, recog);
+    return;
+  }
+#else
+  ret = event_recognize_step(recog);
+#endif
+
+  switch(ret) {
+  case 1:       /* paused by a callback (stream will continue) */
+  case 3:
+    event_sched_post(recognize_task, recog);
+    break;
+  case 0:     /* end of stream */
     /* go on to the next input */
-    EM_ASM( setTimeout(Module.cwrap('main_event_recognition_stream_loop'), 0); );
+    event_sched_next_input();
     break;
   case -1:    /* error */
     jlog("ERROR: an error occured while recognition, terminate stream\n");
-    EM_ASM( Module.ccall('end_event_recognition_stream_loop'); );
+    event_sched_end_input();
+  }
+}
+
+/** 
+ * <EN>
+ * Start recognizing an opened input stream with the event-driven loop:
+ * its first step is posted to the scheduler (see event_sched.c).
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ * 
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+void
+event_recognize_stream_start(Recog *recog)
+{
+  event_sched_post(recognize_task, recog);
+}
+
+#ifdef HAVE_PTHREAD
+/** 
+ * <EN>
+ * @brief  Recognize an input stream on the decoding thread.
+ *
+ * In the pthread build, A/D-in runs on its own thread (see
+ * adin_thread_create()) and adin_go() waits for its samples, so the
+ * steps of event_recognize_stream() simply run in a loop until the
+ * stream ends.
+ * </EN>
+ * 
+ * @param recog [i/o] engine instance
+ * 
+ * @return 0 when reached end of stream, -1 on error.
+ *
+ * @callgraph
+ * @callergraph
+ * @ingroup engine
+ */
+int
+event_recognize_stream_thread(Recog *recog)
+{
+  int ret;
+
+  do {
+    ret = event_recognize_step(recog);
+  } while(ret == 1 || ret == 3);
+  if (ret == -1) {
+    jlog("ERROR: an error occured while recognition, terminate stream\n");
   }
+  return(ret);
+}
+
+/** 
+ * <EN>
+ * Discount from the decoding time of the gauges the time the decoding
+ * thread spent waiting for A/D-in samples.
+ * </EN>
+ * 
+ * @param msec [in] time waited (ms)
+ */
+void
+event_gauge_idle(double msec)
+{
+  if (e_gauge_speech) e_gauge_cpu -= msec;
 }
+#endif
 
 /* end of file */
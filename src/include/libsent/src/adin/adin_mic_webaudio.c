@@ -8,6 +8,19 @@
  * This relies on other alterations inherent in the port.
  * See the attached script (`emscripten.sh`) for details.
  *
+ * In the pthread build (`PTHREAD=1`, see `emscript.sh`), samples are
+ * read by the A/D-in thread of Julius while the worker fills the ring
+ * buffer, so the buffer is locked and reads wait for samples.
+ *
+ * In the event build, a buffer of samples in memory (a decoded audio
+ * file) can also be read at full speed in place of the microphone, as
+ * one input stream of its own, like a file of `-input rawfile`.
+ *
+ * The ring buffer starts with one second of samples.  It grows when a
+ * fill would overrun samples not read yet, up to about 20 seconds, past
+ * which the oldest are overwritten; it is brought back to one second
+ * once it has been read empty and stayed below half of that for a while.
+ *
  * For more details, see https://github.com/zzmp/juliusjs
  *
  * Tested on Chrome 35.0.1916.153 for OS X.
@@ -29,11 +42,79 @@
 
 #include <emscripten.h>
 
-static long limit = 320000; // About 20 seconds of buffer
-SP16 *buffer;
+#ifdef __EMSCRIPTEN_PTHREADS__
+#include <pthread.h>
+static pthread_mutex_t buffer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t buffer_filled = PTHREAD_COND_INITIALIZER;
+#define BUFFER_LOCK() pthread_mutex_lock(&buffer_mutex)
+#define BUFFER_UNLOCK() pthread_mutex_unlock(&buffer_mutex)
+#else
+#define BUFFER_LOCK()
+#define BUFFER_UNLOCK()
+#endif
+
+#define RING_MAX 320000		/* About 20 seconds of buffer */
+#define RING_IDLE 10		/* Seconds below half of the base to shrink */
+
+static long limit = 0;		/* current length of the ring buffer */
+static long limit_base = 0;	/* length at rest: one second of samples */
+static long idle_len = 0;	/* samples read since the fill was high */
+static int resizes = 0;		/* number of times the ring was resized */
+SP16 *buffer = NULL;
 long get_pos = 0;
 long set_pos = 0;
 
+#ifndef __EMSCRIPTEN_PTHREADS__
+/* Samples read in place of the microphone (see adin_mic_decode()) */
+#define MEMORY_NONE 0		/* reading the microphone */
+#define MEMORY_PENDING 1	/* to be read once the live stream ends */
+#define MEMORY_READING 2	/* read as the current stream */
+#define MEMORY_READ 3		/* read, stream ending */
+static int memory_state = MEMORY_NONE;
+static SP16 *memory = NULL;
+static long memory_len = 0;
+static long memory_pos = 0;
+#endif
+
+/**
+ * Number of samples waiting in the ring buffer.  Call locked.
+ *
+ * @return samples waiting to be read.
+ */
+static long
+ring_fill()
+{
+  return (set_pos >= get_pos) ? set_pos - get_pos : limit - get_pos + set_pos;
+}
+
+/**
+ * Resize the ring buffer, keeping the samples waiting in it, which
+ * must fit.  Call locked.
+ *
+ * @param len [in] new length of the ring buffer (in SP16)
+ */
+static void
+ring_resize(long len)
+{
+  SP16 *ring;
+  long fill;
+
+  fill = ring_fill();
+  ring = (SP16 *) malloc( sizeof(SP16) * len );
+  if (set_pos >= get_pos) {
+    memcpy(ring, buffer + get_pos, sizeof(SP16) * fill);
+  } else {
+    memcpy(ring, buffer + get_pos, sizeof(SP16) * (limit - get_pos));
+    memcpy(ring + limit - get_pos, buffer, sizeof(SP16) * set_pos);
+  }
+  free(buffer);
+  buffer = ring;
+  limit = len;
+  get_pos = 0;
+  set_pos = fill;
+  resizes++;
+}
+
 /**
  * Fill the microphone ring buffer from the Web Audio API
  *
@@ -43,6 +124,16 @@ long set_pos = 0;
 void
 fill_buffer(const SP16* audio_buf, unsigned int buffer_length)
 {
+  long len;
+
+  BUFFER_LOCK();
+  /* grow rather than overrun samples not read yet (one slot stays
+     free, as a full ring would read as empty) */
+  if (ring_fill() + buffer_length >= limit && limit < RING_MAX) {
+    len = limit * 2;
+    while (len <= ring_fill() + buffer_length) len *= 2;
+    ring_resize((len < RING_MAX) ? len : RING_MAX);
+  }
   if (buffer_length + set_pos <= limit) {
     memcpy(buffer + set_pos, audio_buf, sizeof(SP16) * buffer_length);
     set_pos += buffer_length;
@@ -53,7 +144,133 @@ fill_buffer(const SP16* audio_buf, unsigned int buffer_length)
     memcpy(buffer, audio_buf + tail, sizeof(SP16) * head);
     set_pos = head;
   }
+#ifdef __EMSCRIPTEN_PTHREADS__
+  pthread_cond_signal(&buffer_filled);
+#endif
+  BUFFER_UNLOCK();
+}
+
+/**
+ * Get the current status of the microphone ring buffer.
+ *
+ * @param len [out] length of the ring buffer (in SP16)
+ * @param fill [out] number of samples waiting to be read (in SP16)
+ * @param resized [out] number of times the ring buffer was resized
+ */
+void
+adin_mic_buffer_status(int *len, int *fill, int *resized)
+{
+  BUFFER_LOCK();
+  *len = (buffer != NULL) ? limit : 0;
+  *fill = (buffer != NULL) ? ring_fill() : 0;
+  *resized = resizes;
+  BUFFER_UNLOCK();
+}
+
+/**
+ * Put samples back in front of those waiting in the ring buffer, so
+ * that they are read again first.  If the ring buffer cannot hold them
+ * all, the last ones are kept.  Samples already read ahead by Julius
+ * (the rest of its input buffer, or more in the pthread build) are
+ * still processed before them.
+ *
+ * @param samples [in] samples to read again (in SP16)
+ * @param len [in] number of samples
+ */
+void
+adin_mic_replay(const SP16 *samples, int len)
+{
+  long fill, room;
+
+  BUFFER_LOCK();
+  if (buffer != NULL) {
+    fill = ring_fill();
+    /* one slot stays free, as a full ring would read as empty */
+    room = limit - 1 - fill;
+    if (len > room) {
+      samples += len - room;
+      len = room;
+    }
+    while(len > 0) {
+      get_pos = (get_pos == 0) ? limit - 1 : get_pos - 1;
+      buffer[get_pos] = samples[--len];
+    }
+#ifdef __EMSCRIPTEN_PTHREADS__
+    pthread_cond_signal(&buffer_filled);
+#endif
+  }
+  BUFFER_UNLOCK();
+}
+
+#ifndef __EMSCRIPTEN_PTHREADS__
+/**
+ * Read samples from memory in place of the microphone.  The live
+ * stream ends at the next read (an utterance in progress is finished
+ * and output as usual), then the samples are read as a stream of their
+ * own, without waiting, and the microphone is read again when it ends.
+ *
+ * The handling script is told when the samples are opened
+ * (`decodeBegin(len)`), as they are read (`decodeProgress(pos, len)`)
+ * and once all their results are output (`decodeEnd()`).
+ *
+ * @param samples [in] samples at the input rate, allocated with malloc();
+ * freed once read.
+ * @param len [in] number of samples
+ *
+ * @return TRUE on success, FALSE if samples are already being read.
+ */
+boolean
+adin_mic_decode(SP16 *samples, int len)
+{
+  if (memory_state != MEMORY_NONE) return FALSE;
+  memory = samples;
+  memory_len = len;
+  memory_pos = 0;
+  memory_state = MEMORY_PENDING;
+  return TRUE;
+}
+
+/**
+ * Whether samples from memory are being read, so that recognition need
+ * not wait for the microphone.
+ *
+ * @return TRUE when reading samples from memory.
+ */
+boolean
+adin_mic_offline()
+{
+  return(memory_state == MEMORY_READING);
+}
+
+/**
+ * Read samples from memory (see adin_mic_decode()).
+ *
+ * @param buf [out] samples obtained in this function.
+ * @param sampnum [in] wanted number of samples to be read.
+ *
+ * @return actual number of read samples, -1 at the end.
+ */
+static int
+memory_read(SP16 *buf, int sampnum)
+{
+  long nread;
+
+  if (memory_pos >= memory_len) {
+    free(memory);
+    memory = NULL;
+    memory_state = MEMORY_READ;
+    return -1;
+  }
+  nread = (memory_len - memory_pos >= sampnum) ? sampnum : memory_len - memory_pos;
+  memcpy(buf, memory + memory_pos, sizeof(SP16) * nread);
+  memory_pos += nread;
+  EM_ASM_ARGS({
+    decodeProgress($0, $1);
+  }, memory_pos, memory_len);
+
+  return nread;
 }
+#endif
 
 /** 
  * Device initialization: check device capability and open for recording.
@@ -66,12 +283,20 @@ fill_buffer(const SP16* audio_buf, unsigned int buffer_length)
 boolean
 adin_mic_standby(int sfreq, void *dummy)
 {
+  limit_base = (sfreq < RING_MAX) ? sfreq : RING_MAX;
+  limit = limit_base;
   buffer = (SP16 *) malloc( sizeof(SP16) * limit );
 
   // Tell handling script the requested rate
+#ifdef __EMSCRIPTEN_PTHREADS__
+  MAIN_THREAD_EM_ASM({
+    setRate(+$0);
+  }, sfreq);
+#else
   EM_ASM_ARGS({
     setRate(+$0);
   }, sfreq);
+#endif
 
   return TRUE;
 }
@@ -89,8 +314,27 @@ adin_mic_standby(int sfreq, void *dummy)
 boolean
 adin_mic_begin(char *pathname)
 {
+#ifndef __EMSCRIPTEN_PTHREADS__
+  // Results of the samples read from memory are all output by now
+  if (memory_state == MEMORY_READ) {
+    memory_state = MEMORY_NONE;
+    EM_ASM( decodeEnd() );
+  }
+  if (memory_state == MEMORY_PENDING) {
+    memory_state = MEMORY_READING;
+    EM_ASM_ARGS({
+      decodeBegin($0);
+    }, memory_len);
+    return TRUE;
+  }
+#endif
+
   // Tell handling script to begin sending audio
+#ifdef __EMSCRIPTEN_PTHREADS__
+  MAIN_THREAD_EM_ASM( begin() );
+#else
   EM_ASM( begin() );
+#endif
   
   return TRUE;
 }
@@ -107,19 +351,16 @@ adin_mic_end()
 }
 
 /**
- * @brief  Read samples from device.
- * 
- * Try to read @a sampnum samples and returns actual number of recorded
- * samples currently available.  This function will block until
- * at least some samples are obtained.
- * 
+ * Read samples from the ring buffer, as many as available up to
+ * @a sampnum.
+ *
  * @param buf [out] samples obtained in this function.
  * @param sampnum [in] wanted number of samples to be read.
- * 
- * @return actual number of read samples, -2 if an error occured.
+ *
+ * @return actual number of read samples.
  */
-int
-adin_mic_read(SP16 *buf, int sampnum)
+static int
+ring_read(SP16 *buf, int sampnum)
 {
   long nread = 0;
 
@@ -131,8 +372,59 @@ adin_mic_read(SP16 *buf, int sampnum)
     nread = (limit - get_pos >= sampnum) ? sampnum : limit - get_pos;
     memcpy(buf, buffer + get_pos, sizeof(SP16) * nread);
     get_pos = 0;
-    nread += adin_mic_read(buf + nread, sampnum - nread);
+    nread += ring_read(buf + nread, sampnum - nread);
+  }
+
+  return nread;
+}
+
+/**
+ * @brief  Read samples from device.
+ * 
+ * Try to read @a sampnum samples and returns actual number of recorded
+ * samples currently available.  In the event build, this returns 0
+ * when no sample is available, and Julius will call again on the next
+ * event.  In the pthread build, this blocks until at least some samples
+ * are obtained.
+ * 
+ * @param buf [out] samples obtained in this function.
+ * @param sampnum [in] wanted number of samples to be read.
+ * 
+ * @return actual number of read samples, -1 at the end of samples read
+ * from memory, -2 if an error occured.
+ */
+int
+adin_mic_read(SP16 *buf, int sampnum)
+{
+  int nread;
+
+#ifndef __EMSCRIPTEN_PTHREADS__
+  switch(memory_state) {
+  case MEMORY_PENDING:		/* end the live stream */
+    return -1;
+  case MEMORY_READING:
+    return memory_read(buf, sampnum);
+  }
+#endif
+
+  BUFFER_LOCK();
+#ifdef __EMSCRIPTEN_PTHREADS__
+  while(set_pos == get_pos) pthread_cond_wait(&buffer_filled, &buffer_mutex);
+#endif
+  nread = ring_read(buf, sampnum);
+  /* shrink once read empty after a while with little to read */
+  if (limit > limit_base) {
+    if (ring_fill() > limit_base / 2) {
+      idle_len = 0;
+    } else {
+      idle_len += nread;
+      if (idle_len >= RING_IDLE * limit_base && set_pos == get_pos) {
+        ring_resize(limit_base);
+        idle_len = 0;
+      }
+    }
   }
+  BUFFER_UNLOCK();
 
   return nread;
 }
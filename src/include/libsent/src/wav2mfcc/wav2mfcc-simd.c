@@ -0,0 +1,551 @@
+/**
+ * @file   wav2mfcc-simd.c
+ *
+ * <EN>
+ * @brief  Vectorized MFCC computation of a frame.
+ *
+ * This replaces WMP_calc() with a version whose hot loops (pre-emphasis
+ * and Hamming window, FFT, mel filterbank and DCT) work on 4 floats at
+ * a time.  Vectors are written with GCC/Clang vector extensions, so
+ * they become WebAssembly SIMD when compiled with `-msimd128` (see the
+ * SIMD variant in `emscript.sh`), and plain scalar code otherwise.
+ *
+ * The original WMP_calc() is kept as WMP_calc_scalar() (the build
+ * script renames it in wav2mfcc-pipe.c), and is used as fallback for
+ * the configurations not handled here: energy, spectral subtraction
+ * and VTLN.  With wmp_simd_setup(), the vector path can be disabled,
+ * or checked against the scalar one on every frame.
+ *
+ * Delta computation (WMP_deltabuf_*) is cheap and left as is.
+ * </EN>
+ *
+ * @author Zachary POMERANTZ
+ * @date   Tue Jul 22 10:17:00 2014
+ *
+ * $Revision: 1.00 $
+ *
+ */
+/*
+ * Copyright (c) 2014 Zachary Pomerantz, @zzmp
+ * Using the MIT License
+ */
+
+#include <sent/stddefs.h>
+#include <sent/mfcc.h>
+
+/* also built natively (`NATIVE=1`, see emscript.sh), where time of the
+   check is read from a monotonic clock */
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#else
+#include <time.h>
+static double
+emscripten_get_now()
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return(ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0);
+}
+#endif
+
+#ifdef __wasm_simd128__
+#include <wasm_simd128.h>
+#endif
+
+#define SIMD_WORK_MAX 4		///< Number of parameter sets to cache tables for
+#define SIMD_CHECK_REPORT 1000	///< Frames between check reports
+
+/// 4 floats, as one 128-bit vector
+typedef float v4sf __attribute__ ((vector_size (16)));
+
+/// Tables and work area of the vector path for a parameter set
+typedef struct {
+  Value *para;			///< Parameter set the tables were made for
+  int fftN;			///< FFT length
+  float *win;			///< Hamming window [framesize]
+  float *re, *im;		///< FFT work area [fftN]
+  float *twr, *twi;		///< FFT twiddles, those of half size h at h-1
+  int *bitrev;			///< Bit reversed index [fftN]
+  int klo, khi;			///< Spectral bins covered by the filterbank (1-based)
+  float *spec;			///< Amplitude (or power) spectrum, 1-based
+  int *chan_lo;			///< First spectral bin of each channel
+  int *chan_len;		///< Number of bins of each channel (padded to 4)
+  float **chan_wt;		///< Weights of each channel over its bins
+  int fbank_pad;		///< fbank_num padded to 4
+  float *fbank;			///< Log filterbank outputs [fbank_pad]
+  float *dct;			///< DCT table [mfcc_dim][fbank_pad]
+  float *lift;			///< Cepstral liftering weights [mfcc_dim]
+  float sqrt2var;		///< sqrt(2.0 / fbank_num)
+} SimdWork;
+
+static SimdWork simd_work[SIMD_WORK_MAX];
+static int simd_work_num = 0;
+
+static boolean simd_enabled = TRUE; ///< Use the vector path
+static boolean simd_check = FALSE;  ///< Compare with the scalar path
+
+/* check statistics */
+static int check_frames = 0;
+static float check_maxdiff = 0.0;
+static double check_scalar_ms = 0.0;
+static double check_simd_ms = 0.0;
+
+/* the original, renamed in wav2mfcc-pipe.c by the build script */
+void WMP_calc_scalar(MFCCWork *w, float *mfcc, Value *para);
+
+static v4sf
+load4(const float *p)
+{
+  v4sf v;
+  memcpy(&v, p, sizeof(v4sf));
+  return v;
+}
+
+static void
+store4(float *p, v4sf v)
+{
+  memcpy(p, &v, sizeof(v4sf));
+}
+
+static v4sf
+splat4(float x)
+{
+  v4sf v = {x, x, x, x};
+  return v;
+}
+
+static float
+hsum4(v4sf v)
+{
+  return v[0] + v[1] + v[2] + v[3];
+}
+
+static v4sf
+sqrt4(v4sf v)
+{
+#ifdef __wasm_simd128__
+  return (v4sf)wasm_f32x4_sqrt((v128_t)v);
+#else
+  v4sf r = {sqrtf(v[0]), sqrtf(v[1]), sqrtf(v[2]), sqrtf(v[3])};
+  return r;
+#endif
+}
+
+/**
+ * Dot product of two float arrays whose length is a multiple of 4.
+ *
+ * @param a [in] array
+ * @param b [in] array
+ * @param len [in] length, multiple of 4
+ *
+ * @return the dot product.
+ */
+static float
+dot4(const float *a, const float *b, int len)
+{
+  v4sf acc = splat4(0.0);
+  int i;
+
+  for(i = 0; i < len; i += 4) acc += load4(a + i) * load4(b + i);
+  return(hsum4(acc));
+}
+
+/**
+ * Mel frequency of a spectral bin, as the scalar filterbank.
+ *
+ * @param k [in] spectral bin (1-based)
+ * @param fres [in] frequency resolution scaled for mel
+ *
+ * @return the mel frequency.
+ */
+static float
+mel(int k, float fres)
+{
+  return(1127 * log(1 + (k - 1) * fres));
+}
+
+/**
+ * Build the tables for a parameter set: they follow the scalar
+ * filterbank of InitFBank() and cosine tables of the DCT, laid out for
+ * vector access.
+ *
+ * @param s [out] work area to build
+ * @param para [in] MFCC parameters
+ */
+static void
+simd_work_build(SimdWork *s, Value *para)
+{
+  int i, j, k, n, h, chan, maxChan, Nby2;
+  float fres, mlo, mhi, ms, *cf, *loWt;
+  short *loChan;
+
+  s->para = para;
+
+  /* Hamming window */
+  s->win = (float *)mymalloc(sizeof(float) * para->framesize);
+  for(i = 0; i < para->framesize; i++) {
+    s->win[i] = 0.54 - 0.46 * cos(2.0 * PI * i / (para->framesize - 1));
+  }
+
+  /* FFT */
+  s->fftN = 2; n = 1;
+  while(para->framesize > s->fftN) {
+    s->fftN *= 2; n++;
+  }
+  s->re = (float *)mymalloc(sizeof(float) * s->fftN);
+  s->im = (float *)mymalloc(sizeof(float) * s->fftN);
+  s->twr = (float *)mymalloc(sizeof(float) * s->fftN);
+  s->twi = (float *)mymalloc(sizeof(float) * s->fftN);
+  for(h = 1; h < s->fftN; h *= 2) {
+    for(j = 0; j < h; j++) {
+      s->twr[h - 1 + j] = cos(PI * j / h);
+      s->twi[h - 1 + j] = - sin(PI * j / h);
+    }
+  }
+  s->bitrev = (int *)mymalloc(sizeof(int) * s->fftN);
+  for(i = 0; i < s->fftN; i++) {
+    for(k = 0, j = 0; j < n; j++) k = (k << 1) | ((i >> j) & 1);
+    s->bitrev[i] = k;
+  }
+
+  /* mel filterbank, as InitFBank() */
+  Nby2 = s->fftN / 2;
+  fres = 1.0E7 / (para->smp_period * s->fftN * 700.0);
+  maxChan = para->fbank_num + 1;
+  s->klo = 2; s->khi = Nby2;
+  mlo = 0; mhi = mel(Nby2 + 1, fres);
+  if (para->lopass >= 0) {
+    mlo = 1127 * log(1 + (float)para->lopass / 700.0);
+    s->klo = ((para->lopass * para->smp_period * 1.0e-7 * s->fftN) + 2.5);
+    if (s->klo < 2) s->klo = 2;
+  }
+  if (para->hipass >= 0) {
+    mhi = 1127 * log(1 + (float)para->hipass / 700.0);
+    s->khi = ((para->hipass * para->smp_period * 1.0e-7 * s->fftN) + 0.5);
+    if (s->khi > Nby2) s->khi = Nby2;
+  }
+  ms = mhi - mlo;
+  cf = (float *)mymalloc(sizeof(float) * (maxChan + 1));
+  for(chan = 1; chan <= maxChan; chan++) {
+    cf[chan] = ((float)chan / (float)maxChan) * ms + mlo;
+  }
+  loChan = (short *)mymalloc(sizeof(short) * (Nby2 + 1));
+  loWt = (float *)mymalloc(sizeof(float) * (Nby2 + 1));
+  for(k = 1, chan = 1; k <= Nby2; k++) {
+    if (k < s->klo || k > s->khi) {
+      loChan[k] = -1;
+    } else {
+      while (chan <= maxChan && cf[chan] < mel(k, fres)) ++chan;
+      loChan[k] = chan - 1;
+    }
+  }
+  for(k = 1; k <= Nby2; k++) {
+    chan = loChan[k];
+    if (k < s->klo || k > s->khi) {
+      loWt[k] = 0.0;
+    } else if (chan > 0) {
+      loWt[k] = (cf[chan + 1] - mel(k, fres)) / (cf[chan + 1] - cf[chan]);
+    } else {
+      loWt[k] = (cf[1] - mel(k, fres)) / (cf[1] - mlo);
+    }
+  }
+
+  /* each channel takes the upper part (1 - loWt) of the bins below its
+     center, and the lower part (loWt) of the bins above: make them a
+     dense weight vector over contiguous bins */
+  s->chan_lo = (int *)mymalloc(sizeof(int) * (para->fbank_num + 1));
+  s->chan_len = (int *)mymalloc(sizeof(int) * (para->fbank_num + 1));
+  s->chan_wt = (float **)mymalloc(sizeof(float *) * (para->fbank_num + 1));
+  for(chan = 1; chan <= para->fbank_num; chan++) {
+    int lo = -1, hi = -1;
+    for(k = s->klo; k <= s->khi; k++) {
+      if (loChan[k] == chan - 1 || loChan[k] == chan) {
+	if (lo < 0) lo = k;
+	hi = k;
+      }
+    }
+    if (lo < 0) {
+      s->chan_lo[chan] = s->klo;
+      s->chan_len[chan] = 0;
+      s->chan_wt[chan] = NULL;
+      continue;
+    }
+    s->chan_lo[chan] = lo;
+    s->chan_len[chan] = (hi - lo + 4) & ~3;
+    s->chan_wt[chan] = (float *)mymalloc(sizeof(float) * s->chan_len[chan]);
+    for(i = 0; i < s->chan_len[chan]; i++) {
+      k = lo + i;
+      if (k > hi) s->chan_wt[chan][i] = 0.0;
+      else if (loChan[k] == chan) s->chan_wt[chan][i] = loWt[k];
+      else s->chan_wt[chan][i] = 1.0 - loWt[k];
+    }
+  }
+  free(cf);
+  free(loChan);
+  free(loWt);
+  /* padded reads of the last channel may go 3 bins beyond khi */
+  s->spec = (float *)mymalloc(sizeof(float) * (Nby2 + 8));
+  for(k = 0; k < Nby2 + 8; k++) s->spec[k] = 0.0;
+
+  /* DCT and liftering */
+  s->fbank_pad = (para->fbank_num + 3) & ~3;
+  s->fbank = (float *)mymalloc(sizeof(float) * s->fbank_pad);
+  for(j = 0; j < s->fbank_pad; j++) s->fbank[j] = 0.0;
+  s->dct = (float *)mymalloc(sizeof(float) * para->mfcc_dim * s->fbank_pad);
+  for(i = 1; i <= para->mfcc_dim; i++) {
+    for(j = 1; j <= s->fbank_pad; j++) {
+      s->dct[(i - 1) * s->fbank_pad + (j - 1)] = (j <= para->fbank_num) ? cos(PI * i / para->fbank_num * (j - 0.5)) : 0.0;
+    }
+  }
+  s->lift = (float *)mymalloc(sizeof(float) * para->mfcc_dim);
+  for(i = 1; i <= para->mfcc_dim; i++) {
+    s->lift[i - 1] = (para->lifter > 0) ? 1.0 + para->lifter / 2.0 * sin(i * PI / para->lifter) : 1.0;
+  }
+  s->sqrt2var = sqrt(2.0 / para->fbank_num);
+}
+
+/**
+ * Get the work area for a parameter set, building it on first use.
+ *
+ * @param para [in] MFCC parameters
+ *
+ * @return the work area, or NULL if too many parameter sets are in use.
+ */
+static SimdWork *
+simd_work_get(Value *para)
+{
+  int i;
+
+  for(i = 0; i < simd_work_num; i++) {
+    if (simd_work[i].para == para) return(&(simd_work[i]));
+  }
+  if (simd_work_num >= SIMD_WORK_MAX) return(NULL);
+  simd_work_build(&(simd_work[simd_work_num]), para);
+  return(&(simd_work[simd_work_num++]));
+}
+
+/**
+ * In-place radix-2 FFT of s->re, s->im, whose input is given in bit
+ * reversed order.  Butterflies of half size 4 and more are done by
+ * vectors.
+ *
+ * @param s [i/o] work area
+ */
+static void
+simd_fft(SimdWork *s)
+{
+  int g, h, j, n;
+  float *re, *im, tr, ti;
+  v4sf wr, wi, ar, ai, br, bi, vr, vi;
+
+  re = s->re; im = s->im; n = s->fftN;
+  for(h = 1; h < n && h < 4; h *= 2) {
+    for(g = 0; g < n; g += 2 * h) {
+      for(j = 0; j < h; j++) {
+	tr = re[g+h+j] * s->twr[h-1+j] - im[g+h+j] * s->twi[h-1+j];
+	ti = re[g+h+j] * s->twi[h-1+j] + im[g+h+j] * s->twr[h-1+j];
+	re[g+h+j] = re[g+j] - tr; im[g+h+j] = im[g+j] - ti;
+	re[g+j] += tr; im[g+j] += ti;
+      }
+    }
+  }
+  for(; h < n; h *= 2) {
+    for(g = 0; g < n; g += 2 * h) {
+      for(j = 0; j < h; j += 4) {
+	wr = load4(s->twr + h - 1 + j); wi = load4(s->twi + h - 1 + j);
+	ar = load4(re + g + j);     ai = load4(im + g + j);
+	br = load4(re + g + h + j); bi = load4(im + g + h + j);
+	vr = br * wr - bi * wi;
+	vi = br * wi + bi * wr;
+	store4(re + g + j, ar + vr);     store4(im + g + j, ai + vi);
+	store4(re + g + h + j, ar - vr); store4(im + g + h + j, ai - vi);
+      }
+    }
+  }
+}
+
+/**
+ * Vector path of WMP_calc().
+ *
+ * @param s [i/o] work area
+ * @param w [i/o] MFCC calculation work area, w->bf holds the frame
+ * @param mfcc [out] buffer to hold the resulting MFCC vector
+ * @param para [in] configuration parameters
+ */
+static void
+simd_calc(SimdWork *s, MFCCWork *w, float *mfcc, Value *para)
+{
+  float *bf, *x, p, mean, temp;
+  int i, k, chan, framesize;
+  v4sf vp, v, r, im;
+
+  bf = w->bf;			/* 1-based */
+  framesize = para->framesize;
+  x = s->im;			/* windowed frame, before bit reversal */
+
+  if (para->zmeanframe) {
+    mean = 0.0;
+    for(i = 1; i <= framesize; i++) mean += bf[i];
+    mean /= framesize;
+    for(i = 1; i <= framesize; i++) bf[i] -= mean;
+  }
+
+  /* pre-emphasis and Hamming window */
+  p = para->preEmph;
+  vp = splat4(p);
+  x[0] = bf[1] * (1.0 - p) * s->win[0];
+  for(i = 1; i + 4 <= framesize; i += 4) {
+    v = load4(bf + i + 1) - vp * load4(bf + i);
+    store4(x + i, v * load4(s->win + i));
+  }
+  for(; i < framesize; i++) x[i] = (bf[i + 1] - p * bf[i]) * s->win[i];
+  for(; i < s->fftN; i++) x[i] = 0.0;
+
+  /* FFT */
+  for(i = 0; i < s->fftN; i++) s->re[i] = x[s->bitrev[i]];
+  for(i = 0; i < s->fftN; i++) s->im[i] = 0.0;
+  simd_fft(s);
+
+  /* spectrum of bins klo..khi: bin k is FFT output k-1 */
+  for(k = s->klo; k + 4 <= s->khi + 1; k += 4) {
+    r = load4(s->re + k - 1);
+    im = load4(s->im + k - 1);
+    v = r * r + im * im;
+    store4(s->spec + k, para->usepower ? v : sqrt4(v));
+  }
+  for(; k <= s->khi; k++) {
+    temp = s->re[k - 1] * s->re[k - 1] + s->im[k - 1] * s->im[k - 1];
+    s->spec[k] = para->usepower ? temp : sqrtf(temp);
+  }
+
+  /* mel filterbank and logs */
+  for(chan = 1; chan <= para->fbank_num; chan++) {
+    temp = dot4(s->chan_wt[chan], s->spec + s->chan_lo[chan], s->chan_len[chan]);
+    if (temp < 1.0) temp = 1.0;
+    s->fbank[chan - 1] = log(temp);
+  }
+
+  /* DCT, liftering and c0 */
+  for(i = 0; i < para->mfcc_dim; i++) {
+    mfcc[i] = dot4(s->dct + i * s->fbank_pad, s->fbank, s->fbank_pad) * s->sqrt2var * s->lift[i];
+  }
+  if (para->c0) {
+    temp = 0.0;
+    for(chan = 0; chan < para->fbank_num; chan++) temp += s->fbank[chan];
+    mfcc[para->mfcc_dim] = temp * s->sqrt2var;
+  }
+}
+
+/**
+ * Run both paths on the frame and account the difference and speed.
+ *
+ * @param s [i/o] work area
+ * @param w [i/o] MFCC calculation work area
+ * @param mfcc [out] buffer to hold the resulting MFCC vector
+ * @param para [in] configuration parameters
+ */
+static void
+simd_calc_check(SimdWork *s, MFCCWork *w, float *mfcc, Value *para)
+{
+  static float *bf = NULL, *ref = NULL;
+  static int bflen = 0, reflen = 0;
+  double t;
+  float d;
+  int i, len;
+
+  if (bflen < para->framesize + 1) {
+    bflen = para->framesize + 1;
+    bf = (float *)myrealloc(bf, sizeof(float) * bflen);
+  }
+  len = para->mfcc_dim + para->c0;
+  if (reflen < para->baselen) {
+    reflen = para->baselen;
+    ref = (float *)myrealloc(ref, sizeof(float) * reflen);
+  }
+  memcpy(bf, w->bf, sizeof(float) * (para->framesize + 1));
+
+  t = emscripten_get_now();
+  WMP_calc_scalar(w, ref, para);
+  check_scalar_ms += emscripten_get_now() - t;
+
+  memcpy(w->bf, bf, sizeof(float) * (para->framesize + 1));
+  t = emscripten_get_now();
+  simd_calc(s, w, mfcc, para);
+  check_simd_ms += emscripten_get_now() - t;
+
+  for(i = 0; i < len; i++) {
+    d = fabs(mfcc[i] - ref[i]);
+    if (d > check_maxdiff) check_maxdiff = d;
+  }
+  if (++check_frames % SIMD_CHECK_REPORT == 0) {
+    jlog("STAT: MFCC SIMD check: %d frames, max diff %f, scalar %.0f frames/sec, SIMD %.0f frames/sec\n",
+	 check_frames, check_maxdiff,
+	 check_frames * 1000.0 / check_scalar_ms, check_frames * 1000.0 / check_simd_ms);
+  }
+}
+
+/**
+ * <EN>
+ * Configure the vector path of MFCC computation.
+ * </EN>
+ *
+ * @param enable [in] FALSE to always use the scalar path
+ * @param check [in] TRUE to run both paths on every frame, logging the
+ * largest difference and the speed of each
+ */
+void
+wmp_simd_setup(boolean enable, boolean check)
+{
+  simd_enabled = enable;
+  simd_check = check;
+}
+
+/**
+ * <EN>
+ * Tell whether the library is compiled with WebAssembly SIMD
+ * (`-msimd128`), that is, whether the vector paths are faster than the
+ * scalar ones.  Asked by the application, whose own objects are not
+ * compiled with the flag.
+ * </EN>
+ *
+ * @return TRUE in the SIMD variant (recognizer-simd.js), FALSE otherwise
+ */
+boolean
+wmp_simd_available()
+{
+#ifdef __wasm_simd128__
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+/**
+ * <EN>
+ * Calculate MFCC and log energy for one frame.  Perform spectral
+ * subtraction if @a ssbuf is specified.  Dispatches to the vector path
+ * when enabled and the configuration is handled by it.
+ * </EN>
+ *
+ * @param w [i/o] MFCC calculation work area
+ * @param mfcc [out] buffer to hold the resulting MFCC vector
+ * @param para [in] configuration parameters
+ */
+void
+WMP_calc(MFCCWork *w, float *mfcc, Value *para)
+{
+  SimdWork *s;
+
+  if (! simd_enabled
+      || para->energy || w->ssbuf != NULL || para->vtln_alpha != 1.0
+      || (s = simd_work_get(para)) == NULL) {
+    WMP_calc_scalar(w, mfcc, para);
+    return;
+  }
+
+  if (simd_check) simd_calc_check(s, w, mfcc, para);
+  else simd_calc(s, w, mfcc, para);
+}
+
+/* end of file */
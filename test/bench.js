@@ -0,0 +1,375 @@
+#!/usr/bin/env node
+// Accuracy and speed suite of the engine, run by `npm test`.
+//
+//   node test/bench.js [--build js/recognizer-node.js] [--runs 3] [--fixtures test/fixtures]
+//                      [--baseline test/baseline.json] [--update] [-- julius options]
+//   node test/bench.js --soak 10000 [--build js/recognizer-node.js] [-- julius options]
+//
+// Decodes the fixtures of test/fixtures, or of another directory of WAV
+// files with a transcripts.txt of the same format (see transcripts.txt, and
+// synth.js which made them) with the Node.js build (`NODE=1
+// ./emscript.sh`) on dist/voxforge and its sample grammar, offline, in
+// a fresh engine for each of `runs` runs.  A JSON report is written to
+// stdout:
+//
+//   fixtures   per file: expected and recognized sentence, score, gauges
+//   metrics    sentenceAccuracy, wordAccuracy (of the first run); rtf
+//              (decoding time / audio, from the engine gauges), wallRtf,
+//              startup (module instantiation + model loading, ms),
+//              peakHeap (bytes in use) and, with a `TRACE=1` build, the
+//              total time of each stage (ms); times are the best of runs
+//   regressions  metrics past their threshold against the baseline
+//
+// The process fails when a metric regresses: accuracies may not drop,
+// and times and peakHeap may not rise, by more than THRESHOLDS
+// (absolute for accuracies, relative otherwise; overridden by
+// `thresholds` in the baseline file).  Runs must agree, and the
+// baseline must hold every metric, stage times included when the build
+// has them.  `--update` stores the metrics as the new baseline instead,
+// keeping its thresholds.  Baselines hold times of one machine: measure
+// them where the suite runs.  The committed test/baseline.json holds
+// thresholds only, so the suite fails until `npm run baseline` has
+// measured one.
+//
+// `--soak N` (`npm run soak`) instead decodes N inputs, the fixtures over
+// and over, in one engine, and checks that memory stays bounded: the
+// heap in use at the end may not exceed the one after the first rounds
+// (SOAK_WARMUP inputs) by more than SOAK_GROWTH bytes.  It reports the
+// heap in use every `inputs / 20` inputs.
+
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+
+var THRESHOLDS = {
+  sentenceAccuracy: 0.05,	// absolute drop, less than one of the fixtures
+  wordAccuracy: 0.05,		// absolute drop
+  rtf: 0.15,			// relative rise
+  wallRtf: 0.15,
+  startup: 0.25,
+  peakHeap: 0.05,
+  stage: 0.25
+};
+var MIN_STAGE_MSEC = 5;		// shorter stage totals are not compared
+var SOAK_WARMUP = 100;		// inputs before the heap is expected to settle
+var SOAK_GROWTH = 64 * 1024;	// bytes the heap in use may still grow by
+
+// Member order of EventStats (see libjulius/include/julius/event.h)
+var HEAP_SIZE = 0, HEAP_INUSE = 2;
+
+var root = path.join(__dirname, '..');
+var model = path.join(root, 'dist', 'voxforge');
+
+var cli = require('./cli')('bench',
+  'usage: bench.js [--build js/recognizer-node.js] [--runs 3] [--fixtures test/fixtures] [--baseline test/baseline.json] [--update] [-- julius options]\n' +
+  '       bench.js --soak 10000 [--build js/recognizer-node.js] [-- julius options]');
+var fail = cli.fail;
+
+// - options
+
+var opts = {
+  build: path.join(root, 'js', 'recognizer-node.js'),
+  runs: 3,
+  fixtures: path.join(__dirname, 'fixtures'),
+  baseline: path.join(__dirname, 'baseline.json'),
+  update: false,
+  soak: 0
+};
+var extra = [];
+var rest = cli.parse({
+  '--build': function(file) { opts.build = path.resolve(file); },
+  '--runs': function(n) { opts.runs = parseInt(n, 10); },
+  '--fixtures': function(dir) { opts.fixtures = path.resolve(dir); },
+  '--baseline': function(file) { opts.baseline = path.resolve(file); },
+  '--update': function() { opts.update = true; },
+  '--soak': function(n) { opts.soak = parseInt(n, 10); },
+  '--': function(args) { extra = args; }
+});
+if (rest.length || !(opts.runs > 0) || !(opts.soak >= 0)) cli.usage();
+if (opts.soak) opts.runs = 1;
+cli.need(opts.build, 'NODE=1 ./emscript.sh');
+
+var cases = [];
+fs.readFileSync(path.join(opts.fixtures, 'transcripts.txt'), 'utf8').split(/\r?\n/).forEach(function(line) {
+  var fields = line.split('\t');
+  if (!line.trim() || line[0] === '#') return;
+  cases.push({file: path.join(opts.fixtures, fields[0] + '.wav'), expected: fields[1].trim()});
+});
+
+var list = path.join(os.tmpdir(), 'juliusjs-bench-' + process.pid + '.list');
+var inputs = cases;
+// Soak: the fixtures over and over
+if (opts.soak) {
+  inputs = [];
+  for (var n = 0; n < opts.soak; n++) inputs.push(cases[n % cases.length]);
+}
+fs.writeFileSync(list, inputs.map(function(c) { return c.file; }).join('\n') + '\n');
+
+var options = [
+  '-input',    'rawfile',
+  '-filelist', list,
+  '-h',        path.join(model, 'hmmdefs'),
+  '-hlist',    path.join(model, 'tiedlist'),
+  '-dfa',      path.join(model, 'sample.dfa'),
+  '-v',        path.join(model, 'sample.dict'),
+  '-nolog'
+].concat(extra);
+
+// - one run, in a fresh engine
+
+var run = function() {
+  return new Promise(function(resolve, reject) {
+    var results = [];
+    var current = null;
+    var peakHeap = 0, heapSize = 0;
+    var inUse = [];		// heap in use at the start of each input, then at the end
+    var Module = null;
+    var start = Date.now();
+    var times = {};
+
+    var sample = function() {
+      var ptr = Module.ccall('get_stats', 'number', [], []) >> 2;
+      peakHeap = Math.max(peakHeap, Module.HEAP32[ptr + HEAP_INUSE]);
+      heapSize = Math.max(heapSize, Module.HEAP32[ptr + HEAP_SIZE]);
+      inUse.push(Module.HEAP32[ptr + HEAP_INUSE]);
+    };
+
+    // Functions called by the engine (see recogloop.c and recogmain.c)
+    global.fileBegin = function(name) {
+      sample();
+      current = {file: name, sentence: null, score: null, audio: null, cpu: null};
+      results.push(current);
+    };
+    global.filesDone = function() {
+      sample();
+      var trace = Module._event_trace_json &&
+        Module.ccall('event_trace_json', 'string', ['number'], [1]);
+      var stages = null;
+      if (trace) {
+        stages = {};
+        var s = JSON.parse(trace).otherData.stages;
+        for (var name in s) stages[name] = s[name].total;
+      }
+      // let the loop end before the next run
+      setTimeout(function() {
+        resolve({results: results, peakHeap: peakHeap, heapSize: heapSize, inUse: inUse, stages: stages,
+                 instantiate: times.instantiate, init: times.init});
+      }, 0);
+    };
+    global.gauges = function(audio, cpu) {
+      if (!current) return;
+      current.audio = audio;
+      current.cpu = cpu;
+    };
+    global.pass1final = global.pass1verified = global.spotted = global.cascade = function() {};
+
+    var print = function(line) {
+      var match;
+      if (!current) return;
+      if ((match = line.match(/^sentence1: (.*)/)))
+        current.sentence = match[1].split(' ').filter(function(w) { return w[0] !== '<'; }).join(' ');
+      else if ((match = line.match(/^score1: (.*)/))) current.score = parseFloat(match[1]);
+    };
+
+    require(opts.build)({print: print, printErr: function() {}}).then(function(m) {
+      Module = m;
+      times.instantiate = Date.now() - start;
+      try { Module.callMain(options); }
+      catch (e) { reject(e); return; }
+      times.init = Date.now() - start - times.instantiate;
+    });
+  });
+};
+
+// - metrics
+
+var words = function(s) { return s ? s.split(/\s+/) : []; };
+
+// Edit distance between word sequences
+var errors = function(ref, hyp) {
+  var d = [];
+  for (var i = 0; i <= ref.length; i++) {
+    d.push([i]);
+    for (var j = 1; j <= hyp.length; j++) {
+      d[i][j] = i === 0 ? j : Math.min(d[i - 1][j] + 1, d[i][j - 1] + 1,
+                                       d[i - 1][j - 1] + (ref[i - 1] === hyp[j - 1] ? 0 : 1));
+    }
+  }
+  return d[ref.length][hyp.length];
+};
+
+var measure = function(runs) {
+  var first = runs[0];
+  var correct = 0, wordErrors = 0, wordCount = 0;
+  var report = cases.map(function(c, n) {
+    var r = first.results[n] || {};
+    var ref = words(c.expected), hyp = words(r.sentence);
+    var ok = r.sentence === c.expected;
+    if (ok) correct++;
+    wordErrors += errors(ref, hyp);
+    wordCount += ref.length;
+    return {file: path.basename(c.file), expected: c.expected, sentence: r.sentence || null,
+            score: r.score, correct: ok, audio: r.audio, cpu: r.cpu,
+            rtf: r.audio ? r.cpu / r.audio : null};
+  });
+
+  var best = function(f) { return Math.min.apply(null, runs.map(f)); };
+  var sum = function(results, key) {
+    return results.reduce(function(total, r) { return total + (r[key] || 0); }, 0);
+  };
+  var audio = sum(first.results, 'audio');
+  var metrics = {
+    sentenceAccuracy: correct / cases.length,
+    wordAccuracy: 1 - wordErrors / wordCount,
+    audio: audio,
+    rtf: best(function(r) { return sum(r.results, 'cpu') / audio; }),
+    wallRtf: best(function(r) { return r.wall / audio; }),
+    startup: best(function(r) { return r.instantiate + r.init; }),
+    instantiate: best(function(r) { return r.instantiate; }),
+    init: best(function(r) { return r.init; }),
+    peakHeap: Math.max.apply(null, runs.map(function(r) { return r.peakHeap; })),
+    heapSize: Math.max.apply(null, runs.map(function(r) { return r.heapSize; })),
+    stages: null
+  };
+  if (first.stages) {
+    metrics.stages = {};
+    for (var stage in first.stages)
+      metrics.stages[stage] = best(function(r) { return r.stages[stage]; });
+  }
+  // runs must agree on every result
+  var agree = runs.every(function(r) {
+    return r.results.length === first.results.length && r.results.every(function(x, n) {
+      return x.sentence === first.results[n].sentence && x.score === first.results[n].score;
+    });
+  });
+  return {fixtures: report, metrics: metrics, deterministic: agree};
+};
+
+var compare = function(metrics, baseline) {
+  var thresholds = Object.assign({}, THRESHOLDS, baseline.thresholds || {});
+  var b = baseline.metrics;
+  var out = [];
+  // every metric is gated: one the baseline lacks is a regression too
+  var missing = function(key, base, value) {
+    if (base !== undefined && base !== null && value !== undefined && value !== null) return false;
+    out.push({metric: key, baseline: base === undefined ? null : base, value: value});
+    return true;
+  };
+  var drop = function(key) {
+    if (missing(key, b[key], metrics[key])) return;
+    if (metrics[key] < b[key] - thresholds[key])
+      out.push({metric: key, baseline: b[key], value: metrics[key], limit: b[key] - thresholds[key]});
+  };
+  var rise = function(key, value, base, threshold) {
+    if (missing(key, base, value)) return;
+    if (value > base * (1 + threshold))
+      out.push({metric: key, baseline: base, value: value, limit: base * (1 + threshold)});
+  };
+  drop('sentenceAccuracy');
+  drop('wordAccuracy');
+  ['rtf', 'wallRtf', 'startup', 'peakHeap'].forEach(function(key) {
+    rise(key, metrics[key], b[key], thresholds[key]);
+  });
+  // stage times are there with a TRACE=1 build, which the baseline must match
+  if (metrics.stages || b.stages) {
+    if (missing('stages', b.stages, metrics.stages)) return out;
+    for (var stage in b.stages) {
+      if (b.stages[stage] >= MIN_STAGE_MSEC)
+        rise('stages.' + stage, metrics.stages[stage], b.stages[stage], thresholds.stage);
+    }
+  }
+  return out;
+};
+
+// Whether the heap in use stayed bounded over a soak run
+var soak = function(r) {
+  var warm = Math.min(SOAK_WARMUP, r.inUse.length - 1);
+  var settled = Math.max.apply(null, r.inUse.slice(0, warm + 1));
+  var end = r.inUse[r.inUse.length - 1];
+  var step = Math.max(1, Math.floor(r.inUse.length / 20));
+  var trace = [];
+  for (var i = 0; i < r.inUse.length; i += step) trace.push({input: i, heapInUse: r.inUse[i]});
+  return {
+    inputs: r.results.length,
+    settled: settled,
+    end: end,
+    growth: end - settled,
+    limit: SOAK_GROWTH,
+    peakHeap: r.peakHeap,
+    bounded: end - settled <= SOAK_GROWTH,
+    correct: r.results.filter(function(x, n) { return x.sentence === inputs[n].expected; }).length,
+    trace: trace
+  };
+};
+
+// - run
+
+var runs = [];
+var next = function() {
+  var start = Date.now();
+  return run().then(function(r) {
+    r.wall = Date.now() - start - r.instantiate - r.init;
+    runs.push(r);
+    if (runs.length < opts.runs) return next();
+  });
+};
+
+next().then(function() {
+  fs.unlinkSync(list);
+  if (opts.soak) {
+    var soaked = soak(runs[0]);
+    console.log(JSON.stringify({build: path.relative(root, opts.build), options: extra, soak: soaked}, null, 2));
+    if (!soaked.bounded) fail('heap in use grew by ' + soaked.growth + ' bytes over ' + soaked.inputs + ' inputs');
+    process.exit(0);
+  }
+  var result = measure(runs);
+  var report = {
+    build: path.relative(root, opts.build),
+    options: extra,
+    runs: runs.length,
+    deterministic: result.deterministic,
+    fixtures: result.fixtures,
+    metrics: result.metrics,
+    baseline: null,
+    regressions: []
+  };
+
+  if (opts.update) {
+    // thresholds set by hand are kept
+    var stored = {options: extra, metrics: result.metrics};
+    if (fs.existsSync(opts.baseline)) {
+      var previous = JSON.parse(fs.readFileSync(opts.baseline, 'utf8'));
+      if (previous.thresholds) stored.thresholds = previous.thresholds;
+    }
+    fs.writeFileSync(opts.baseline, JSON.stringify(stored, null, 2) + '\n');
+    report.baseline = path.relative(root, opts.baseline);
+  } else if (fs.existsSync(opts.baseline)) {
+    var baseline = JSON.parse(fs.readFileSync(opts.baseline, 'utf8'));
+    report.baseline = path.relative(root, opts.baseline);
+    if (JSON.stringify(baseline.options || []) !== JSON.stringify(extra))
+      report.regressions.push({metric: 'options', baseline: baseline.options, value: extra});
+    else
+      report.regressions = compare(result.metrics, baseline);
+  } else {
+    report.regressions.push({metric: 'baseline', baseline: null, value: path.relative(root, opts.baseline)});
+    console.error('bench: no baseline at ' + opts.baseline + ', store one with `npm run baseline`');
+  }
+
+  console.log(JSON.stringify(report, null, 2));
+  if (!result.deterministic) fail('runs disagree on results');
+  if (report.regressions.length) {
+    report.regressions.forEach(function(r) {
+      if (r.metric !== 'baseline' && r.baseline === null)
+        console.error('bench: ' + r.metric + ' is not in the baseline, measure one with `npm run baseline`');
+      else if (r.metric !== 'options' && (r.value === null || r.value === undefined))
+        console.error('bench: ' + r.metric + ' is in the baseline but not measured by this build');
+      else
+        console.error('bench: ' + r.metric + ' regressed: ' + JSON.stringify(r.value) +
+          ' (baseline ' + JSON.stringify(r.baseline) + (r.limit !== undefined ? ', limit ' + r.limit : '') + ')');
+    });
+    process.exit(1);
+  }
+  process.exit(0);
+}).catch(function(e) {
+  fail(e.stack || e);
+});
@@ -0,0 +1,339 @@
+#!/usr/bin/env node
+// Replay the fixtures into the worker at the cadence of the browser, to
+// measure end-to-end latency.
+//
+//   node test/cadence.js [--dir js] [--rate 44100] [--repeat 1] [--gap 500]
+//                        [--timeout 5000] [--load 0] [--jank 0/100]
+//                        [--options '{"pass1final": true}'] [--record session.jjsr]
+//                        [fixture.wav ...]
+//
+// worker.js of `dir` (a build made by emscript.sh) runs on a thread
+// standing in for a Web Worker (see host.js), and the main thread plays
+// the page: as julius.js `postBuffer` does for each `onaudioprocess`, it
+// posts 4096 samples at the context rate every 4096 / rate seconds, on a
+// clock that does not drift.  The stream is low noise, in which each
+// fixture (test/fixtures by default) is played in turn, followed by
+// noise until its result comes back, then `gap` more msec.
+//
+// Speech ends at the end of the last word of the label file next to the
+// fixture (name.lab, see synth.js), at the time it would have been
+// spoken; a result is delivered when the page receives it.  Latency is
+// the time in between, for the final result and for the 1st pass one.
+//
+// CPU contention is synthetic: `--load N` keeps N more threads busy, and
+// `--jank ms/period` blocks the thread of the worker for `ms` every
+// `period` msec., as long tasks of the page or garbage collections do.
+//
+// A JSON report is written to stdout: per utterance, the expected and
+// recognized sentences, speech end and latencies (msec.); then the
+// percentiles (p50, p95, p99, max) of latencies, and of the lateness of
+// audio callbacks.  With `pass1final` in `--options`, `fastPath` tells
+// how many results were final on the 1st pass, and with `pass1verify`,
+// how many the 2nd pass corrected and the agreement rate; compare its
+// latencies with a run without.  With `--record`, the session is also
+// recorded for replay.js (see `options.record` in worker.js).
+
+var fs = require('fs');
+var path = require('path');
+var threads = require('worker_threads');
+var performance = require('perf_hooks').performance;
+
+var BUFFER = 4096;		// samples per `onaudioprocess` (see julius.js)
+var NOISE = 0.0005;		// amplitude of the background noise
+
+var cli = require('./cli')('cadence',
+  'usage: cadence.js [--dir js] [--rate 44100] [--repeat 1] [--gap 500] [--timeout 5000]\n' +
+  '                  [--load 0] [--jank ms/period] [--options json] [--record session.jjsr]\n' +
+  '                  [fixture.wav ...]');
+var fail = cli.fail;
+
+// - load thread
+
+var spin = function() {
+  for (;;);
+};
+
+if (!threads.isMainThread) {
+  spin();
+  return;
+}
+
+// - options
+
+var opts = {
+  dir: path.join(__dirname, '..', 'js'),
+  rate: 44100,
+  repeat: 1,
+  gap: 500,
+  timeout: 5000,
+  load: 0,
+  jank: null,
+  options: {},
+  record: null
+};
+var files = cli.parse({
+  '--dir': function(dir) { opts.dir = path.resolve(dir); },
+  '--rate': function(n) { opts.rate = parseInt(n, 10); },
+  '--repeat': function(n) { opts.repeat = parseInt(n, 10); },
+  '--gap': function(ms) { opts.gap = parseFloat(ms); },
+  '--timeout': function(ms) { opts.timeout = parseFloat(ms); },
+  '--load': function(n) { opts.load = parseInt(n, 10); },
+  '--jank': function(value) {
+    var jank = value.split('/');
+    opts.jank = {ms: parseFloat(jank[0]), period: parseFloat(jank[1] || 100)};
+    return opts.jank.ms >= 0 && opts.jank.period > 0;
+  },
+  '--options': function(json) {
+    try { opts.options = JSON.parse(json); }
+    catch (e) { fail('--options: ' + e.message); }
+  },
+  '--record': function(file) { opts.record = path.resolve(file); }
+}).map(function(file) { return path.resolve(file); });
+if (!(opts.rate > 0 && opts.repeat > 0 && opts.load >= 0)) cli.usage();
+cli.need(path.join(opts.dir, 'worker.js'), './emscript.sh');
+
+if (!files.length) {
+  var fixtures = path.join(__dirname, 'fixtures');
+  files = fs.readdirSync(fixtures).filter(function(name) { return /\.wav$/.test(name); })
+    .map(function(name) { return path.join(fixtures, name); });
+}
+
+// - fixtures
+
+// 16-bit PCM WAV, as float samples at the context rate
+var readWav = function(file) {
+  var buf = fs.readFileSync(file);
+  if (buf.toString('ascii', 0, 4) !== 'RIFF' || buf.toString('ascii', 8, 12) !== 'WAVE')
+    fail(file + ': not a WAV file');
+  var rate = 0, channels = 1, bits = 0, data = null;
+  for (var at = 12; at + 8 <= buf.length; at += 8 + buf.readUInt32LE(at + 4) + (buf.readUInt32LE(at + 4) & 1)) {
+    var id = buf.toString('ascii', at, at + 4);
+    if (id === 'fmt ') {
+      channels = buf.readUInt16LE(at + 10);
+      rate = buf.readUInt32LE(at + 12);
+      bits = buf.readUInt16LE(at + 22);
+    } else if (id === 'data') {
+      data = buf.slice(at + 8, at + 8 + buf.readUInt32LE(at + 4));
+    }
+  }
+  if (bits !== 16 || !data) fail(file + ': only 16-bit PCM is supported');
+
+  var frames = Math.floor(data.length / 2 / channels);
+  var length = Math.floor(frames * opts.rate / rate);
+  var out = new Float32Array(length);
+  // linear interpolation of the first channel, as the browser resamples
+  for (var i = 0; i < length; i++) {
+    var x = i * rate / opts.rate;
+    var n = Math.floor(x);
+    var a = data.readInt16LE(n * channels * 2) / 32768;
+    var b = n + 1 < frames ? data.readInt16LE((n + 1) * channels * 2) / 32768 : a;
+    out[i] = a + (b - a) * (x - n);
+  }
+  return {samples: out, audio: frames * 1000 / rate};
+};
+
+// End of the last word of an HTK label file, in msec.
+var speechEnd = function(file) {
+  var end = null;
+  fs.readFileSync(file, 'utf8').split(/\r?\n/).forEach(function(line) {
+    var fields = line.trim().split(/\s+/);
+    if (fields.length < 3 || /^(sil|sp|<s>|<\/s>)$/.test(fields[2])) return;
+    end = parseInt(fields[1], 10) / 1e4;
+  });
+  return end;
+};
+
+var utterances = files.map(function(file) {
+  var lab = file.replace(/\.wav$/, '.lab');
+  if (!fs.existsSync(lab)) fail(lab + ' not found, see test/synth.js');
+  var wav = readWav(file);
+  var words = fs.readFileSync(lab, 'utf8').split(/\r?\n/).map(function(line) {
+    return line.trim().split(/\s+/)[2];
+  }).filter(function(word) { return word && !/^(sil|sp|<s>|<\/s>)$/.test(word); });
+  return {file: file, samples: wav.samples, audio: wav.audio, end: speechEnd(lab),
+          expected: words.join(' ')};
+});
+
+// - page
+
+var period = BUFFER * 1000 / opts.rate;
+var noise = (function() {
+  var seed = 1;
+  return function() {
+    seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+    return (seed / 0x3fffffff - 1) * NOISE;
+  };
+}() );
+
+var loads = [];
+for (var i = 0; i < opts.load; i++)
+  loads.push(new threads.Worker(__filename));
+
+var worker = new threads.Worker(path.join(__dirname, 'host.js'), {workerData: {dir: opts.dir, jank: opts.jank}});
+
+var queue = [];
+for (var r = 0; r < opts.repeat; r++) queue = queue.concat(utterances);
+
+var results = [];
+var lateness = [];
+var current = null;		// utterance being played or waited for
+var last = null;		// utterance done last, which may still be corrected
+var pos = 0;			// samples played of the current one
+var idleUntil = 0;		// noise is played until then between utterances
+var start = null;		// time of sample 0 of the stream
+var sent = 0;			// buffers posted
+
+// Start playing the next utterance, or end the run
+var next = function() {
+  if (!queue.length) return finish();
+  var u = queue.shift();
+  current = {
+    file: path.basename(u.file), expected: u.expected, samples: u.samples, audio: u.audio,
+    end: u.end, sentences: [], pass1: null, final: null, gauges: null, pass1Final: false
+  };
+  current.speechEnd = start + sent * period + u.end;
+  pos = 0;
+};
+
+// The utterance got its result, or none in time
+var done = function(timedOut) {
+  var u = current;
+  u.result = {
+    file: u.file,
+    expected: u.expected,
+    sentence: u.sentences.length ? u.sentences.join(' ') : null,
+    correct: u.sentences.join(' ') === u.expected,
+    timedOut: timedOut,
+    speechEnd: u.end,
+    latency: u.final === null ? null : u.final - u.speechEnd,
+    pass1Latency: u.pass1 === null ? null : u.pass1 - u.speechEnd,
+    pass1Final: u.pass1Final,
+    corrected: !!u.corrected,
+    gauges: u.gauges
+  };
+  results.push(u.result);
+  last = u;
+  current = null;
+  idleUntil = performance.now() + opts.gap;
+};
+
+var buffer = function() {
+  var out = new Float32Array(BUFFER);
+  for (var i = 0; i < BUFFER; i++) {
+    out[i] = noise();
+    if (current && pos < current.samples.length) out[i] += current.samples[pos++];
+  }
+  return out;
+};
+
+// Post the buffers due, as `onaudioprocess` does once each is recorded
+var tick = function() {
+  var now = performance.now();
+  while (start + (sent + 1) * period <= now) {
+    lateness.push(now - (start + (sent + 1) * period));
+    worker.postMessage(buffer());
+    sent++;
+    now = performance.now();
+  }
+  if (current && current.final === null && now - current.speechEnd > opts.timeout) done(true);
+  if (!current && now >= idleUntil && !next.ended) next();
+  if (next.ended) return;
+  setTimeout(tick, Math.max(0, start + (sent + 1) * period - performance.now()));
+};
+
+var percentiles = function(values) {
+  values = values.filter(function(v) { return v !== null; }).sort(function(a, b) { return a - b; });
+  if (!values.length) return null;
+  var at = function(p) { return values[Math.min(values.length - 1, Math.ceil(p * values.length) - 1)]; };
+  return {count: values.length, p50: at(0.5), p95: at(0.95), p99: at(0.99), max: values[values.length - 1]};
+};
+
+// Results final on the 1st pass (see `options.pass1final` in README.md)
+var fastPath = function() {
+  if (opts.options.pass1final === undefined) return null;
+  var taken = results.filter(function(r) { return r.pass1Final; });
+  var corrected = taken.filter(function(r) { return r.corrected; }).length;
+  return {
+    pass1Final: taken.length,
+    corrected: corrected,
+    agreement: opts.options.pass1verify && taken.length ? (taken.length - corrected) / taken.length : null,
+    latency: percentiles(taken.map(function(r) { return r.latency; }))
+  };
+};
+
+var finish = function() {
+  next.ended = true;
+  // Save the recording first
+  if (opts.record && !finish.saved) {
+    worker.postMessage({type: 'recording'});
+    return;
+  }
+  worker.terminate();
+  loads.forEach(function(load) { load.terminate(); });
+  console.log(JSON.stringify({
+    dir: path.relative(process.cwd(), opts.dir) || '.',
+    rate: opts.rate,
+    contention: {load: opts.load, jank: opts.jank},
+    options: opts.options,
+    recording: opts.record && path.relative(process.cwd(), opts.record),
+    utterances: results,
+    summary: {
+      utterances: results.length,
+      correct: results.filter(function(r) { return r.correct; }).length,
+      timedOut: results.filter(function(r) { return r.timedOut; }).length,
+      latency: percentiles(results.map(function(r) { return r.latency; })),
+      pass1Latency: percentiles(results.map(function(r) { return r.pass1Latency; })),
+      callbackLateness: percentiles(lateness),
+      fastPath: fastPath()
+    }
+  }, null, 2));
+};
+
+worker.on('error', function(e) { fail(e.stack || e); });
+worker.on('message', function(data) {
+  var now = performance.now();
+
+  if (data.type === 'begin') {
+    // The microphone is open: start the stream
+    start = now;
+    idleUntil = now + opts.gap;
+    tick();
+  } else if (data.type === 'recog') {
+    // The 2nd pass corrected the 1st pass result of an utterance done
+    if (data.correction && !current && last) {
+      last.sentences.pop();
+      last.sentences.push(data.sentence);
+      last.result.sentence = last.sentences.join(' ');
+      last.result.correct = last.result.sentence === last.expected;
+      last.result.corrected = true;
+      return;
+    }
+    if (!current) return;
+    if (data.firstpass) {
+      current.pass1 = now;
+    } else {
+      if (data.correction) {
+        current.sentences.pop();
+        current.corrected = true;
+      }
+      if (data.margin !== undefined) current.pass1Final = true;
+      current.sentences.push(data.sentence);
+      current.gauges = data.gauges || null;
+      // Segments before the end of speech are part of the utterance
+      if (now >= current.speechEnd) {
+        current.final = now;
+        done(false);
+      }
+    }
+  } else if (data.type === 'recording') {
+    if (!data.recording) fail('the build of ' + opts.dir + ' does not record sessions');
+    fs.writeFileSync(opts.record, Buffer.from(data.recording));
+    finish.saved = true;
+    finish();
+  } else if (data.type === 'error') {
+    fail('engine error' + (data.error ? ': ' + data.error : ''));
+  }
+});
+
+if (opts.record) opts.options.record = true;
+worker.postMessage({type: 'begin', options: opts.options});
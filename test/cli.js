@@ -0,0 +1,62 @@
+// Command line of the scripts of test/ and bin/: usage and failure
+// messages, options, and the builds they need.
+//
+//   var cli = require('./cli')('bench', 'usage: bench.js [--runs 3] [--update] [-- julius options]');
+//   var files = cli.parse({
+//     '--runs': function(n) { opts.runs = parseInt(n, 10); },
+//     '--update': function() { opts.update = true; },
+//     '--': function(rest) { extra = rest; }
+//   });
+//   cli.need(opts.build, 'NODE=1 ./emscript.sh');
+//
+// parse() reads the arguments of the process.  An option whose function
+// takes a parameter is given the next argument, the others are flags;
+// `--` is given all arguments after it, when the script takes them.  The
+// arguments that are not options are returned, in order.  An unknown
+// option, a missing value, or a function returning false prints the
+// usage and exits.
+
+var fs = require('fs');
+
+module.exports = function(name, usage) {
+  var cli = {};
+
+  // Print the usage and exit
+  cli.usage = function() {
+    console.error(usage);
+    process.exit(1);
+  };
+
+  // Print `message` as the script and exit
+  cli.fail = function(message) {
+    console.error(name + ': ' + message);
+    process.exit(1);
+  };
+
+  cli.parse = function(options) {
+    var args = process.argv.slice(2);
+    var rest = [];
+    while (args.length) {
+      var arg = args.shift();
+      var option = Object.prototype.hasOwnProperty.call(options, arg) ? options[arg] : null;
+      if (arg === '--' && option) {
+        option(args.splice(0));
+      } else if (option) {
+        if (option.length && !args.length) cli.usage();
+        if ((option.length ? option(args.shift()) : option()) === false) cli.usage();
+      } else if (arg[0] === '-' && arg.length > 1) {
+        cli.usage();
+      } else {
+        rest.push(arg);
+      }
+    }
+    return rest;
+  };
+
+  // Fail unless `file` exists, telling how to build it
+  cli.need = function(file, how) {
+    if (!fs.existsSync(file)) cli.fail(file + ' not found, build it with `' + how + '`');
+  };
+
+  return cli;
+};
@@ -0,0 +1,117 @@
+// A worker thread standing in for the Web Worker of julius.js, running
+// worker.js of a build on Node.js (see cadence.js and replay.js).
+//
+//   new Worker('test/host.js', {workerData: {dir: 'js', jank: {ms, period}}})
+//
+// worker.js runs in a context of its own, with the globals it and the
+// emscripted code use in a Worker: importScripts, postMessage (to the
+// parent thread, whose messages come to `onmessage`), `location`, and
+// an XMLHttpRequest that reads the files of `dir`.  With `jank`, the
+// thread is blocked for `ms` every `period` msec., as by long tasks.
+
+var fs = require('fs');
+var path = require('path');
+var vm = require('vm');
+var threads = require('worker_threads');
+var performance = require('perf_hooks').performance;
+
+var port = threads.parentPort;
+var job = threads.workerData;
+var dir = job.dir;
+
+var file = function(url) {
+  return path.resolve(dir, decodeURIComponent(String(url).replace(/^file:\/\//, '')));
+};
+
+var sandbox = {
+  setTimeout: setTimeout,
+  clearTimeout: clearTimeout,
+  setInterval: setInterval,
+  clearInterval: clearInterval,
+  performance: performance,
+  WebAssembly: WebAssembly,
+  MessageChannel: MessageChannel,
+  TextDecoder: TextDecoder,
+  TextEncoder: TextEncoder,
+  crypto: require('crypto').webcrypto,
+  location: {
+    href: 'file://' + path.join(dir, 'worker.js'),
+    pathname: path.join(dir, 'worker.js')
+  },
+  postMessage: function(data, transfer) { port.postMessage(data, transfer); },
+  __read: function(url) { return fs.readFileSync(file(url)); }
+};
+var context = vm.createContext(sandbox);
+
+sandbox.importScripts = function() {
+  for (var i = 0; i < arguments.length; i++) {
+    var name = file(arguments[i]);
+    if (!fs.existsSync(name)) {
+      // as browsers fail a script that cannot be fetched
+      var error = new Error('Failed to load ' + arguments[i]);
+      error.name = 'NetworkError';
+      throw error;
+    }
+    vm.runInContext(fs.readFileSync(name, 'utf8'), context, {filename: name});
+  }
+};
+
+// Files are read from `dir`; responses are made in the context, where
+// the emscripted code checks them
+vm.runInContext('var self = this;\n(' + function() {
+  self.XMLHttpRequest = function() {
+    this.readyState = 0;
+    this.status = 0;
+    this.responseType = '';
+  };
+  XMLHttpRequest.prototype.open = function(method, url, async) {
+    this.method = method;
+    this.url = url;
+    this.async = async !== false;
+  };
+  XMLHttpRequest.prototype.overrideMimeType = function() {};
+  XMLHttpRequest.prototype.setRequestHeader = function() {};
+  XMLHttpRequest.prototype.getResponseHeader = function(name) {
+    return /^content-length$/i.test(name) && this.length !== undefined ? String(this.length) : null;
+  };
+  XMLHttpRequest.prototype.send = function() {
+    var xhr = this;
+    var load = function() {
+      var bytes;
+      try { bytes = __read(xhr.url); }
+      catch (e) {
+        xhr.readyState = 4;
+        xhr.status = 404;
+        if (xhr.onerror) xhr.onerror(e);
+        return;
+      }
+      var data = new Uint8Array(bytes.length);
+      data.set(bytes);
+      xhr.readyState = 4;
+      xhr.status = 200;
+      xhr.length = data.length;
+      if (xhr.method !== 'HEAD') {
+        xhr.response = xhr.responseType === 'arraybuffer' ? data.buffer : bytes.toString('binary');
+        xhr.responseText = xhr.responseType === 'arraybuffer' ? null : xhr.response;
+      }
+      if (xhr.onprogress) xhr.onprogress({loaded: data.length, total: data.length, lengthComputable: true});
+      if (xhr.onreadystatechange) xhr.onreadystatechange();
+      if (xhr.onload) xhr.onload({});
+    };
+    if (this.async) setTimeout(load, 0);
+    else load();
+  };
+} + ')();', context);
+
+var jank = job.jank;
+if (jank && jank.ms > 0) {
+  setInterval(function() {
+    var until = performance.now() + jank.ms;
+    while (performance.now() < until);
+  }, jank.period);
+}
+
+port.on('message', function(data) {
+  if (sandbox.onmessage) sandbox.onmessage({data: data});
+});
+sandbox.importScripts('worker.js');
@@ -0,0 +1,148 @@
+#!/usr/bin/env node
+// Benchmark of the lexicon cache (`-lexcache`, `options.grammarCache`):
+// activation of grammars with their lexicon trees built, then read back.
+//
+//   node test/lexicon.js [--build js/recognizer-node.js] [--sizes 0,1000,10000]
+//
+// For each size N, the sample grammar with N made-up names added to
+// F_NAME_STEVE_YOUNG (see names.js) is activated in a fresh engine with
+// an empty cache directory (cold), then in another one with the file the
+// first wrote (cached).  Each engine decodes one fixture, so that the
+// tree read back is known to work.
+//
+// A JSON report is written to stdout: for each grammar, its words and
+// key, and for each run the time the tree took to build or read (msec.),
+// the startup of the engine including it, whether the tree was read,
+// the size of its file, and the sentence recognized.  It fails when a
+// cached run did not read the tree back, or recognized another sentence
+// than the cold one.
+
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+
+var root = path.join(__dirname, '..');
+var model = path.join(root, 'dist', 'voxforge');
+var CATEGORY = 'F_NAME_STEVE_YOUNG';
+
+var cli = require('./cli')('lexicon', 'usage: lexicon.js [--build js/recognizer-node.js] [--sizes 0,1000,10000]');
+var fail = cli.fail;
+
+var opts = {
+  build: path.join(root, 'js', 'recognizer-node.js'),
+  sizes: [0, 1000, 10000]
+};
+var rest = cli.parse({
+  '--build': function(file) { opts.build = path.resolve(file); },
+  '--sizes': function(list) { opts.sizes = list.split(',').map(function(n) { return parseInt(n, 10); }); }
+});
+if (rest.length || !opts.sizes.every(function(n) { return n >= 0; })) cli.usage();
+cli.need(opts.build, 'NODE=1 ./emscript.sh');
+
+var tmp = fs.mkdtempSync(path.join(os.tmpdir(), 'juliusjs-lexicon-'));
+var fixture = path.join(__dirname, 'fixtures', 'call-steve-young.wav');
+var list = path.join(tmp, 'files.list');
+fs.writeFileSync(list, fixture + '\n');
+
+// - grammars
+
+var category = (function() {
+  var found = null;
+  fs.readFileSync(path.join(model, 'sample.term'), 'utf8').split(/\r?\n/).forEach(function(line) {
+    var fields = line.trim().split(/\s+/);
+    if (fields[1] === CATEGORY) found = fields[0];
+  });
+  return found;
+}() );
+if (category === null) fail('no category ' + CATEGORY + ' in the sample grammar');
+
+// Dictionary of the sample grammar with `count` names
+var dictionary = function(count) {
+  var file = path.join(tmp, 'sample-' + count + '.dict');
+  var lines = require('./names')(count).map(function(name) {
+    return category + '\t[' + name.word + ']\t' + name.phones;
+  });
+  fs.writeFileSync(file, fs.readFileSync(path.join(model, 'sample.dict'), 'utf8') +
+                   (lines.length ? lines.join('\n') + '\n' : ''));
+  return file;
+};
+
+// - one activation, in a fresh engine
+
+var run = function(dict, cache) {
+  return new Promise(function(resolve, reject) {
+    var Module = null;
+    var report = {lexicon: null, startup: null, sentence: null};
+
+    // Functions called by the engine (see event_lexicon.c and recogloop.c)
+    global.lexiconBuilt = function(key, hit, msec, words, bytes) {
+      report.lexicon = {key: key, hit: hit, msec: msec, words: words, bytes: bytes};
+    };
+    global.fileBegin = function() {};
+    global.filesDone = function() {
+      // let the loop end before the next run
+      setTimeout(function() { resolve(report); }, 0);
+    };
+    global.gauges = global.pass1final = global.pass1verified = global.spotted = global.cascade = function() {};
+
+    var print = function(line) {
+      var match = line.match(/^sentence1: (.*)/);
+      if (match) report.sentence = match[1].split(' ').filter(function(w) { return w[0] !== '<'; }).join(' ');
+    };
+
+    require(opts.build)({print: print, printErr: function() {}}).then(function(m) {
+      Module = m;
+      var start = Date.now();
+      try {
+        Module.callMain([
+          '-input', 'rawfile', '-filelist', list,
+          '-h', path.join(model, 'hmmdefs'), '-hlist', path.join(model, 'tiedlist'),
+          '-dfa', path.join(model, 'sample.dfa'), '-v', dict,
+          '-lexcache', cache, '-nolog'
+        ]);
+      } catch (e) { reject(e); return; }
+      report.startup = Date.now() - start;
+      if (!report.lexicon) reject(new Error('no lexicon built, is the build older than -lexcache?'));
+    });
+  });
+};
+
+var result = function(r) {
+  return {msec: r.lexicon.msec, startup: r.startup, hit: r.lexicon.hit, bytes: r.lexicon.bytes,
+          sentence: r.sentence};
+};
+
+var report = {build: path.relative(root, opts.build), category: CATEGORY, grammars: []};
+var failures = [];
+
+opts.sizes.reduce(function(done, count) {
+  return done.then(function() {
+    var dict = dictionary(count);
+    var cache = path.join(tmp, 'cache-' + count);
+    var grammar = {names: count};
+    fs.mkdirSync(cache);
+    return run(dict, cache).then(function(cold) {
+      grammar.words = cold.lexicon.words;
+      grammar.key = cold.lexicon.key;
+      grammar.cold = result(cold);
+      return run(dict, cache);
+    }).then(function(cached) {
+      grammar.cached = result(cached);
+      grammar.speedup = cached.lexicon.msec ? grammar.cold.msec / cached.lexicon.msec : null;
+      report.grammars.push(grammar);
+      if (!cached.lexicon.hit)
+        failures.push(count + ' names: the tree was built again instead of read');
+      else if (cached.lexicon.key !== grammar.key)
+        failures.push(count + ' names: key ' + cached.lexicon.key + ' instead of ' + grammar.key);
+      if (cached.sentence !== grammar.cold.sentence)
+        failures.push(count + ' names: recognized "' + cached.sentence + '" from the cached tree, "' +
+                      grammar.cold.sentence + '" from the built one');
+    });
+  });
+}, Promise.resolve()).then(function() {
+  fs.rmSync(tmp, {recursive: true, force: true});
+  console.log(JSON.stringify(report, null, 2));
+  if (failures.length) fail(failures.join('\n'));
+}, function(e) {
+  fail(e.stack || e);
+});
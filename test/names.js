@@ -0,0 +1,41 @@
+// Made-up names for growing the sample grammar (see slots.js and
+// lexicon.js): `count` pronunciations, random but reproducible, whose
+// triphones are all listed in the tiedlist of the model.
+//
+//   require('./names')(1000) -> [{word: 'NAME0000', phones: 'k ae n ...'}, ...]
+
+var fs = require('fs');
+var path = require('path');
+
+module.exports = function(count) {
+  var listed = {};
+  var phones = {};
+  fs.readFileSync(path.join(__dirname, '..', 'dist', 'voxforge', 'tiedlist'), 'utf8')
+    .split(/\r?\n/).forEach(function(line) {
+      var name = line.trim().split(/\s+/)[0];
+      if (!name) return;
+      listed[name] = true;
+      var m = name.match(/^([^-+]+)-([^-+]+)\+([^-+]+)$/);
+      if (m) phones[m[2]] = true;
+    });
+  phones = Object.keys(phones).filter(function(p) { return p !== 'sil' && p !== 'sp'; }).sort();
+
+  var seed = 1;
+  var random = function(n) {
+    seed = (Math.imul(seed, 1103515245) + 12345) & 0x7fffffff;
+    return (seed >> 16) % n;
+  };
+  var list = [];
+  while (list.length < count) {
+    var seq = [phones[random(phones.length)]];
+    var len = 3 + random(4);
+    for (var tries = 0; seq.length < len && tries < 50; tries++) {
+      var next = phones[random(phones.length)];
+      if (seq.length < 2 || listed[seq[seq.length - 2] + '-' + seq[seq.length - 1] + '+' + next])
+        seq.push(next);
+    }
+    if (seq.length === len)
+      list.push({word: 'NAME' + ('000' + list.length).slice(-4), phones: seq.join(' ')});
+  }
+  return list;
+};
@@ -0,0 +1,126 @@
+#!/usr/bin/env node
+// Benchmark of batched output probabilities (`options.obatch`).
+//
+//   node test/obatch.js [--build js/recognizer-node.js] [--runs 3] [--batches 1,2,4,8]
+//                       [--native bin/julius-event]
+//
+// The fixtures are decoded by bench.js with each batch size K, on the
+// real-time 1st pass (`-realtime`, which then searches K-1 frames behind
+// the input) and with `-norealtime`.  K = 1 runs without `-obatch`.
+//
+// A JSON report is written to stdout: for each run, the options, frames
+// decoded per second of decoding time (100 / rtf, at 10 msec. frames),
+// rtf, and the accuracies, which should not change with K.  With a
+// build made with `TRACE=1`, the time spent in the 1st pass, the 2nd
+// pass and output probabilities is reported too (ms, over all fixtures),
+// so that the batches of the 2nd pass, which go back in time, are
+// measured apart from those of the 1st.  When the native build
+// (`NATIVE=1 ./emscript.sh`) and `perf` are found, each is also run
+// under `perf stat`, and the cache misses and references of the whole
+// decoding are reported.
+
+var fs = require('fs');
+var os = require('os');
+var path = require('path');
+var child = require('child_process');
+
+var root = path.join(__dirname, '..');
+var model = path.join(root, 'dist', 'voxforge');
+
+var cli = require('./cli')('obatch',
+  'usage: obatch.js [--build js/recognizer-node.js] [--runs 3] [--batches 1,2,4,8] [--native bin/julius-event]');
+var fail = cli.fail;
+
+var opts = {
+  build: path.join(root, 'js', 'recognizer-node.js'),
+  runs: 3,
+  batches: [1, 2, 4, 8],
+  native: path.join(root, 'bin', 'julius-event')
+};
+var rest = cli.parse({
+  '--build': function(file) { opts.build = path.resolve(file); },
+  '--runs': function(n) { opts.runs = parseInt(n, 10); },
+  '--batches': function(list) { opts.batches = list.split(',').map(function(k) { return parseInt(k, 10); }); },
+  '--native': function(file) { opts.native = path.resolve(file); }
+});
+if (rest.length || !(opts.runs > 0) || !opts.batches.every(function(k) { return k >= 1 && k <= 8; })) cli.usage();
+cli.need(opts.build, 'NODE=1 ./emscript.sh');
+
+var perf = (function() {
+  if (!fs.existsSync(opts.native)) return false;
+  return child.spawnSync('perf', ['--version']).status === 0;
+}() );
+
+var julius = function(k, realtime) {
+  return [realtime ? '-realtime' : '-norealtime'].concat(k > 1 ? ['-obatch', String(k)] : []);
+};
+
+// - Node.js build, through bench.js
+
+var bench = function(extra) {
+  var out = child.spawnSync(process.execPath, [
+    path.join(__dirname, 'bench.js'),
+    '--build', opts.build,
+    '--runs', String(opts.runs),
+    '--baseline', path.join(os.tmpdir(), 'juliusjs-obatch-none.json'),
+    '--'
+  ].concat(extra), {encoding: 'utf8', maxBuffer: 64 * 1024 * 1024});
+  if (out.status !== 0) fail('bench.js ' + extra.join(' ') + ' failed:\n' + out.stderr);
+  var metrics = JSON.parse(out.stdout).metrics;
+  return {
+    framesPerSec: metrics.rtf ? 100 / metrics.rtf : null,
+    rtf: metrics.rtf,
+    pass1Msec: metrics.stages ? metrics.stages.pass1 : null,
+    pass2Msec: metrics.stages ? metrics.stages.pass2 : null,
+    outprobMsec: metrics.stages ? metrics.stages.outprob : null,
+    sentenceAccuracy: metrics.sentenceAccuracy,
+    wordAccuracy: metrics.wordAccuracy
+  };
+};
+
+// - native build, under perf stat
+
+var list = path.join(os.tmpdir(), 'juliusjs-obatch-' + process.pid + '.list');
+
+var cache = function(extra) {
+  var out = child.spawnSync('perf', [
+    'stat', '-x', ',', '-e', 'cache-misses,cache-references', '--',
+    opts.native,
+    '-input', 'rawfile', '-filelist', list,
+    '-h', path.join(model, 'hmmdefs'), '-hlist', path.join(model, 'tiedlist'),
+    '-dfa', path.join(model, 'sample.dfa'), '-v', path.join(model, 'sample.dict'),
+    '-nolog'
+  ].concat(extra), {encoding: 'utf8', maxBuffer: 64 * 1024 * 1024});
+  var counts = {};
+  out.stderr.split('\n').forEach(function(line) {
+    var fields = line.split(',');
+    if (fields[2] === 'cache-misses') counts.cacheMisses = parseInt(fields[0], 10) || null;
+    if (fields[2] === 'cache-references') counts.cacheReferences = parseInt(fields[0], 10) || null;
+  });
+  if (counts.cacheMisses && counts.cacheReferences)
+    counts.missRate = counts.cacheMisses / counts.cacheReferences;
+  return counts;
+};
+
+if (perf) {
+  var files = [];
+  fs.readFileSync(path.join(__dirname, 'fixtures', 'transcripts.txt'), 'utf8').split(/\r?\n/).forEach(function(line) {
+    if (!line.trim() || line[0] === '#') return;
+    files.push(path.join(__dirname, 'fixtures', line.split('\t')[0] + '.wav'));
+  });
+  fs.writeFileSync(list, files.join('\n') + '\n');
+}
+
+var report = {build: path.relative(root, opts.build), runs: opts.runs,
+              native: perf ? path.relative(root, opts.native) : null, results: []};
+[true, false].forEach(function(realtime) {
+  opts.batches.forEach(function(k) {
+    var extra = julius(k, realtime);
+    var result = Object.assign({options: extra, batch: k, realtime: realtime}, bench(extra));
+    if (perf) Object.assign(result, cache(extra));
+    report.results.push(result);
+  });
+});
+if (perf) fs.unlinkSync(list);
+
+console.log(JSON.stringify(report, null, 2));
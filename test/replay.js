@@ -0,0 +1,54 @@
+#!/usr/bin/env node
+// Replay a recorded session into the engine, to reproduce and bisect
+// its performance offline.
+//
+//   node test/replay.js [--dir js] session.jjsr
+//
+// Sessions are recorded by worker.js with `options.record` and saved by
+// `julius.getRecording()` (or `cadence.js --record`): each fill of the
+// ring buffer, with its samples, and each task the engine ran.  The
+// build of `dir` (made by emscript.sh) is started on a thread standing
+// in for a Web Worker (see host.js) with the options of the session, and
+// is given the fills and run the tasks in the recorded order, at full
+// speed (see `replay` in worker.js).
+//
+// The report of worker.js is written to stdout as JSON: results at the
+// recorded time they came (msec. from the start of the session), count,
+// total and percentiles of task durations as recorded and as replayed,
+// the wall time of the replay and the peak heap in use.  `skipped`
+// counts recorded tasks the replayed build did not have pending, and
+// `pending` those it still had at the end: a build that steps
+// differently diverges from the recording.
+
+var fs = require('fs');
+var path = require('path');
+var threads = require('worker_threads');
+
+var cli = require('./cli')('replay', 'usage: replay.js [--dir js] session.jjsr');
+var fail = cli.fail;
+
+var dir = path.join(__dirname, '..', 'js');
+var args = cli.parse({
+  '--dir': function(value) { dir = path.resolve(value); }
+});
+if (args.length !== 1) cli.usage();
+var file = path.resolve(args[0]);
+cli.need(path.join(dir, 'worker.js'), './emscript.sh');
+
+var data = fs.readFileSync(file);
+var recording = data.buffer.slice(data.byteOffset, data.byteOffset + data.length);
+var worker = new threads.Worker(path.join(__dirname, 'host.js'), {workerData: {dir: dir}});
+
+worker.on('error', function(e) { fail(e.stack || e); });
+worker.on('message', function(data) {
+  if (data.type === 'replayed') {
+    worker.terminate();
+    if (data.error) fail(data.error);
+    data.report.file = path.relative(process.cwd(), file);
+    console.log(JSON.stringify(data.report, null, 2));
+  } else if (data.type === 'error') {
+    fail('engine error' + (data.error ? ': ' + data.error : ''));
+  }
+});
+
+worker.postMessage({type: 'replay', recording: recording}, [recording]);
@@ -0,0 +1,141 @@
+#!/usr/bin/env node
+// Benchmark of category slots: words added to a category of the running
+// grammar, then removed (see `addWords` in julius.js).
+//
+//   node test/slots.js [--dir js] [--count 1000] [--category F_NAME_STEVE_YOUNG]
+//
+// worker.js of `dir` (a build made by emscript.sh) runs with the sample
+// grammar on a thread standing in for a Web Worker (see host.js), and is
+// given low noise at the cadence of the browser, so that the engine
+// waits for input as it does on a page.  `count` made-up names, whose
+// pronunciations only have triphones of the acoustic model, are added to
+// `category` in one request, then removed in another.
+//
+// A JSON report is written to stdout: for each request, the time until
+// it was answered as the page sees it (msec.), the time the engine took
+// to rebuild the lexicon, and its size in words; the dictionary, lexicon
+// tree and heap in use before, with the names and after; and the startup
+// of the engine, which reloading the grammar would take again.
+
+var path = require('path');
+var threads = require('worker_threads');
+var performance = require('perf_hooks').performance;
+
+var BUFFER = 4096;		// samples per `onaudioprocess` (see julius.js)
+var RATE = 44100;
+var NOISE = 0.0005;		// amplitude of the background noise
+
+var cli = require('./cli')('slots', 'usage: slots.js [--dir js] [--count 1000] [--category F_NAME_STEVE_YOUNG]');
+var fail = cli.fail;
+
+var opts = {
+  dir: path.join(__dirname, '..', 'js'),
+  count: 1000,
+  category: 'F_NAME_STEVE_YOUNG'
+};
+var rest = cli.parse({
+  '--dir': function(dir) { opts.dir = path.resolve(dir); },
+  '--count': function(n) { opts.count = parseInt(n, 10); },
+  '--category': function(name) { opts.category = name; }
+});
+if (rest.length || !(opts.count > 0) || !opts.category) cli.usage();
+cli.need(path.join(opts.dir, 'worker.js'), './emscript.sh');
+
+// - names
+
+var names = require('./names')(opts.count);
+
+// - page
+
+var noise = (function() {
+  var seed = 1;
+  return function() {
+    seed = (seed * 1103515245 + 12345) & 0x7fffffff;
+    return (seed / 0x3fffffff - 1) * NOISE;
+  };
+}() );
+
+var worker = new threads.Worker(path.join(__dirname, 'host.js'), {workerData: {dir: opts.dir}});
+var period = BUFFER * 1000 / RATE;
+var start = null;
+var sent = 0;
+var ticking = null;
+
+// Post the buffers due, as `onaudioprocess` does once each is recorded
+var tick = function() {
+  while (start + (sent + 1) * period <= performance.now()) {
+    var out = new Float32Array(BUFFER);
+    for (var i = 0; i < BUFFER; i++) out[i] = noise();
+    worker.postMessage(out);
+    sent++;
+  }
+  ticking = setTimeout(tick, Math.max(0, start + (sent + 1) * period - performance.now()));
+};
+
+// Answers of the worker, by type
+var waiting = {};
+var request = function(data) {
+  return new Promise(function(resolve, reject) {
+    waiting[data.type] = {resolve: resolve, reject: reject};
+    worker.postMessage(data);
+  });
+};
+
+var sizes = function(stats) {
+  return {dict: stats.dict, wchmm: stats.wchmm, heapInUse: stats.heapInUse};
+};
+
+var change = function(remove) {
+  var asked = performance.now();
+  return request({type: 'slot', id: remove ? 2 : 1, category: opts.category, words: names, remove: remove})
+    .then(function(result) {
+      result.msec = performance.now() - asked;
+      return result;
+    });
+};
+
+var report = {dir: path.relative(process.cwd(), opts.dir) || '.', count: opts.count, category: opts.category};
+
+var run = function() {
+  request({type: 'stats'}).then(function(stats) {
+    report.startup = stats.startup && stats.startup.msec;
+    report.before = sizes(stats);
+    return change(false);
+  }).then(function(result) {
+    report.add = result;
+    return request({type: 'stats'});
+  }).then(function(stats) {
+    report.added = sizes(stats);
+    return change(true);
+  }).then(function(result) {
+    report.remove = result;
+    return request({type: 'stats'});
+  }).then(function(stats) {
+    report.after = sizes(stats);
+    clearTimeout(ticking);
+    worker.terminate();
+    console.log(JSON.stringify(report, null, 2));
+  }, function(error) {
+    fail(error.message || error);
+  });
+};
+
+worker.on('error', function(e) { fail(e.stack || e); });
+worker.on('message', function(data) {
+  if (data.type === 'begin') {
+    // The microphone is open: start the stream
+    start = performance.now();
+    tick();
+    run();
+  } else if (data.type === 'stats' || data.type === 'slot') {
+    var pending = waiting[data.type];
+    delete waiting[data.type];
+    if (!pending) return;
+    if (data.error) pending.reject(new Error(data.error));
+    else pending.resolve(data.type === 'stats' ? data.stats : data.result);
+  } else if (data.type === 'error') {
+    fail('engine error' + (data.error ? ': ' + data.error : ''));
+  }
+});
+
+worker.postMessage({type: 'begin', options: {}});
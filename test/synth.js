@@ -0,0 +1,317 @@
+#!/usr/bin/env node
+// Synthesize the WAV fixtures of the test suite from the acoustic model.
+//
+//   node test/synth.js [--model dist/voxforge] [--dict dist/voxforge/sample.dict]
+//                      test/fixtures/transcripts.txt
+//
+// Each line of the transcripts is `name<TAB>WORDS` (words of the dict,
+// without <s> and </s>).  The words are expanded to triphones as the
+// engine does (across words too, with silences at both ends), mapped to
+// physical HMMs through the HMM list, and each state is held for its
+// expected duration (1 / (1 - self-loop probability)) frames.  Its mean
+// cepstrum is turned back into a spectral envelope (unliftered, inverse
+// DCT to log filterbank energies, then fitted over FFT bins), which
+// shapes one pulse per frame shift (a 100 Hz buzz); the result is
+// de-emphasized and written as 16 kHz, 16-bit mono WAV next to the
+// transcripts as name.wav, along with the word alignment it was made
+// from as an HTK label file, name.lab (`start end word` in 100 ns units,
+// `sil` for the leading and trailing silences).
+//
+// The fixtures are a reproducible stand-in for recordings: they are as
+// close to the model as speech can be, so the suite tracks changes of
+// the engine rather than of the model's fit to a speaker.  The absolute
+// cepstral mean and energy are lost to the _Z and _N qualifiers of the
+// model; a flat mean is used, and energy follows the delta of c0.
+
+var fs = require('fs');
+var path = require('path');
+var hmmdefs = require('../bin/hmmdefs');
+
+// Front-end of the voxforge model (Julius defaults)
+var RATE = 16000;
+var SHIFT = 160;
+var FFT = 512;
+var FBANK = 24;
+var CEPS = 12;
+var LIFTER = 22;
+var PREEMPH = 0.97;
+var SILENCE = 'sil';
+var SIL_FRAMES = 8;		// per state of the leading and trailing silences
+var MAX_FRAMES = 12;		// per state of speech
+
+var cli = require('./cli')('synth', 'usage: synth.js [--model dist/voxforge] [--dict dist/voxforge/sample.dict] transcripts.txt');
+var fail = cli.fail;
+
+var model = path.join(__dirname, '..', 'dist', 'voxforge');
+var dictFile = null;
+var args = cli.parse({
+  '--model': function(dir) { model = dir; },
+  '--dict': function(file) { dictFile = file; }
+});
+if (args.length !== 1) cli.usage();
+dictFile = dictFile || path.join(model, 'sample.dict');
+
+// - model
+
+var am;
+try { am = hmmdefs.read(path.join(model, 'hmmdefs')); }
+catch (e) { fail(e.message); }
+
+var states = {};
+am.states.forEach(function(s) { states[s.name] = s; });
+
+// Transition matrices, as macros or inline
+var transp = function(text) {
+  var tokens = text.trim().split(/\s+/);
+  var n = parseInt(tokens[0], 10);
+  var m = [];
+  for (var i = 0; i < n; i++) m.push(tokens.slice(1 + i * n, 1 + (i + 1) * n).map(parseFloat));
+  return m;
+};
+var transMacros = {};
+var hmms = {};
+am.chunks.forEach(function(chunk) {
+  var head = chunk.match(/^~(\w) "([^"]*)"/);
+  if (!head) return;
+  if (head[1] === 't') transMacros[head[2]] = transp(chunk.split(/<TRANSP>/i)[1]);
+});
+am.chunks.forEach(function(chunk) {
+  var head = chunk.match(/^~h "([^"]*)"/);
+  if (!head) return;
+  var hmm = {states: [], trans: null};
+  var re = /<STATE>\s*\d+\s*~s "([^"]*)"/gi, match;
+  while ((match = re.exec(chunk))) hmm.states.push(states[match[1]]);
+  if ((match = chunk.match(/~t "([^"]*)"/))) hmm.trans = transMacros[match[1]];
+  else if ((match = chunk.split(/<TRANSP>/i)[1])) hmm.trans = transp(match.split(/<ENDHMM>/i)[0]);
+  if (!hmm.trans || hmm.states.indexOf(undefined) >= 0) fail('~h "' + head[1] + '": unsupported definition');
+  hmms[head[1]] = hmm;
+});
+
+// Logical names of the HMM list
+var physical = {};
+try {
+  fs.readFileSync(path.join(model, 'tiedlist'), 'latin1').split(/\r?\n/).forEach(function(line) {
+    var fields = line.trim().split(/\s+/);
+    if (fields[0]) physical[fields[0]] = fields[1] || fields[0];
+  });
+} catch (e) { fail(e.message); }
+
+var lookup = function(l, c, r) {
+  var names = [];
+  if (l && r) names.push(l + '-' + c + '+' + r);
+  if (r) names.push(c + '+' + r);
+  if (l) names.push(l + '-' + c);
+  names.push(c);
+  for (var i = 0; i < names.length; i++) {
+    if (physical[names[i]] && hmms[physical[names[i]]]) return hmms[physical[names[i]]];
+  }
+  fail('no HMM for ' + names[0]);
+};
+
+// - dictionary
+
+var dict = {};
+try {
+  fs.readFileSync(dictFile, 'latin1').split(/\r?\n/).forEach(function(line) {
+    var fields = line.trim().split(/\s+/);
+    if (fields.length < 3) return;
+    var word = fields[1].replace(/^\[(.*)\]$/, '$1');
+    if (!dict[word]) dict[word] = fields.slice(2);
+  });
+} catch (e) { fail(e.message); }
+
+// - front-end inversion
+
+var mel = function(f) { return 1127 * Math.log(1 + f / 700); };
+
+// Triangular filters over FFT bins, centers equally spaced on the mel scale
+var filters = (function() {
+  var top = mel(RATE / 2);
+  var centers = [];
+  for (var j = 0; j <= FBANK + 1; j++) centers.push(top * j / (FBANK + 1));
+  var w = [];
+  for (j = 1; j <= FBANK; j++) {
+    var row = new Float64Array(FFT / 2 + 1);
+    for (var k = 1; k <= FFT / 2; k++) {
+      var m = mel(k * RATE / FFT);
+      if (m > centers[j - 1] && m < centers[j + 1])
+        row[k] = m <= centers[j] ? (m - centers[j - 1]) / (centers[j] - centers[j - 1])
+                                 : (centers[j + 1] - m) / (centers[j + 1] - centers[j]);
+    }
+    w.push(row);
+  }
+  return {weights: w, centers: centers.slice(1, FBANK + 1)};
+}());
+
+// Log-amplitude over FFT bins, linear in mel between filter centers
+var spread = function(values) {
+  var out = new Float64Array(FFT / 2 + 1);
+  var c = filters.centers;
+  for (var k = 0; k <= FFT / 2; k++) {
+    var m = mel(k * RATE / FFT);
+    var j = 0;
+    while (j < FBANK - 2 && m > c[j + 1]) j++;
+    var t = Math.max(0, Math.min(1, (m - c[j]) / (c[j + 1] - c[j])));
+    out[k] = values[j] * (1 - t) + values[j + 1] * t;
+  }
+  return out;
+};
+
+// Magnitude spectrum whose filterbank outputs are exp(logfb)
+var envelope = function(logfb) {
+  var loga = spread(logfb);
+  for (var iter = 0; iter < 6; iter++) {
+    var err = [];
+    for (var j = 0; j < FBANK; j++) {
+      var sum = 0;
+      for (var k = 1; k <= FFT / 2; k++) sum += Math.exp(loga[k]) * filters.weights[j][k];
+      err.push(logfb[j] - Math.log(sum));
+    }
+    var fix = spread(err);
+    for (k = 0; k <= FFT / 2; k++) loga[k] += fix[k];
+  }
+  var a = new Float64Array(FFT / 2 + 1);
+  for (k = 1; k <= FFT / 2; k++) a[k] = Math.exp(loga[k]);
+  return a;
+};
+
+// Log filterbank energies from c0 and liftered c1..c12 (inverse of the DCT)
+var filterbank = function(c0, ceps) {
+  var logfb = [];
+  var norm = Math.sqrt(2 / FBANK);
+  for (var j = 0; j < FBANK; j++) {
+    var sum = c0 / 2;
+    for (var i = 1; i <= CEPS; i++) {
+      var raw = ceps[i - 1] / (1 + LIFTER / 2 * Math.sin(Math.PI * i / LIFTER));
+      sum += raw * Math.cos(Math.PI * i * (j + 0.5) / FBANK);
+    }
+    logfb.push(norm * sum);
+  }
+  return logfb;
+};
+
+// Zero-phase pulse of a magnitude spectrum, centered and tapered
+var pulse = function(a) {
+  var out = new Float64Array(FFT);
+  for (var n = 0; n < FFT; n++) {
+    var sum = a[0] + a[FFT / 2] * (n % 2 ? -1 : 1);
+    for (var k = 1; k < FFT / 2; k++) sum += 2 * a[k] * Math.cos(2 * Math.PI * k * (n - FFT / 2) / FFT);
+    out[n] = sum / FFT * (0.5 - 0.5 * Math.cos(2 * Math.PI * n / FFT));
+  }
+  return out;
+};
+
+// - synthesis
+
+var frames = function(words) {
+  var phones = [SILENCE];
+  var owner = [null];		// index of the word of each phone
+  words.forEach(function(word, w) {
+    if (!dict[word]) fail(word + ': not in ' + dictFile);
+    phones = phones.concat(dict[word]);
+    dict[word].forEach(function() { owner.push(w); });
+  });
+  phones.push(SILENCE);
+  owner.push(null);
+
+  var out = [];
+  phones.forEach(function(p, n) {
+    var silence = p === SILENCE;
+    var hmm = silence ? lookup(null, p, null) :
+      lookup(phones[n - 1] === SILENCE ? null : phones[n - 1], p,
+             phones[n + 1] === SILENCE ? null : phones[n + 1]);
+    hmm.states.forEach(function(s, i) {
+      var loop = hmm.trans[i + 1][i + 1];
+      var len = silence ? SIL_FRAMES :
+        Math.max(1, Math.min(MAX_FRAMES, Math.round(1 / (1 - loop))));
+      var best = s.mixtures.reduce(function(a, b) { return b.weight > a.weight ? b : a; });
+      for (var f = 0; f < len; f++) out.push({mean: best.mean, silence: silence, word: owner[n]});
+    });
+  });
+  return out;
+};
+
+// Frame t is centered on sample (t + 2) * SHIFT + 200 of the signal
+var labels = function(seq, words, length) {
+  var units = 1e7 / RATE;
+  var out = [];
+  var start = 0;
+  seq.forEach(function(frame, t) {
+    var next = seq[t + 1];
+    if (next && next.word === frame.word) return;
+    var at = function(f) {
+      return Math.round((f === 0 ? 0 : f === seq.length ? length : (f + 2) * SHIFT + 200) * units);
+    };
+    out.push(at(start) + ' ' + at(t + 1) + ' ' + (frame.word === null ? SILENCE : words[frame.word]));
+    start = t + 1;
+  });
+  return out.join('\n') + '\n';
+};
+
+var synthesize = function(words) {
+  var seq = frames(words);
+  var len = seq.length;
+  var signal = new Float64Array((len + 4) * SHIFT + FFT);
+  var c0 = 0;
+
+  seq.forEach(function(frame, t) {
+    // static cepstra, smoothed over neighbours for natural deltas
+    var ceps = [];
+    for (var i = 0; i < CEPS; i++) {
+      var prev = seq[Math.max(0, t - 1)].mean[i], next = seq[Math.min(len - 1, t + 1)].mean[i];
+      ceps.push(0.25 * prev + 0.5 * frame.mean[i] + 0.25 * next);
+    }
+    // energy from delta c0 (last dimension), drawn back to silence level
+    c0 = frame.silence ? 0.8 * c0 : Math.max(0, c0 + frame.mean[frame.mean.length - 1]);
+    var p = pulse(envelope(filterbank(c0, ceps)));
+    var at = (t + 2) * SHIFT - FFT / 2 + 200;
+    for (var n = 0; n < FFT; n++) if (at + n >= 0) signal[at + n] += p[n];
+  });
+
+  // undo pre-emphasis, then scale to 16 bits
+  var peak = 0;
+  for (var n = 1; n < signal.length; n++) {
+    signal[n] += PREEMPH * signal[n - 1];
+  }
+  var mean = 0;
+  for (n = 0; n < signal.length; n++) mean += signal[n];
+  mean /= signal.length;
+  for (n = 0; n < signal.length; n++) peak = Math.max(peak, Math.abs(signal[n] - mean));
+  var pcm = new Int16Array(signal.length);
+  for (n = 0; n < signal.length; n++) pcm[n] = Math.round((signal[n] - mean) / peak * 16000);
+  return {pcm: pcm, labels: labels(seq, words, pcm.length)};
+};
+
+var wav = function(pcm) {
+  var buf = Buffer.alloc(44 + pcm.length * 2);
+  buf.write('RIFF', 0);
+  buf.writeUInt32LE(36 + pcm.length * 2, 4);
+  buf.write('WAVEfmt ', 8);
+  buf.writeUInt32LE(16, 16);
+  buf.writeUInt16LE(1, 20);
+  buf.writeUInt16LE(1, 22);
+  buf.writeUInt32LE(RATE, 24);
+  buf.writeUInt32LE(RATE * 2, 28);
+  buf.writeUInt16LE(2, 32);
+  buf.writeUInt16LE(16, 34);
+  buf.write('data', 36);
+  buf.writeUInt32LE(pcm.length * 2, 40);
+  for (var n = 0; n < pcm.length; n++) buf.writeInt16LE(pcm[n], 44 + n * 2);
+  return buf;
+};
+
+var list = args[0];
+var lines;
+try { lines = fs.readFileSync(list, 'utf8').split(/\r?\n/); }
+catch (e) { fail(e.message); }
+lines.forEach(function(line) {
+  var fields = line.split('\t');
+  if (!line.trim() || line[0] === '#') return;
+  if (fields.length !== 2) fail(list + ': expected name<TAB>WORDS: ' + line);
+  var out = synthesize(fields[1].trim().split(/\s+/));
+  var pcm = out.pcm;
+  var file = path.join(path.dirname(list), fields[0] + '.wav');
+  fs.writeFileSync(file, wav(pcm));
+  fs.writeFileSync(file.replace(/\.wav$/, '.lab'), out.labels);
+  console.log('synth: ' + file + ': ' + (pcm.length / RATE).toFixed(2) + ' s, ' + fields[1].trim());
+});